@@ -2,10 +2,108 @@
 
 #include <stdint.h>
 
-#define CHANNELS 4
-#define SAMPLERATE 192000
+#define CHANNELS 4 // 2 for i2s, up to 16 TDM slots
+#define SAMPLERATE 192000 // format at begin(), AudioOutputI2S::setFormat() switches at runtime
 #define BIT_DEPTH 32
+
+// Half-block callback: 1 calls the callback on every DMA half interrupt instead of every
+// other one, with blocks of half the size. Saves a block of round trip latency for twice
+// the callbacks per second.
+#ifndef AUDIO_HALF_BLOCK_CALLBACK
+#define AUDIO_HALF_BLOCK_CALLBACK 0
+#endif
+
+// Samples per channel in each callback block: 16, 32, 64, 128 or 256. Smaller blocks mean
+// less latency and more interrupts per second. Set it per project or with -DAUDIO_BLOCK_SAMPLES=n.
+#ifndef AUDIO_BLOCK_SAMPLES
+#if AUDIO_HALF_BLOCK_CALLBACK
+#define AUDIO_BLOCK_SAMPLES 64
+#else
 #define AUDIO_BLOCK_SAMPLES 128
+#endif
+#endif
+
+#if AUDIO_BLOCK_SAMPLES != 16 && AUDIO_BLOCK_SAMPLES != 32 && AUDIO_BLOCK_SAMPLES != 64 && AUDIO_BLOCK_SAMPLES != 128 && AUDIO_BLOCK_SAMPLES != 256
+#error "AUDIO_BLOCK_SAMPLES must be 16, 32, 64, 128 or 256"
+#endif
+
+// Zero-copy mode: 1 makes i2sAudioViewCallback work directly on the DMA buffers through
+// strided views (see strided_view.h) instead of copying every block into and out of
+// the BufferQueues for i2sAudioCallback.
+#ifndef AUDIO_ZERO_COPY
+#define AUDIO_ZERO_COPY 0
+#endif
+
+// Deferred processing: 1 runs i2sAudioCallback from the low priority software interrupt
+// instead of inside the DMA interrupt. The DMA interrupts only move data, the callback
+// may then fall behind by up to BUFFER_QUEUE_SIZE - 1 blocks before the output repeats a block.
+#ifndef AUDIO_DEFERRED_PROCESSING
+#define AUDIO_DEFERRED_PROCESSING 0
+#endif
+
+// Float processing: 1 calls i2sAudioFloatCallback with float samples in [-1.0, 1.0) instead
+// of i2sAudioCallback. The conversion is part of the copy between the DMA buffers and the
+// BufferQueues (see utility/tdm_convert.h), the callback gets no extra pass over the block.
+#ifndef AUDIO_FLOAT_PROCESSING
+#define AUDIO_FLOAT_PROCESSING 0
+#endif
+
+// Blocks per BufferQueue. Each extra block adds one block of latency, and in deferred
+// mode one block of headroom for the callback.
+// BUFFER_QUEUE_SIZE is the depth the queues start with, setQueueDepth() on the input and
+// output classes changes it at runtime up to BUFFER_QUEUE_MAX_SIZE, which sets the memory
+// reserved per queue (CHANNELS * AUDIO_BLOCK_SAMPLES * 4 bytes per block).
+#ifndef BUFFER_QUEUE_SIZE
+#define BUFFER_QUEUE_SIZE 3
+#endif
+#ifndef BUFFER_QUEUE_MAX_SIZE
+#define BUFFER_QUEUE_MAX_SIZE 6
+#endif
+
+// Event trace: 1 records the DMA interrupts, queue moves, callbacks and AUDIO_TRACE_SCOPE spans
+// with cycle timestamps into a ring of AUDIO_TRACE_EVENTS (a power of two, 16 bytes each)
+// for audio_trace::drain(), see utility/audio_trace.h. 0 compiles the trace points away.
+#ifndef AUDIO_TRACE
+#define AUDIO_TRACE 0
+#endif
+#ifndef AUDIO_TRACE_EVENTS
+#define AUDIO_TRACE_EVENTS 1024
+#endif
+
+// Profiling zones: 1 times every PROFILE_ZONE("name") scope per block, inclusive and
+// exclusive of the zones nested in it, see profile_zone.h. 0 compiles the zones away.
+#ifndef AUDIO_PROFILE
+#define AUDIO_PROFILE 0
+#endif
+
+// Timer histograms: 1 also counts every Timers::Lap in a log-bucketed histogram per timer for
+// Timers::GetPercentile (240 counters per timer, ~19 KB), see utility/cycle_histogram.h.
+#ifndef AUDIO_TIMER_HISTOGRAM
+#define AUDIO_TIMER_HISTOGRAM 0
+#endif
+
+#if AUDIO_ZERO_COPY && AUDIO_DEFERRED_PROCESSING
+#error "AUDIO_ZERO_COPY works on the DMA buffers in place and cannot defer processing"
+#endif
+
+#if AUDIO_ZERO_COPY && AUDIO_FLOAT_PROCESSING
+#error "AUDIO_ZERO_COPY works on the DMA buffers in place and cannot convert to float"
+#endif
+
+// Sample type of the BufferQueues and the callback
+#if AUDIO_FLOAT_PROCESSING
+typedef float audio_sample_t;
+#else
+typedef int32_t audio_sample_t;
+#endif
+
+// Frames moved per DMA interrupt. The DMA buffers hold two halves: normally a block spans
+// both, in zero-copy and half-block mode every half is a whole block.
+#if AUDIO_ZERO_COPY || AUDIO_HALF_BLOCK_CALLBACK
+#define AUDIO_DMA_HALF_FRAMES AUDIO_BLOCK_SAMPLES
+#else
+#define AUDIO_DMA_HALF_FRAMES (AUDIO_BLOCK_SAMPLES / 2)
+#endif
 
 #define SAMPLE_16_MAX INT16_MAX
 #define SAMPLE_16_MIN INT16_MIN
@@ -0,0 +1,379 @@
+/** Audio Playback Module
+ **
+ ** Streams a WAV file from the SD card to the audio callback, the counterpart of WavWriter.
+ **
+ ** loop() reads the file ahead into a ring of `segments` segments of transfer_size bytes
+ ** with Read(), the audio callback takes planar blocks out of the ring with ReadBlock().
+ ** The callback never touches the card: a block is only converted from memory that is
+ ** already read. Like WavWriter the ring has to cover the worst card stall at the data
+ ** rate of the file, declare the reader EXTMEM for big rings.
+ **
+ ** Files: PCM and WAVE_FORMAT_EXTENSIBLE with 16, 24 (packed) or 32 bit integer samples,
+ ** or 32 bit IEEE float, 1 to 16 channels, RIFF or RF64 (over 4 GB). The samples reach the callback
+ ** as SAI words of the width OpenFile() found in AudioOutputI2S::getBitDepth(): right-aligned
+ ** and sign-extended at 16 or 24 bit, the whole int32 at 32 bit (float files as Q31 of that
+ ** width), converted in the same pass that de-interleaves them; samples wider than the word
+ ** keep their top bits. File channel k goes to callback channel k; channels the file does not have are
+ ** silent. The sample rate of the file is not converted: compare GetSampleRate() with
+ ** AudioOutputI2S::getSampleRate(), or switch to it with AudioOutputI2S::setFormat().
+ **
+ ** If the callback finds the ring empty it gets silence for what is missing, GetStats()
+ ** counts those underruns. At the end of the file the reader plays silence, or starts
+ ** over with SetLoop(true).
+ **
+ ** To use:
+ ** 1. Create a WavReader<size> object (e.g. WavReader<32768> reader, or WavReader<32768, 8> for 8 segments)
+ ** 2. Open the file after SD.begin() with: reader.OpenFile("FileName.wav"), this fills the ring
+ ** 3. Play it within your audio callback using: reader.ReadBlock(outputs, AUDIO_BLOCK_SAMPLES)
+ ** 4. Keep the ring filled from your main loop by running: reader.Read()
+ ** 5. Close the file with: reader.CloseFile()
+ **
+ ** */
+#ifndef WavReader_h
+  #define WavReader_h
+
+#include "Arduino.h"
+#include "AudioConfig.h"
+#include "WavWriter.h"
+#include "utility/pcm_pack.h"
+#include <SD.h>
+
+/** Default number of segments in the playback ring */
+#ifndef WAV_READER_SEGMENTS
+#define WAV_READER_SEGMENTS 4
+#endif
+
+/** Health of the playback ring */
+struct WavReaderStats
+{
+	uint32_t underruns;     /**< times the callback found the ring empty */
+	uint32_t missingFrames; /**< frames played as silence because of that */
+	uint32_t lastUnderrun;  /**< micros() of the last underrun, 0 if none */
+	uint32_t lowWater;      /**< fewest full segments left when the callback finished one */
+};
+
+/** loop() (producer) fills segment head_ % segments, the audio callback (consumer) plays
+** segment tail_ % segments. Both only count up, as in WavWriter. */
+template <size_t transfer_size, size_t segments = WAV_READER_SEGMENTS>
+class WavReader
+{
+  public:
+    WavReader() {}
+    ~WavReader() {}
+
+	/** Opens a file and reads its header, then fills the ring so playback starts with the
+	 ** full read-ahead. Returns false if the file cannot be opened or is not a supported WAV.
+	 ** The samples are scaled to the word width the audio runs at now, AudioOutputI2S::setFormat()
+	 ** switches before this, not while the file is open. */
+	bool OpenFile(const char *name)
+	{
+	    CloseFile();
+	    if(!fp_.open(&SD.sdfs, name, O_RDONLY))
+	    {
+	        Serial.println("Unable to open file");
+	        return false;
+	    }
+	    if(!ParseHeader())
+	    {
+	        Serial.println("Unsupported WAV file");
+	        fp_.close();
+	        return false;
+	    }
+
+	    segmentFrames_ = transfer_size / frameBytes_;
+	    shift_         = 32 - AudioOutputI2S::getBitDepth();
+	    readPos_       = dataStart_;
+	    head_          = 0;
+	    tail_          = 0;
+	    rframe_        = 0;
+	    eof_           = false;
+	    ClearStats();
+	    open_          = true;
+
+	    Read();
+	    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+	    playing_ = true;
+	    return true;
+	}
+
+	/** Stops playback and closes the file */
+	void CloseFile()
+	{
+	    playing_ = false;
+	    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+	    if(open_)
+	        fp_.close();
+	    open_ = false;
+	}
+
+	/** Fills every free segment from the file. Call it from loop() as often as possible. */
+	void Read()
+	{
+	    if(!open_)
+	        return;
+
+	    while(head_ - tail_ < segments && !eof_)
+	    {
+	        if(dataEnd_ - readPos_ < frameBytes_)
+	        {
+	            if(!loop_)
+	            {
+	                eof_ = true;
+	                break;
+	            }
+	            // start over, the next segment begins with the first frame
+	            readPos_ = dataStart_;
+	            fp_.seekSet(readPos_);
+	        }
+
+	        uint64_t bytes = (uint64_t)segmentFrames_ * frameBytes_;
+	        if(bytes > dataEnd_ - readPos_)
+	            bytes = (dataEnd_ - readPos_) / frameBytes_ * frameBytes_;
+
+	        uint32_t seg = head_ % segments;
+	        int got = fp_.read(&buff_[seg * transfer_size], (size_t)bytes);
+	        if(got < (int)frameBytes_)
+	        {
+	            // read error or a file cut short
+	            eof_ = true;
+	            break;
+	        }
+	        // whole frames only: a short read that ends mid-frame reads that frame again next time
+	        uint32_t whole = (uint32_t)got / frameBytes_ * frameBytes_;
+	        readPos_ += whole;
+	        if(whole != (uint32_t)got)
+	            fp_.seekSet(readPos_);
+	        segFrames_[seg] = whole / frameBytes_;
+	        __atomic_signal_fence(__ATOMIC_SEQ_CST); // the segment is complete before head_ moves
+	        head_ = head_ + 1;
+	    }
+	}
+
+	/** Plays `frames` frames into the CHANNELS planar buffers, silence for what is not there.
+	 ** For the audio callback. Returns the number of frames that came from the file. */
+	size_t ReadBlock(int32_t **channels, size_t frames)
+	{
+	    size_t done = 0;
+	    if(playing_)
+	    {
+	        while(done < frames)
+	        {
+	            if(tail_ == head_)
+	            {
+	                if(!eof_)
+	                {
+	                    stats_.underruns++;
+	                    stats_.missingFrames += frames - done;
+	                    stats_.lastUnderrun = micros();
+	                }
+	                break;
+	            }
+	            __atomic_signal_fence(__ATOMIC_SEQ_CST); // read the segment after head_
+
+	            uint32_t seg = tail_ % segments;
+	            size_t   n   = frames - done;
+	            if(n > segFrames_[seg] - rframe_)
+	                n = segFrames_[seg] - rframe_;
+
+	            Unpack(&buff_[seg * transfer_size + rframe_ * frameBytes_], n, channels, done);
+	            done += n;
+	            rframe_ += n;
+
+	            if(rframe_ == segFrames_[seg])
+	            {
+	                rframe_ = 0;
+	                __atomic_signal_fence(__ATOMIC_SEQ_CST); // done with the segment before tail_ moves
+	                tail_ = tail_ + 1;
+	                uint32_t left = head_ - tail_;
+	                if(left < stats_.lowWater)
+	                    stats_.lowWater = left;
+	            }
+	        }
+	    }
+
+	    if(done < frames)
+	    {
+	        for(size_t k = 0; k < CHANNELS; k++)
+	            memset(channels[k] + done, 0, (frames - done) * sizeof(int32_t));
+	    }
+	    return done;
+	}
+
+	/** Starts over at the end of the file instead of playing silence */
+	void SetLoop(bool loop) { loop_ = loop; }
+
+	/** True once the whole file has been played */
+	bool IsFinished() const { return open_ && eof_ && tail_ == head_; }
+
+	/** Format of the open file */
+	uint32_t GetSampleRate() const { return sampleRate_; }
+	uint16_t GetChannels() const { return channels_; }
+	uint16_t GetBitsPerSample() const { return bytesPerSample_ * 8; }
+	bool IsFloat() const { return float_; }
+	/** Frames in the file */
+	uint32_t GetFrames() const { return frameBytes_ ? (uint32_t)((dataEnd_ - dataStart_) / frameBytes_) : 0; }
+
+	/** Full segments waiting for the callback */
+	size_t SegmentsQueued() const { return head_ - tail_; }
+
+	WavReaderStats GetStats() const { return stats_; }
+	void ClearStats()
+	{
+	    stats_.underruns     = 0;
+	    stats_.missingFrames = 0;
+	    stats_.lastUnderrun  = 0;
+	    stats_.lowWater      = segments;
+	}
+
+	private:
+		alignas(4) uint8_t buff_[transfer_size * segments];
+		uint32_t          segFrames_[segments];   // frames read into each segment
+		volatile uint32_t head_ = 0, tail_ = 0;   // segments read by loop(), played by the callback
+		uint32_t          rframe_ = 0;            // next frame in segment tail_
+		FsFile            fp_;
+		uint64_t          dataStart_ = 0, dataEnd_ = 0, readPos_ = 0; // file offsets of the samples
+		uint32_t          segmentFrames_ = 0;
+		uint32_t          sampleRate_ = 0;
+		uint32_t          frameBytes_ = 0;
+		uint16_t          channels_ = 0;
+		uint16_t          bytesPerSample_ = 0;
+		uint8_t           shift_ = 0;        // 32 - the SAI word width, right-aligns the samples
+		bool              float_ = false;
+		bool              loop_ = false;
+		bool              open_ = false;
+		volatile bool     eof_ = false;      // loop() read the last frame
+		volatile bool     playing_ = false;  // the callback may take from the ring
+		WavReaderStats    stats_ = {};
+
+		/** Finds the fmt and data chunks, skips everything else */
+		bool ParseHeader()
+		{
+		    uint32_t riff[3];
+		    if(fp_.read(riff, sizeof(riff)) != sizeof(riff) || riff[2] != kWavFileWaveId)
+		        return false;
+		    if(riff[0] != kWavFileChunkId && riff[0] != kWavFileRf64Id)
+		        return false;
+
+		    bool     haveFmt  = false;
+		    uint64_t dataSize = 0; // from ds64, RF64 only
+		    uint64_t pos      = sizeof(riff);
+		    for(;;)
+		    {
+		        uint32_t chunk[2]; // id, size
+		        if(fp_.read(chunk, sizeof(chunk)) != sizeof(chunk))
+		            return false;
+		        pos += sizeof(chunk);
+
+		        if(chunk[0] == kWavFileSubChunk1Id)
+		        {
+		            WAV_FormatTypeDef fmt;
+		            uint8_t *f = (uint8_t *)&fmt.AudioFormat; // the fields after SubChunk1Size
+		            size_t   n = chunk[1] < 40 ? chunk[1] : 40;
+		            if(n < 16 || fp_.read(f, n) != (int)n)
+		                return false;
+
+		            uint16_t format = fmt.AudioFormat;
+		            if(format == WAVE_FORMAT_EXTENSIBLE)
+		            {
+		                if(n < 40)
+		                    return false;
+		                format = fmt.SubFormat[0] | (fmt.SubFormat[1] << 8);
+		            }
+		            channels_       = fmt.NbrChannels;
+		            sampleRate_     = fmt.SampleRate;
+		            bytesPerSample_ = fmt.BitPerSample / 8;
+		            float_          = format == WAVE_FORMAT_IEEE_FLOAT;
+		            frameBytes_     = channels_ * bytesPerSample_;
+
+		            if(format != WAVE_FORMAT_PCM && format != WAVE_FORMAT_IEEE_FLOAT)
+		                return false;
+		            if(float_ ? bytesPerSample_ != 4 : (bytesPerSample_ < 2 || bytesPerSample_ > 4))
+		                return false;
+		            if(channels_ < 1 || channels_ > TDM_MAX_CHANNELS || fmt.BlockAlign != frameBytes_)
+		                return false;
+		            haveFmt = true;
+		        }
+		        else if(chunk[0] == kWavFileDs64Id && riff[0] == kWavFileRf64Id)
+		        {
+		            WAV_Ds64TypeDef ds64;
+		            if(chunk[1] < sizeof(ds64) - 8 || fp_.read(&ds64.RiffSize, sizeof(ds64) - 8) != (int)sizeof(ds64) - 8)
+		                return false;
+		            dataSize = ds64.DataSize;
+		        }
+		        else if(chunk[0] == kWavFileSubChunk2Id)
+		        {
+		            if(!haveFmt)
+		                return false;
+		            dataStart_ = pos;
+		            dataEnd_   = pos + (chunk[1] == 0xFFFFFFFF && dataSize ? dataSize : chunk[1]);
+		            // a recording that was never finalized says 0, play what is there
+		            uint64_t size = fp_.fileSize();
+		            if(chunk[1] == 0 || dataEnd_ > size)
+		                dataEnd_ = size;
+		            return dataEnd_ - dataStart_ >= frameBytes_ && fp_.seekSet(dataStart_);
+		        }
+
+		        // chunks are padded to an even size
+		        pos += chunk[1] + (chunk[1] & 1);
+		        if(!fp_.seekSet(pos))
+		            return false;
+		    }
+		}
+
+		/** Converts `count` frames at src into the planar channels, from frame `first` on */
+		inline void Unpack(const uint8_t *src, size_t count, int32_t **channels, size_t first)
+		{
+		    int32_t *dest[CHANNELS];
+		    for(size_t k = 0; k < CHANNELS; k++)
+		    {
+		        dest[k] = channels[k] + first;
+		    }
+
+		    if(channels_ == CHANNELS)
+		    {
+		        // one pass per format with the channel loop unrolled
+		        if(float_)
+		            pcm_deinterleave_f32<CHANNELS>((const float *)src, count, dest, shift_);
+		        else if(bytesPerSample_ == 2)
+		            pcm_deinterleave16<CHANNELS>((const int16_t *)src, count, dest, shift_);
+		        else if(bytesPerSample_ == 3)
+		            pcm_deinterleave24<CHANNELS>(src, count, dest, shift_);
+		        else
+		            pcm_deinterleave32<CHANNELS>((const int32_t *)src, count, dest, shift_);
+		        return;
+		    }
+
+		    // other channel counts, sample by sample
+		    for(size_t i = 0; i < count; i++)
+		    {
+		        for(size_t k = 0; k < CHANNELS; k++)
+		        {
+		            dest[k][i] = k < channels_ ? Convert(src + k * bytesPerSample_) : 0;
+		        }
+		        src += frameBytes_;
+		    }
+		}
+
+		/** One file sample as a word of the SAI width */
+		inline int32_t Convert(const uint8_t *p) const
+		{
+		    if(float_)
+		    {
+		        float f;
+		        memcpy(&f, p, 4);
+		        return float_to_q31(f) >> shift_;
+		    }
+		    switch(bytesPerSample_)
+		    {
+		        case 2: return (int32_t)(((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 24)) >> shift_;
+		        case 3: return pcm_unpack24(p) >> shift_;
+		        default:
+		        {
+		            int32_t x;
+		            memcpy(&x, p, 4);
+		            return x >> shift_;
+		        }
+		    }
+		}
+};
+#endif
@@ -2,29 +2,77 @@
  ** 
  ** Record audio into a working buffer that is gradually written to a WAV file on an SD Card. 
  **
- ** Recordings are made with floating point input, and will be converted to the 
- ** specified bits per sample internally 
+ ** Recordings are made from the int32_t samples of the audio callback, all CHANNELS
+ ** channels, and stored with the sample size of the bit_depth template parameter
+ ** (BIT_DEPTH unless given, e.g. WavWriter<32768, 8, WAV_WRITER_PCM, 24>). The callback
+ ** samples are the SAI words of the width AudioOutputI2S::getBitDepth() returns,
+ ** right-aligned in the int32 at 16 or 24 bit; OpenFile() takes the word width, the
+ ** writer shifts every sample to the top and the file keeps the top bit_depth bits.
+ ** A 16 bit word in a 24 bit file is exact, its ValidBitsPerSample says 16.
  **
- ** For now only 16-bit and 32-bit (signed int) formats are supported
- ** f32 and s24 formats will be added next
+ ** 16, 24 and 32-bit (signed int) formats are supported. 24-bit samples are packed in
+ ** 3 bytes, a quarter less to write than 32-bit. Files with more than 2 channels or more
+ ** than 16 bits get a WAVE_FORMAT_EXTENSIBLE header, as the format specification asks.
  **
- ** The transfer size determines the amount of internal memory used, and can have an
- ** effect on the performance of the streaming behavior of the WavWriter.
- ** Memory use can be calculated as: (2 * transfer_size) bytes
+ ** Float: WavWriter<32768, 8, WAV_WRITER_FLOAT> records 32-bit IEEE float samples in
+ ** [-1.0, 1.0) instead, ready for float based post-production. The Q31 to float conversion
+ ** happens while SampleBlock() interleaves the block into the ring (pcm_interleave_f32),
+ ** there is no separate pass. bit_depth does not matter then, every sample takes 4 bytes.
+ **
+ ** RIFF sizes are 32 bit, a file ends at 4 GB: 22 minutes of 4 channels of 32 bit at
+ ** 192 kHz. Every file starts with a JUNK chunk that has the room of an RF64 ds64 chunk
+ ** (EBU Tech 3306); when a recording grows past 4 GB the header written at the end turns
+ ** it into a ds64 chunk with the 64 bit sizes and the file into RF64. Nothing changes
+ ** while recording, there is no gap. Files over 4 GB need an exFAT card (SDXC, > 32 GB).
+ **
+ ** The audio callback fills a ring of `segments` segments of transfer_size bytes, loop()
+ ** writes every full segment to the card. The ring absorbs card stalls: SD cards regularly
+ ** stall for 100 ms or more, 4 channels of 32 bit at 192 kHz are ~3 MB/s, so a stall needs
+ ** about 300 kB of segments to ride out. Memory use is (segments * transfer_size) bytes,
+ ** put big rings in PSRAM with EXTMEM (WavInit() sets up all state, EXTMEM is not
+ ** initialized at startup):
+ **
+ **   EXTMEM WavWriter<32768, 16> writer;
+ **
+ ** When the ring is full the callback drops frames rather than overwrite a segment that is
+ ** not written yet. GetStats() counts the overruns and dropped frames, and the high-water
+ ** mark tells how close to full the ring got.
+ ** Each write to the card is the largest number of whole frames that fits in transfer_size.
  ** Performance optimal with sizes: 16384, 32768
+ **
+ ** Lossless: WavWriter<32768, 8, WAV_WRITER_FLAC> records a FLAC file instead (utility/flac_encoder.h),
+ ** for up to 8 channels. Write() encodes each full segment in loop() before it goes to the
+ ** card, the callback side does not change. Tones and music usually take 15 to 60 % of the
+ ** PCM size, silent channels next to nothing; noise does not compress. The encoder needs
+ ** another segment of memory for its output, and a segment must hold 16 to 65535 frames.
+ **
+ ** Power loss: only the header says how long the recording is, and SaveFile() writes it.
+ ** SetCommitInterval(1000) has Write() rewrite the header for what is on the card and sync
+ ** the file about once a second, after it wrote a segment and only then, so a cut lasts
+ ** no longer than that (two seeks per interval, not per segment). RecoverFile(name) on the
+ ** next boot repairs a file that was cut short anyway: it fits the header to the data the
+ ** file holds, whole frames, and cuts off the rest. The file length only reaches the card
+ ** when the file is synced, so recovery needs a commit interval: without one a cut file
+ ** holds no data as far as the card knows, and RecoverFile() returns false.
  ** 
  ** To use:
- ** 1. Create a WavWriter<size> object (e.g. WavWriter<32768> writer)
+ ** 1. Create a WavWriter<size> object (e.g. WavWriter<32768> writer, or WavWriter<32768, 8> for 8 segments)
  ** 2. Configure the settings as desired by creating a WavWriter<32768>::Config struct and setting the settings.
  ** 3. Initialize the object with the configuration struct.
- ** 4. Open a new file for writing with: writer.OpenFile("FileName.wav")
- ** 5. Write to it within your audio callback using: writer.Sample(value)
+ ** 4. Open a new file for writing with: writer.OpenFile("FileName.wav"), or reserve the space for
+ **    a recording of up to 600 seconds up front with: writer.OpenFile("FileName.wav", 600).
+ **    Name it "FileName.flac" when lossless.
+ ** 5. Write to it within your audio callback using: writer.SampleBlock(inputs, AUDIO_BLOCK_SAMPLES)
  ** 6. Fill the Wav File on the SD Card with data from your main loop by running: writer.Write()
  ** 7. When finished with the recording finalize, and close the file with: writer.SaveFile();
  ** 
  ** */
 #include "Arduino.h" 
 #include "AudioConfig.h"
+#include "utility/tdm_transpose.h"
+#include "utility/pcm_pack.h"
+#include "utility/flac_encoder.h"
+#include "output_i2s_tdm.h"
 #include <SD.h>
 
 #ifndef WavWriter_h
@@ -52,6 +100,10 @@ const uint32_t kWavFileChunkId     = 0x46464952; /**< "RIFF" = 5249 4646 */
 const uint32_t kWavFileWaveId      = 0x45564157; /**< "WAVE" */
 const uint32_t kWavFileSubChunk1Id = 0x20746d66; /**< "fmt " */
 const uint32_t kWavFileSubChunk2Id = 0x61746164; /**< "data" */
+const uint32_t kWavFileRf64Id      = 0x34364652; /**< "RF64" */
+const uint32_t kWavFileDs64Id      = 0x34367364; /**< "ds64" */
+const uint32_t kWavFileJunkId      = 0x4B4E554A; /**< "JUNK" */
+const uint32_t kWavFileFactId      = 0x74636166; /**< "fact" */
 
 /** Standard Format codes for the waveform data.
 	 ** 
@@ -84,23 +136,57 @@ typedef struct
     uint32_t ByteRate;      /**< & */
     uint16_t BlockAlign;    /**< & */
     uint16_t BitPerSample;  /**< & */
+    uint16_t ExtensionSize;      /**< 22 for WAVE_FORMAT_EXTENSIBLE, the fields up to SubFormat */
+    uint16_t ValidBitsPerSample; /**< & */
+    uint32_t ChannelMask;        /**< speaker positions, 0 for none */
+    uint8_t  SubFormat[16];      /**< GUID, the format code in the first 2 bytes */
     uint32_t SubChunk2ID;   /**< & */
     uint32_t SubCHunk2Size; /**< & */
 } WAV_FormatTypeDef;
 
+/** ds64 chunk of RF64 files, the 64 bit sizes. Written as a JUNK chunk of the same size
+ ** until the file needs it. */
+typedef struct __attribute__((packed))
+{
+    uint32_t ChunkId;     /**< "ds64", or "JUNK" */
+    uint32_t ChunkSize;   /**< 28 */
+    uint64_t RiffSize;    /**< file size - 8 */
+    uint64_t DataSize;    /**< bytes in the data chunk */
+    uint64_t SampleCount; /**< frames */
+    uint32_t TableLength; /**< 0, no other 64 bit chunk sizes */
+} WAV_Ds64TypeDef;
+
+/** KSDATAFORMAT_SUBTYPE_PCM, the format code is filled in the first 2 bytes */
+const uint8_t kWavSubFormatGuid[16] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00,
+                                       0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71};
+
+
+/** Default number of segments in the recording ring */
+#ifndef WAV_WRITER_SEGMENTS
+#define WAV_WRITER_SEGMENTS 4
+#endif
+
+/** What WavWriter records */
+enum WavWriterFormat
+{
+    WAV_WRITER_PCM,   /**< integer PCM of bit_depth bits */
+    WAV_WRITER_FLOAT, /**< 32-bit IEEE float */
+    WAV_WRITER_FLAC,  /**< FLAC of bit_depth bits, up to 8 channels */
+};
 
-/** State of the internal Writing mechanism. 
-** When the buffer is a certain amount full one section will write its contents
-** while the other is still being written to. This is performed circularly
-** so that audio will be uninterrupted during writing. */
-enum class BufferState
+/** Health of the recording ring */
+struct WavWriterStats
 {
-	IDLE,
-	FLUSH0,
-	FLUSH1,
+	uint32_t overruns;      /**< times the callback found the ring full */
+	uint32_t droppedFrames; /**< frames not recorded because of that */
+	uint32_t lastOverrun;   /**< micros() of the last overrun, 0 if none */
+	uint32_t highWater;     /**< most full segments waiting for the card at once */
 };
 
-template <size_t transfer_size> 
+/** The audio callback (producer) fills segment head_ % segments, loop() (consumer) writes
+** segment tail_ % segments. head_ and tail_ only count up, each is written by one side only,
+** so neither side waits for the other or disables interrupts. */
+template <size_t transfer_size, size_t segments = WAV_WRITER_SEGMENTS, WavWriterFormat format = WAV_WRITER_PCM, unsigned bit_depth = BIT_DEPTH>
 class WavWriter
 {
   public:
@@ -111,110 +197,266 @@ class WavWriter
 	void WavInit() //const Config &cfg)
 	{
 	    // cfg_       = cfg;
-	    num_samps_ = 0;
+	    num_samps_  = 0;
+	    data_bytes_ = 0;
+	    commit_interval_ = 0;
+	    head_      = 0;
+	    tail_      = 0;
+	    wframe_    = 0;
+	    recording_ = false;
+	    stopped_   = false;
+	    SetWordWidth(AudioOutputI2S::getBitDepth()); // OpenFile() takes the current one
+	    ClearStats();
 	    // Prep the wav header according to config.
 	    // Certain things (i.e. Size, etc. will have to wait until the finalization of the file, or be updated while streaming).
 	    wavheader_.ChunkId       = kWavFileChunkId;     /** "RIFF" */
 	    wavheader_.FileFormat    = kWavFileWaveId;      /** "WAVE" */   //aac1 3600
 	    wavheader_.SubChunk1ID   = kWavFileSubChunk1Id; /** "fmt " */
-	    wavheader_.SubChunk1Size = 16;                  // for PCM
-	    wavheader_.AudioFormat   = WAVE_FORMAT_PCM;
-	    wavheader_.NbrChannels   = LOCAL_CHANNELS;
-	    wavheader_.SampleRate    = static_cast<int>(SAMPLERATE);
-	    wavheader_.ByteRate      = SAMPLERATE * LOCAL_CHANNELS * (BIT_DEPTH / 8);
-	    wavheader_.BlockAlign    = LOCAL_CHANNELS * (BIT_DEPTH / 8);
-	    wavheader_.BitPerSample  = BIT_DEPTH;
+	    wavheader_.SubChunk1Size = kExtensible ? 40 : 16; // 16 for PCM
+	    wavheader_.AudioFormat   = kExtensible ? WAVE_FORMAT_EXTENSIBLE : WAVE_FORMAT_PCM;
+	    wavheader_.NbrChannels   = CHANNELS;
+	    wavheader_.SampleRate    = AudioOutputI2S::getSampleRate(); // OpenFile() takes the current one
+	    wavheader_.ByteRate      = wavheader_.SampleRate * kFrameBytes;
+	    wavheader_.BlockAlign    = kFrameBytes;
+	    wavheader_.BitPerSample  = kSampleBytes * 8;
+	    wavheader_.ExtensionSize      = 22;
+	    wavheader_.ChannelMask        = CHANNELS == 2 ? 0x3 : 0; // front left and right
+	    memcpy(wavheader_.SubFormat, kWavSubFormatGuid, sizeof(kWavSubFormatGuid));
+	    wavheader_.SubFormat[0]       = kFloat ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM;
 	    wavheader_.SubChunk2ID   = kWavFileSubChunk2Id; /** "data" */
 	    /** Also calcs SubChunk2Size */
-	    wavheader_.FileSize =  CalcFileSize();
+	    UpdateSizes();
 	    // This is calculated as part of the subchunk size
 	}
 
-	/** Opens a file for writing. Writes the initial WAV Header, and gets ready for stream-based recording. */
-	void OpenFile(const char *name)
+	/** Opens a file for writing. Writes the initial WAV Header, and gets ready for stream-based recording.
+	 ** 
+	 ** \param preallocateSeconds reserves one contiguous run of clusters for that many seconds of
+	 ** audio before recording starts, SaveFile() gives back what was not used. Writes then
+	 ** stream into sectors that are already allocated: no FAT updates while recording and a
+	 ** lower worst-case write time. A recording can run longer, the file grows from there.
+	 ** Needs SD.begin() first. Returns false if the file could not be opened.
+	 **
+	 ** The recording has the sample rate and word width the audio runs at now,
+	 ** AudioOutputI2S::setFormat() switches before this, not while recording.
+	 */
+	bool OpenFile(const char *name, float preallocateSeconds = 0)
 	{   
+	    // the callback drops its frames until the ring is reset below
+	    recording_ = false;
+	    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+
 	    // Prefill known WAV file information
-	   
-	    Serial.println("Open File");
-	    if (SD.exists(name)) {
-	        // The SD library writes new data to the end of the
-	        // file, so to start a new recording, the old file
-	        // must be deleted before new data is written.
-	        SD.remove(name);
+	    if (SD.sdfs.exists(name)) {
+	        // to start a new recording, the old file must be deleted
+	        // before new data is written.
+	        SD.sdfs.remove(name);
 	    }
 
-	    fp_=SD.open(name, FILE_WRITE);
+	    // SdFat file of the SD library, it can preallocate
+	    if(!fp_.open(&SD.sdfs, name, O_RDWR | O_CREAT | O_TRUNC))
+	    {
+	        Serial.println("Unable to open file");
+	        return false;
+	    }
+	    wavheader_.SampleRate = AudioOutputI2S::getSampleRate();
+	    wavheader_.ByteRate   = wavheader_.SampleRate * kFrameBytes;
+	    SetWordWidth(AudioOutputI2S::getBitDepth());
+	    preallocated_ = false;
+	    if(preallocateSeconds > 0)
+	    {
+	        // lossless: room for the PCM size, what the encoder does not need is given back
+	        uint64_t bytes = kFileHeaderBytes + (uint64_t)(preallocateSeconds * wavheader_.SampleRate) * kFrameBytes;
+	        preallocated_  = fp_.preAllocate(bytes);
+	        if(!preallocated_)
+	            Serial.println("Preallocation failed, the file grows while recording");
+	    }
 	    // unsigned int bw = 0;
-	    fp_.write(&wavheader_, sizeof(wavheader_));
+	    num_samps_  = 0;
+	    data_bytes_ = 0;
+	    if(kFlac)
+	        flac_.begin(wavheader_.SampleRate);
+	    UpdateSizes();
+	    WriteHeader();
+	    last_commit_ = millis();
 	    
+	    head_      = 0;
+	    tail_      = 0;
+	    wframe_    = 0;
+	    overrun_   = false;
+	    stopped_   = false;
+	    ClearStats();
+	    __atomic_signal_fence(__ATOMIC_SEQ_CST); // the ring is reset before the callback fills it
 	    recording_ = true;
-	    num_samps_ = 0;
+	    return true;
 	}
 
-	/** Records the current sample into the working buffer,
+	/** Records one frame into the working buffer,
 	**  queues writes to media when necessary. 
 	** 
-	** \param in should be a pointer to an array of samples 
+	** \param in should be a pointer to an array of CHANNELS samples
 	*/
-	// void Sample(const float *in)
-
 	void Sample(const int32_t *in)
 	{
-	    for(size_t i = 0; i < LOCAL_CHANNELS; i++)
+	    if(!Reserve(1))
+	        return;
+	    uint8_t *dest = &transfer_buff[(head_ % segments) * kSegmentBytes + wframe_ * kFrameBytes];
+	    // the samples left-justified, the file keeps their top bits
+	    const unsigned shift = shift_;
+	    if(kFloat)
 	    {
-	        switch(BIT_DEPTH)
-	        {
-	            case 16:
-	              {
-	                int16_t *tp;
-	                tp            = (int16_t *)transfer_buff;
-	                //tp[wptr_ + i] = f2s16(in[i]);
-	                tp[wptr_ + i] = in[i];
-	              }
-	              break;
-	            case 32: 
-	              //transfer_buff[wptr_ + i] = f2s32(in[i]); 
-	              transfer_buff[wptr_ + i] = (int32_t)in; 
-	              // Test Samples coming in:
-	              //Serial.println(in[i]);
-	              break;
-	            default: 
-	              break;
-	        }
+	        for(size_t k = 0; k < CHANNELS; k++)
+	            ((float *)dest)[k] = q31_to_float((int32_t)((uint32_t)in[k] << shift));
+	        Advance(1);
+	        return;
 	    }
-	    num_samps_++;
-	    wptr_ += LOCAL_CHANNELS;
-	    size_t cap_point
-	        = BIT_DEPTH == 16 ? kTransferSamps * 2 :kTransferSamps;
-	    if(wptr_ == cap_point)
+	    switch(bit_depth)
 	    {
-	        bstate_ = BufferState::FLUSH0;
+	        case 16:
+	            for(size_t k = 0; k < CHANNELS; k++)
+	                ((int16_t *)dest)[k] = (int16_t)(((uint32_t)in[k] << shift) >> 16);
+	            break;
+	        case 24:
+	            for(size_t k = 0; k < CHANNELS; k++)
+	                pcm_pack24((uint32_t)in[k] << shift, dest + 3 * k);
+	            break;
+	        default:
+	            if(shift == 0)
+	            {
+	                memcpy(dest, in, kFrameBytes);
+	                break;
+	            }
+	            for(size_t k = 0; k < CHANNELS; k++)
+	                ((int32_t *)dest)[k] = (int32_t)((uint32_t)in[k] << shift);
+	            break;
 	    }
-	    if(wptr_ >= cap_point * 2)
+	    Advance(1);
+	}
+
+	/** Records a block of planar samples, as the audio callback gets them,
+	**  queues writes to media when necessary.
+	**
+	** \param channels CHANNELS pointers to `frames` samples each
+	*/
+	void SampleBlock(const int32_t *const *channels, size_t frames)
+	{
+	    size_t done = 0;
+	    while(done < frames)
 	    {
-	        wptr_   = 0;
-	        bstate_ = BufferState::FLUSH1;
+	        if(!Reserve(frames - done))
+	            return;
+
+	        // up to the end of the segment being filled
+	        size_t n = frames - done;
+	        if(n > kSegmentFrames - wframe_)
+	            n = kSegmentFrames - wframe_;
+
+	        PackFrames(channels, done, n, &transfer_buff[(head_ % segments) * kSegmentBytes + wframe_ * kFrameBytes]);
+	        done += n;
+	        Advance(n);
 	    }
 	}
 
-	/** Check buffer state and write */
+	void SampleBlock(int32_t **channels, size_t frames)
+	{
+	    SampleBlock((const int32_t *const *)channels, frames);
+	}
+
+	/** Writes every full segment to the card, encoded first when lossless */
 	void Write()
 	{
+	    if(!recording_)
+	        return;
 
-	   
-	    if(bstate_ != BufferState::IDLE && recording_)
+	    const uint8_t *segment;
+	    bool wrote = false;
+	    while((segment = PeekSegment()) != nullptr)
 	    {
-	        uint32_t     offset;
 	        // unsigned int bw = 0; //for error messaging
-	        //offset          = bstate_ == BufferState::FLUSH0 ? 0 : transfer_size;
-	        offset  = bstate_ == BufferState::FLUSH0 ? 0 : kTransferSamps;
-	        bstate_ = BufferState::IDLE;
-	        //f_write(&fp_, &transfer_buff[offset], transfer_size, &bw); //STM32
-			fp_.seek(EOF); //get to end of file
-	        fp_.write(&transfer_buff[offset],transfer_size); // SD Arduino library
-			// Serial.print("File size: ");
-			//Serial.println(fp_.size());
+	        //f_write(&fp_, segment, transfer_size, &bw); //STM32
+	        WriteFrames(segment, kSegmentFrames);
+	        ReleaseSegment();
+	        wrote = true;
 	    }
+	    // the header goes with a segment write, the card is busy with the file anyway
+	    if(wrote && commit_interval_ && !stopped_ && millis() - last_commit_ >= commit_interval_)
+	    {
+	        CommitHeader();
+	    }
+	}
+
+	/** Has Write() rewrite the header and sync the file every `milliseconds`, so a power cut
+	 ** loses no more than that of the recording. 0, the default after WavInit(), commits only
+	 ** in SaveFile(). */
+	void SetCommitInterval(uint32_t milliseconds) { commit_interval_ = milliseconds; }
+
+	/** Repairs a recording that never got to SaveFile(), at boot before the file is
+	 ** recorded over. Recovery starts from the sizes of the last header commit. WAV and
+	 ** RF64 keep the committed data, and a file that grew past 4 GB becomes RF64. FLAC
+	 ** also keeps each frame after the committed ones that has the next frame number and
+	 ** passes its CRC-16 check. STREAMINFO gets the samples up to the last one, and a torn
+	 ** frame is cut off. Whatever follows the recovered audio is cut off. Needs SD.begin() first.
+	 **
+	 ** The file size in the directory entry is not the length of the recording. exFAT only
+	 ** updates it when the file is synced. FAT sets it to the preallocated length at once,
+	 ** and those clusters still hold what was on the card before. Record with
+	 ** SetCommitInterval() for anything to recover. WAV data after the last commit is lost.
+	 ** If the file size does not end at the last committed FLAC frame, as on a preallocated
+	 ** FAT file, the frames are followed from the start of the file, which reads all of it.
+	 ** Returns false if the file cannot be opened, is neither WAV nor FLAC, or holds no
+	 ** whole frame of audio. The file is left as it is then.
+	 */
+	static bool RecoverFile(const char *name)
+	{
+	    FsFile file;
+	    if(!file.open(&SD.sdfs, name, O_RDWR))
+	    {
+	        return false;
+	    }
+	    uint32_t id = 0;
+	    bool ok = file.read(&id, 4) == 4 && (memcmp(&id, "fLaC", 4) == 0 ? RecoverFlac(file) : RecoverWav(file));
+	    file.close();
+	    return ok;
+	}
+
+	/** Oldest full segment not written yet, nullptr if there is none. For loop() only. */
+	const uint8_t *PeekSegment() const
+	{
+	    if(tail_ == head_)
+	        return nullptr;
+	    __atomic_signal_fence(__ATOMIC_SEQ_CST); // read the segment after head_
+	    return &transfer_buff[(tail_ % segments) * kSegmentBytes];
+	}
+
+	/** Hands the segment from PeekSegment() back to the callback */
+	void ReleaseSegment()
+	{
+	    __atomic_signal_fence(__ATOMIC_SEQ_CST); // done with the segment before tail_ moves
+	    tail_ = tail_ + 1;
+	}
+
+	/** Full segments waiting for the card */
+	size_t SegmentsQueued() const { return head_ - tail_; }
+
+	/** Bytes in one segment, whole frames */
+	static constexpr size_t SegmentBytes() { return kSegmentBytes; }
+
+	/** Bytes in one frame of all channels */
+	static constexpr size_t FrameBytes() { return kFrameBytes; }
+
+	/** Bytes of audio data in the file so far, after encoding when lossless */
+	uint64_t DataBytes() const { return data_bytes_; }
+
+	/** True if OpenFile() reserved the space for the recording */
+	bool IsPreallocated() const { return preallocated_; }
+
+	WavWriterStats GetStats() const { return stats_; }
+	void ClearStats()
+	{
+	    stats_.overruns      = 0;
+	    stats_.droppedFrames = 0;
+	    stats_.lastOverrun   = 0;
+	    stats_.highWater     = 0;
 	}
 
 	/** Finalizes the writing of the WAV file.
@@ -223,15 +465,26 @@ class WavWriter
 
 	void SaveFile()
 	{
-	    Serial.println("Save File & overwrites WAV header");
 	    // unsigned int bw = 0;
-	    recording_      = false;
-	    // We _should_ flush whatever's left in the transfer buff
-	    // TODO: that.
+	    // the callback stops recording, then the ring and the partly filled segment go to the card
+	    stopped_ = true;
+	    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+	    Write();
+	    if(recording_ && wframe_ > 0)
+	    {
+	        WriteFrames(&transfer_buff[(head_ % segments) * kSegmentBytes], wframe_);
+	    }
 
-	    wavheader_.FileSize = CalcFileSize();
-	    fp_.seek(0);
-	    fp_.write(&wavheader_, sizeof(wavheader_));
+	    UpdateSizes();
+	    if(recording_ && preallocated_)
+	    {
+	        // release the clusters reserved after the last sample
+	        fp_.truncate(kFileHeaderBytes + data_bytes_);
+	    }
+	    recording_ = false;
+
+	    fp_.seekSet(0);
+	    WriteHeader();
 	    fp_.close();
 	}
 
@@ -245,72 +498,473 @@ class WavWriter
         int32_t bitspersample;
     };
 
-    // Float conversion not implemented atm.
-    
-	// /**
-	//     Converts float to Signed 16-bit
-	// */
-	// int16_t f2s16(float x)
-	// {
-	//     x = x <= FBIPMIN ? FBIPMIN : x;
-	//     x = x >= FBIPMAX ? FBIPMAX : x;
-	//     return (int32_t)(x * F2S16_SCALE);
-	// }
-
-	// /**
-	//     Converts Signed 24-bit to float
-	//  */
-	// float s242f(int32_t x)
-	// {
-	//     x = (x ^ S24SIGN) - S24SIGN; //sign extend aka ((x<<8)>>8)
-	//     return (float)x * S242F_SCALE;
-	// }
-	// /**
-	//     Converts float to Signed 24-bit
-	//  */
-	// int32_t f2s24(float x)
-	// {
-	//     x = x <= FBIPMIN ? FBIPMIN : x;
-	//     x = x >= FBIPMAX ? FBIPMAX : x;
-	//     return (int32_t)(x * F2S24_SCALE);
-	// }
-
-	// /**
-	//     Converts Signed 32-bit to float
-	//  */
-	// float s322f(int32_t x)
-	// {
-	//     return (float)x * S322F_SCALE;
-	// }
-	// /**
-	//     Converts float to Signed 24-bit
-	//  */
-	// int32_t f2s32(float x)
-	// {
-	//     x = x <= FBIPMIN ? FBIPMIN : x;
-	//     x = x >= FBIPMAX ? FBIPMAX : x;
-	//     return (int32_t)(x * F2S32_SCALE);
-	// }
+	private:
+		static constexpr bool   kFloat = format == WAV_WRITER_FLOAT;
+		static constexpr bool   kFlac  = format == WAV_WRITER_FLAC;
+		// 24 bit samples packed in 3 bytes
+		static constexpr size_t kSampleBytes = kFloat ? 4 : bit_depth / 8;
+		static constexpr size_t kFrameBytes  = CHANNELS * kSampleBytes;
+		static constexpr bool   kExtensible  = kFloat || bit_depth > 16 || CHANNELS > 2;
+		// RIFF, the ds64 room, fmt and, for float, the fact chunk every format but PCM
+		// needs; the PCM header leaves out the extension fields
+		static constexpr size_t kFactBytes   = kFloat ? 12 : 0;
+		static constexpr size_t kHeaderBytes = sizeof(WAV_Ds64TypeDef) + kFactBytes + (kExtensible ? sizeof(WAV_FormatTypeDef) : sizeof(WAV_FormatTypeDef) - 24);
+		static_assert(sizeof(WAV_FormatTypeDef) == 68, "WAV_FormatTypeDef must match the file layout");
+		static_assert(sizeof(WAV_Ds64TypeDef) == 36, "WAV_Ds64TypeDef must match the file layout");
+		static_assert(bit_depth == 16 || bit_depth == 24 || bit_depth == 32, "WavWriter records 16, 24 or 32 bit");
+		static constexpr size_t kSegmentFrames = transfer_size / kFrameBytes;
+		static constexpr size_t kSegmentBytes  = kSegmentFrames * kFrameBytes;
+		static_assert(kSegmentFrames > 0, "transfer_size must hold at least one frame");
+		static_assert(segments >= 2, "the ring needs at least 2 segments");
 
+		// the encoder is only sized for the segments when lossless
+		typedef FlacEncoder<kFlac ? CHANNELS : 1, bit_depth, kFlac ? kSegmentFrames : 16> Flac;
+		static constexpr size_t kFileHeaderBytes = kFlac ? Flac::kStreamHeaderBytes : kHeaderBytes;
 
+		alignas(4) uint8_t transfer_buff[kSegmentBytes * segments];
+		volatile uint32_t head_ = 0, tail_ = 0;        // segments filled by the callback, written by loop()
+		uint64_t          num_samps_ = 0;           // frames written to the file
+		uint64_t          data_bytes_ = 0;          // written after the header
+		uint32_t          wframe_ = 0;              // next frame in segment head_
+		uint8_t           shift_ = 0;               // 32 - the SAI word width, left-justifies the samples
+		FsFile            fp_;  // The file where data is recorded
+		volatile bool     recording_ = false;   // OpenFile() started the recording, the callback may fill the ring
+		bool              preallocated_ = false;
+		volatile bool     stopped_ = false;     // SaveFile() ended the recording
+		bool              overrun_ = false;     // dropping frames until a segment is free
+		uint32_t          commit_interval_ = 0; // ms between header commits, 0 for none
+		uint32_t          last_commit_ = 0;     // millis() of the last one
+		WavWriterStats    stats_ = {};
+		WAV_FormatTypeDef wavheader_;
+		WAV_Ds64TypeDef   ds64_;
+		Flac              flac_;
+		uint8_t           flac_buff[kFlac ? Flac::kMaxFrameBytes : 1]; // one encoded segment
 
 
-	private:
-		static constexpr int kTransferSamps = transfer_size / sizeof(int32_t);
-		int32_t           transfer_buff[kTransferSamps * 2];
-		uint32_t          num_samps_, wptr_; 
-		File              fp_;  // The file where data is recorded
-		bool 			  recording_;
-		BufferState       bstate_;
-		size_t 			  LOCAL_CHANNELS = 1; // For testing one channel
-		WAV_FormatTypeDef wavheader_;
+		/** Sets the sizes in the header from the frames recorded, RF64 past 4 GB */
+		inline void UpdateSizes()
+		{
+		    uint64_t data = num_samps_ * kFrameBytes;
+		    uint64_t riff = kHeaderBytes - 8 + data;
+		    bool     rf64 = riff > 0xFFFFFFFF;
+
+		    memset(&ds64_, 0, sizeof(ds64_));
+		    ds64_.ChunkId   = rf64 ? kWavFileDs64Id : kWavFileJunkId;
+		    ds64_.ChunkSize = sizeof(ds64_) - 8;
+		    ds64_.RiffSize  = riff;
+		    ds64_.DataSize  = data;
+		    if(rf64)
+		    {
+		        ds64_.SampleCount = num_samps_;
+		    }
+
+		    // RF64 readers take the sizes from ds64 when these say 0xFFFFFFFF
+		    wavheader_.ChunkId       = rf64 ? kWavFileRf64Id : kWavFileChunkId;
+		    wavheader_.FileSize      = rf64 ? 0xFFFFFFFF : (uint32_t)riff;
+		    wavheader_.SubCHunk2Size = rf64 ? 0xFFFFFFFF : (uint32_t)data;
+		}
 
+		/** Writes the header at the current position: RIFF, ds64 or JUNK, fmt with or without
+		 ** the extension, and the start of the data chunk. FLAC's STREAMINFO when lossless. */
+		inline void WriteHeader()
+		{
+		    if(kFlac)
+		    {
+		        uint8_t buf[Flac::kStreamHeaderBytes];
+		        flac_.streamHeader(buf, num_samps_);
+		        fp_.write(buf, sizeof(buf));
+		        return;
+		    }
+		    const uint8_t *h = (const uint8_t *)&wavheader_;
+		    uint8_t buf[kHeaderBytes];
+		    memcpy(buf, h, 12); // RIFF, size, WAVE
+		    memcpy(buf + 12, &ds64_, sizeof(ds64_));
+		    memcpy(buf + 12 + sizeof(ds64_), h + 12, kExtensible ? 48 : 24); // fmt
+		    if(kFloat)
+		    {
+		        // frames per channel, ds64 has the count of RF64 files
+		        uint32_t fact[3] = {kWavFileFactId, 4, num_samps_ > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)num_samps_};
+		        memcpy(buf + kHeaderBytes - 8 - kFactBytes, fact, kFactBytes);
+		    }
+		    memcpy(buf + kHeaderBytes - 8, &wavheader_.SubChunk2ID, 8);
+		    fp_.write(buf, kHeaderBytes);
+		}
+
+		/** Rewrites the header for the frames written so far and syncs the file, which puts
+		 ** its length in the directory entry: the card has a complete recording up to here.
+		 ** The only seeks while recording. */
+		inline void CommitHeader()
+		{
+		    uint64_t end = fp_.curPosition();
+		    UpdateSizes();
+		    fp_.seekSet(0);
+		    WriteHeader();
+		    fp_.seekSet(end);
+		    fp_.sync();
+		    last_commit_ = millis();
+		}
+
+		/** Writes `frames` frames of a segment, through the encoder when lossless.
+		 ** The file position only moves forward between header commits. */
+		inline void WriteFrames(const uint8_t *segment, size_t frames)
+		{
+		    if(kFlac)
+		    {
+		        size_t bytes = flac_.encodeFrame(segment, frames, flac_buff);
+		        fp_.write(flac_buff, bytes);
+		        data_bytes_ += bytes;
+		    }
+		    else
+		    {
+		        fp_.write(segment, frames * kFrameBytes); // SD Arduino library
+		        data_bytes_ += frames * kFrameBytes;
+		    }
+		    num_samps_ += frames;
+		}
+
+		/** RecoverFile() of a RIFF or RF64 file: finds fmt, the ds64 room, fact and data, the
+		 ** chunks WriteHeader() writes, and sets their sizes from the committed data size,
+		 ** no more than the file holds */
+		static bool RecoverWav(FsFile &file)
+		{
+		    uint32_t riff[3];
+		    if(!file.seekSet(0) || file.read(riff, 12) != 12 || riff[2] != kWavFileWaveId ||
+		       (riff[0] != kWavFileChunkId && riff[0] != kWavFileRf64Id))
+		    {
+		        return false;
+		    }
+		    uint64_t end = file.fileSize();
+		    uint64_t pos = 12, ds64 = 0, fact = 0, data = 0, committed = 0, committed64 = 0;
+		    uint16_t align = 0;
+		    while(data == 0 && pos + 8 <= end)
+		    {
+		        uint32_t chunk[2];
+		        file.seekSet(pos);
+		        if(file.read(chunk, 8) != 8)
+		        {
+		            return false;
+		        }
+		        if(chunk[0] == kWavFileSubChunk2Id)
+		        {
+		            data = pos + 8;
+		            committed = chunk[1];
+		        }
+		        else if(chunk[0] == kWavFileSubChunk1Id && chunk[1] >= 16)
+		        {
+		            file.seekSet(pos + 20);
+		            file.read(&align, 2);
+		        }
+		        else if((chunk[0] == kWavFileJunkId || chunk[0] == kWavFileDs64Id) && chunk[1] == sizeof(WAV_Ds64TypeDef) - 8 && pos == 12)
+		        {
+		            ds64 = pos;
+		            if(chunk[0] == kWavFileDs64Id)
+		            {
+		                file.seekSet(pos + 16);
+		                file.read(&committed64, 8);
+		            }
+		        }
+		        else if(chunk[0] == kWavFileFactId && chunk[1] == 4)
+		        {
+		            fact = pos;
+		        }
+		        pos += 8 + (uint64_t)chunk[1] + (chunk[1] & 1);
+		    }
+		    if(data == 0 || align == 0)
+		    {
+		        return false;
+		    }
+
+		    // RF64 has the size in ds64. Past the committed data the file size counts
+		    // clusters that were never written, or not synced yet, see RecoverFile()
+		    if(committed == 0xFFFFFFFF && committed64)
+		    {
+		        committed = committed64;
+		    }
+		    uint64_t bytes = (committed < end - data ? committed : end - data) / align * align;
+		    if(bytes == 0)
+		    {
+		        // nothing committed, see RecoverFile()
+		        return false;
+		    }
+		    if(data - 8 + bytes > 0xFFFFFFFF && ds64 == 0)
+		    {
+		        // no room for the 64 bit sizes, keep what a RIFF file can say
+		        bytes = (0xFFFFFFFF - (data - 8)) / align * align;
+		    }
+		    uint64_t size = data - 8 + bytes;
+		    bool     rf64 = size > 0xFFFFFFFF;
+
+		    uint32_t head[2] = {rf64 ? kWavFileRf64Id : kWavFileChunkId, rf64 ? 0xFFFFFFFF : (uint32_t)size};
+		    file.seekSet(0);
+		    file.write(head, 8);
+		    if(ds64)
+		    {
+		        WAV_Ds64TypeDef d;
+		        memset(&d, 0, sizeof(d));
+		        d.ChunkId   = rf64 ? kWavFileDs64Id : kWavFileJunkId;
+		        d.ChunkSize = sizeof(d) - 8;
+		        d.RiffSize  = size;
+		        d.DataSize  = bytes;
+		        if(rf64)
+		        {
+		            d.SampleCount = bytes / align;
+		        }
+		        file.seekSet(ds64);
+		        file.write(&d, sizeof(d));
+		    }
+		    if(fact)
+		    {
+		        uint32_t frames = bytes / align > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)(bytes / align);
+		        file.seekSet(fact + 8);
+		        file.write(&frames, 4);
+		    }
+		    uint32_t length = rf64 ? 0xFFFFFFFF : (uint32_t)bytes;
+		    file.seekSet(data - 4);
+		    file.write(&length, 4);
+		    return file.truncate(data + bytes);
+		}
+
+		/** RecoverFile() of a FLAC file: the frames STREAMINFO committed, then every frame
+		 ** that follows with the next frame number and a CRC-16 that checks. A sync code
+		 ** inside the audio data, a torn frame or stale data after the last one end the
+		 ** search there. */
+		static bool RecoverFlac(FsFile &file)
+		{
+		    uint8_t info[Flac::kStreamHeaderBytes];
+		    if(!file.seekSet(0) || file.read(info, sizeof(info)) != sizeof(info) || (info[4] & 0x7F) != 0 || info[7] != 34)
+		    {
+		        return false;
+		    }
+		    uint32_t block    = info[10] << 8 | info[11]; // maximum block size, all but the last frame
+		    uint32_t channels = ((info[20] >> 1) & 7) + 1;
+		    uint32_t bits     = (((info[20] & 1) << 4) | (info[21] >> 4)) + 1;
+		    uint64_t committed = (uint64_t)(info[21] & 0x0F) << 32 | (uint32_t)info[22] << 24 | info[23] << 16 | info[24] << 8 | info[25];
+		    // a frame is no longer than WavWriter's encoder makes it
+		    uint64_t window   = 16 + (uint64_t)block * channels * ((bits + 7) / 8) + channels * 6 + 2;
+		    uint64_t end      = file.fileSize();
+
+		    // the committed frames end where the file does, unless the size is the preallocated
+		    // one on FAT; then they are followed from the first one
+		    uint64_t pos = Flac::kStreamHeaderBytes, samples = 0;
+		    uint32_t number = 0, last, frames;
+		    if(committed && FindFlacFrame(file, end, window, &last, &frames) && (uint64_t)last * block + frames == committed)
+		    {
+		        pos = end;
+		        samples = committed;
+		        number = last + 1;
+		    }
+		    while(FlacFrameAt(file, pos, number, &frames))
+		    {
+		        uint64_t next = FlacFrameEnd(file, pos, end, window, number + 1);
+		        if(!next)
+		        {
+		            break;
+		        }
+		        samples = (uint64_t)number * block + frames;
+		        pos = next;
+		        number++;
+		    }
+		    if(samples == 0)
+		    {
+		        // no whole frame, nothing to recover, see RecoverFile()
+		        return false;
+		    }
+		    if(pos < end && !file.truncate(pos))
+		    {
+		        return false;
+		    }
+		    info[21] = (uint8_t)((info[21] & 0xF0) | ((samples >> 32) & 0x0F));
+		    for(int i = 0; i < 4; i++)
+		    {
+		        info[22 + i] = (uint8_t)(samples >> (24 - 8 * i));
+		    }
+		    file.seekSet(0);
+		    return file.write(info, sizeof(info)) == sizeof(info);
+		}
+
+		/** Start of the last FLAC frame before `end`, within `window` bytes, that ends at
+		 ** `end` with a valid CRC-16; 0 if there is none. */
+		static uint64_t FindFlacFrame(FsFile &file, uint64_t end, uint64_t window, uint32_t *number, uint32_t *frames)
+		{
+		    const uint64_t first = Flac::kStreamHeaderBytes;
+		    const size_t   kHeaderMax = 16;
+		    uint8_t        buf[512 + kHeaderMax];
+		    uint64_t       lo = end > first + window ? end - window : first;
+		    for(uint64_t top = end; top > lo;)
+		    {
+		        uint64_t start = top - lo > 512 ? top - 512 : lo;
+		        size_t   n = (size_t)(end - start < sizeof(buf) ? end - start : sizeof(buf));
+		        file.seekSet(start);
+		        if(file.read(buf, n) != (int)n)
+		        {
+		            return 0;
+		        }
+		        for(size_t i = top - start; i-- > 0;)
+		        {
+		            if(buf[i] != 0xFF || !flac_frame_header(buf + i, n - i, number, frames))
+		            {
+		                continue;
+		            }
+		            if(FlacFrameEndsAt(file, start + i, end))
+		            {
+		                return start + i;
+		            }
+		        }
+		        top = start;
+		    }
+		    return 0;
+		}
+
+		/** True if a FLAC frame header with frame number `number` starts at `pos` */
+		static bool FlacFrameAt(FsFile &file, uint64_t pos, uint32_t number, uint32_t *frames)
+		{
+		    uint8_t  head[16];
+		    uint32_t at;
+		    if(!file.seekSet(pos))
+		    {
+		        return false;
+		    }
+		    int n = file.read(head, sizeof(head));
+		    return n > 0 && flac_frame_header(head, (size_t)n, &at, frames) && at == number;
+		}
+
+		/** End of the FLAC frame at `pos`: the first point within `window` bytes where the
+		 ** CRC-16 of the frame checks and the file ends or frame `next` starts; 0 if none */
+		static uint64_t FlacFrameEnd(FsFile &file, uint64_t pos, uint64_t end, uint64_t window, uint32_t next)
+		{
+		    uint8_t  buf[512];
+		    uint16_t crc = 0, before = 0; // of the frame up to the byte in hand, and to the one before
+		    uint8_t  last = 0;
+		    uint32_t frames;
+		    uint64_t limit = end - pos > window ? pos + window : end;
+		    for(uint64_t at = pos; at < limit; at += sizeof(buf))
+		    {
+		        size_t n = limit - at < sizeof(buf) ? (size_t)(limit - at) : sizeof(buf);
+		        file.seekSet(at);
+		        if(file.read(buf, n) != (int)n)
+		        {
+		            return 0;
+		        }
+		        for(size_t i = 0; i < n; i++)
+		        {
+		            // the CRC-16 is in this byte and the one before it
+		            uint64_t q = at + i + 1;
+		            if(q >= pos + 8 && (last << 8 | buf[i]) == before && (q == end || FlacFrameAt(file, q, next, &frames)))
+		            {
+		                return q;
+		            }
+		            before = crc;
+		            crc    = flac_crc16(&buf[i], 1, crc);
+		            last   = buf[i];
+		        }
+		    }
+		    return 0;
+		}
+
+		/** True if the CRC-16 of [pos, end - 2) is in the 2 bytes before `end` */
+		static bool FlacFrameEndsAt(FsFile &file, uint64_t pos, uint64_t end)
+		{
+		    uint8_t  buf[512];
+		    uint16_t crc = 0;
+		    if(end < pos + 8)
+		    {
+		        return false;
+		    }
+		    file.seekSet(pos);
+		    for(uint64_t left = end - 2 - pos; left > 0;)
+		    {
+		        size_t n = left < sizeof(buf) ? (size_t)left : sizeof(buf);
+		        if(file.read(buf, n) != (int)n)
+		        {
+		            return false;
+		        }
+		        crc = flac_crc16(buf, n, crc);
+		        left -= n;
+		    }
+		    return file.read(buf, 2) == 2 && (buf[0] << 8 | buf[1]) == crc;
+		}
+
+		/** True if segment head_ has room, else drops the `frames` frames on offer.
+		 ** A segment is only started once loop() has written it: head_ - tail_ full
+		 ** segments means the next one is the one loop() is still on. Frames before
+		 ** OpenFile() or after SaveFile() are dropped without counting. */
+		inline bool Reserve(size_t frames)
+		{
+		    if(!recording_ || stopped_)
+		        return false;
+		    if(wframe_ == 0 && head_ - tail_ >= segments)
+		    {
+		        if(!overrun_)
+		        {
+		            overrun_ = true;
+		            stats_.overruns++;
+		            stats_.lastOverrun = micros();
+		        }
+		        stats_.droppedFrames += frames;
+		        return false;
+		    }
+		    overrun_ = false;
+		    return true;
+		}
+
+		/** Moves past n stored frames, hands a full segment to loop() */
+		inline void Advance(size_t n)
+		{
+		    wframe_ += n;
+		    if(wframe_ == kSegmentFrames)
+		    {
+		        wframe_ = 0;
+		        __atomic_signal_fence(__ATOMIC_SEQ_CST); // the segment is complete before head_ moves
+		        head_ = head_ + 1;
+		        uint32_t queued = head_ - tail_;
+		        if(queued > stats_.highWater)
+		            stats_.highWater = queued;
+		    }
+		}
+
+		/** Takes the SAI word width the callback samples have, for the shift and the
+		 ** valid bits in the header */
+		void SetWordWidth(unsigned wordBits)
+		{
+		    shift_ = (uint8_t)(32 - wordBits);
+		    wavheader_.ValidBitsPerSample = kFloat ? 32 : (wordBits < bit_depth ? wordBits : bit_depth);
+		}
 
-		inline uint32_t CalcFileSize()
+		/** Interleaves frames [first, first + count) of the planar channels into dest,
+		 ** one kernel per sample format with the channel loop unrolled */
+		inline void PackFrames(const int32_t *const *channels, size_t first, size_t count, uint8_t *dest) const
 		{
-		    wavheader_.SubCHunk2Size
-		        = num_samps_ * CHANNELS * BIT_DEPTH / 8;
-		    return 36 + wavheader_.SubCHunk2Size;
+		    const int32_t *src[CHANNELS];
+		    for(size_t k = 0; k < CHANNELS; k++)
+		    {
+		        src[k] = channels[k] + first;
+		    }
+		    const unsigned shift = shift_;
+		    if(kFloat)
+		    {
+		        pcm_interleave_f32<CHANNELS>(src, count, (float *)dest, shift);
+		        return;
+		    }
+		    switch(bit_depth)
+		    {
+		        case 16:
+		            pcm_interleave16<CHANNELS>(src, count, (int16_t *)dest, shift);
+		            break;
+		        case 24:
+		            pcm_interleave24<CHANNELS>(src, count, dest, shift);
+		            break;
+		        default:
+		            if(count == AUDIO_BLOCK_SAMPLES && shift == 0)
+		            {
+		                // a whole callback block of 32 bit words, the same transpose as the TDM output
+		                tdm_interleave<CHANNELS, AUDIO_BLOCK_SAMPLES>(src, (int32_t *)dest);
+		            }
+		            else
+		            {
+		                pcm_interleave32<CHANNELS>(src, count, (int32_t *)dest, shift);
+		            }
+		            break;
+		    }
 		}
 };
 #endif
\ No newline at end of file
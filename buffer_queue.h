@@ -1,69 +1,140 @@
 #pragma once
 
-// Circular queue of buffers used to produce and consume new blocks of audio data 
-// coming from and going to the I2S bus. 
-// Current setup is working for 2 channels using i2s or TDM for 4 channels.
+#include <Arduino.h>
+#include "AudioConfig.h"
+#include "utility/tdm_transpose.h"
+#include "utility/tdm_convert.h"
+#include "utility/audio_trace.h"
+
+#define BUFFER_QUEUE_EVENTS 16 // xrun events kept for loop() to read
+
+// A block that was dropped or repeated.
+// Overrun: a block was published while the queue was full, the oldest block was discarded.
+// Underrun: a block was consumed while the queue was empty, the reader gets the same block again.
+struct BufferQueueEvent
+{
+	enum Type : uint8_t { Overrun, Underrun };
+
+	uint32_t time; // micros() when it happened
+	Type type;
+};
+
+struct BufferQueueStats
+{
+	uint32_t overruns;     // blocks dropped
+	uint32_t underruns;    // blocks repeated
+	uint32_t lastOverrun;  // micros() of the last dropped block, 0 if none
+	uint32_t lastUnderrun; // micros() of the last repeated block, 0 if none
+	int minAvailable;      // fewest blocks left after a consume: headroom that was never needed
+	int maxAvailable;      // most blocks waiting after a publish
+};
+
+// Circular queue of buffers used to produce and consume new blocks of audio data
+// coming from and going to the I2S bus.
+// The number of channels is a template parameter, 2 for plain i2s or up to 16 TDM slots,
+// the samples are int32_t or float (AUDIO_FLOAT_PROCESSING) and each block holds BlockSamples
+// samples per channel.
+// Memory is reserved for BUFFER_QUEUE_MAX_SIZE blocks, the number of blocks in use
+// (and with it the latency) is set per queue at runtime with reset().
+template <size_t Channels, typename Sample = int32_t, size_t BlockSamples = AUDIO_BLOCK_SAMPLES>
 class BufferQueue
 {
-#define BUFFER_QUEUE_SIZE 3
 public:
-  int32_t channel[CHANNELS][AUDIO_BLOCK_SAMPLES * BUFFER_QUEUE_SIZE];
-	int32_t* readPtr[CHANNELS];
-	int32_t* writePtr[CHANNELS];
+	static_assert(Channels > 0 && Channels <= TDM_MAX_CHANNELS, "BufferQueue supports 1 to 16 channels");
+	static_assert(BUFFER_QUEUE_SIZE >= 2 && BUFFER_QUEUE_SIZE <= BUFFER_QUEUE_MAX_SIZE, "BUFFER_QUEUE_SIZE must be 2 to BUFFER_QUEUE_MAX_SIZE");
 
+	Sample channel[Channels][BlockSamples * BUFFER_QUEUE_MAX_SIZE];
+	Sample* readPtr[Channels];
+	Sample* writePtr[Channels];
+
+	uint8_t depth = BUFFER_QUEUE_SIZE;
 	uint8_t readPos = 0;
 	uint8_t writePos = 0;
 	int available = 0;
 
-	inline BufferQueue()
+	BufferQueueStats stats;
+	BufferQueueEvent events[BUFFER_QUEUE_EVENTS];
+	volatile uint32_t eventsWritten = 0;
+	uint32_t eventsRead = 0;
+	const char* name; // trace counter name (AUDIO_TRACE)
+
+	// The queue starts with `prefill` blocks of silence available for reading
+	inline BufferQueue(size_t prefill = BUFFER_QUEUE_SIZE - 1, const char* name = "queue") : name(name)
 	{
-		writePtr[0] = &channel[0][writePos * AUDIO_BLOCK_SAMPLES];
-		writePtr[1] = &channel[1][writePos * AUDIO_BLOCK_SAMPLES];
-    
-        readPtr[0] = &channel[0][readPos * AUDIO_BLOCK_SAMPLES];
-		readPtr[1] = &channel[1][readPos * AUDIO_BLOCK_SAMPLES];
-    
-    if (CHANNELS > 2) {
-        writePtr[2] = &channel[2][writePos * AUDIO_BLOCK_SAMPLES];
-		writePtr[3] = &channel[3][writePos * AUDIO_BLOCK_SAMPLES];
-
-        readPtr[2] = &channel[2][readPos * AUDIO_BLOCK_SAMPLES];
-		readPtr[3] = &channel[3][readPos * AUDIO_BLOCK_SAMPLES];
-     }
-        for (size_t i = 0; i < AUDIO_BLOCK_SAMPLES * BUFFER_QUEUE_SIZE; i++)
-        {
-            channel[0][i] = 0;
-            channel[1][i] = 0;
-            
-            if (CHANNELS > 2) {
-              channel[2][i] = 0;
-              channel[3][i] = 0;
-            }
-        }
-        
-        for (size_t i = 0; i < BUFFER_QUEUE_SIZE - 1; i++)
-        {
-            publish();
-        }
+		reset(BUFFER_QUEUE_SIZE, prefill);
+	}
+
+	// Empties the queue, uses `blocks` blocks from now on and publishes `prefill` blocks of silence.
+	// The interrupts using the queue must be disabled while it is reset.
+	inline void reset(size_t blocks, size_t prefill)
+	{
+		if (blocks < 2)
+			blocks = 2;
+		if (blocks > BUFFER_QUEUE_MAX_SIZE)
+			blocks = BUFFER_QUEUE_MAX_SIZE;
+		if (prefill > blocks - 1)
+			prefill = blocks - 1;
+
+		depth = blocks;
+		readPos = 0;
+		writePos = 0;
+		available = 0;
+
+		for (size_t k = 0; k < Channels; k++)
+		{
+			writePtr[k] = &channel[k][writePos * BlockSamples];
+			readPtr[k] = &channel[k][readPos * BlockSamples];
+
+			for (size_t i = 0; i < BlockSamples * depth; i++)
+			{
+				channel[k][i] = 0;
+			}
+		}
+
+		for (size_t i = 0; i < prefill; i++)
+		{
+			publish();
+		}
+
+		clearStats();
+		eventsRead = eventsWritten;
+	}
+
+	inline void clearStats()
+	{
+		stats.overruns = 0;
+		stats.underruns = 0;
+		stats.lastOverrun = 0;
+		stats.lastUnderrun = 0;
+		stats.minAvailable = available;
+		stats.maxAvailable = available;
 	}
 
 	// Increases writePos by one and updates the write pointers
 	// First, write to the write pointers, then call this function to mark the data as available for reading.
 	inline void publish()
 	{
-		writePos = (writePos + 1) % BUFFER_QUEUE_SIZE;
-		writePtr[0] = &channel[0][writePos * AUDIO_BLOCK_SAMPLES];
-		writePtr[1] = &channel[1][writePos * AUDIO_BLOCK_SAMPLES];
-    
-        if (CHANNELS > 2) {
-          writePtr[2] = &channel[2][writePos * AUDIO_BLOCK_SAMPLES];
-		  writePtr[3] = &channel[3][writePos * AUDIO_BLOCK_SAMPLES];
-    }
-    available++;
+		if (++writePos >= depth)
+			writePos = 0;
+		for (size_t k = 0; k < Channels; k++)
+		{
+			writePtr[k] = &channel[k][writePos * BlockSamples];
+		}
+		available++;
 
 		// writing over the tail of the circular buffer. Should never happen as read and write should be synchronous!
-		if (available > BUFFER_QUEUE_SIZE)
+		if (available > depth)
+		{
 			consume(); // consume and discard one block
+			stats.overruns++;
+			stats.lastOverrun = micros();
+			logEvent(BufferQueueEvent::Overrun, stats.lastOverrun);
+		}
+
+		if (available > stats.maxAvailable)
+			stats.maxAvailable = available;
+
+		AUDIO_TRACE_COUNTER(name, available);
 	}
 
 	// increase ReadPos by one and updates the read pointers.
@@ -71,16 +142,51 @@ public:
 	inline void consume()
 	{
 		if (available <= 0)
+		{
+			// nothing new was written, the reader gets the same block again
+			stats.underruns++;
+			stats.lastUnderrun = micros();
+			logEvent(BufferQueueEvent::Underrun, stats.lastUnderrun);
+			AUDIO_TRACE_COUNTER(name, available);
 			return;
+		}
+
+		if (++readPos >= depth)
+			readPos = 0;
+		for (size_t k = 0; k < Channels; k++)
+		{
+			readPtr[k] = &channel[k][readPos * BlockSamples];
+		}
+		available--;
 
-		readPos = (readPos + 1) % BUFFER_QUEUE_SIZE;
-		readPtr[0] = &channel[0][readPos * AUDIO_BLOCK_SAMPLES];
-		readPtr[1] = &channel[1][readPos * AUDIO_BLOCK_SAMPLES];
-    
-    if (CHANNELS > 2) {
-      	readPtr[2] = &channel[2][readPos * AUDIO_BLOCK_SAMPLES];
-		readPtr[3] = &channel[3][readPos * AUDIO_BLOCK_SAMPLES];
-    }
-    available--;
+		if (available < stats.minAvailable)
+			stats.minAvailable = available;
+
+		AUDIO_TRACE_COUNTER(name, available);
+	}
+
+	// Reads the oldest xrun event not read yet, returns false if there is none.
+	// Meant for loop(): when more than BUFFER_QUEUE_EVENTS events happen in between
+	// the oldest are lost, the counters in stats still include them.
+	inline bool readEvent(BufferQueueEvent& event)
+	{
+		uint32_t written = eventsWritten;
+		if (eventsRead == written)
+			return false;
+		if (written - eventsRead > BUFFER_QUEUE_EVENTS)
+			eventsRead = written - BUFFER_QUEUE_EVENTS;
+
+		event = events[eventsRead % BUFFER_QUEUE_EVENTS];
+		eventsRead++;
+		return true;
+	}
+
+private:
+	inline void logEvent(BufferQueueEvent::Type type, uint32_t time)
+	{
+		BufferQueueEvent& event = events[eventsWritten % BUFFER_QUEUE_EVENTS];
+		event.time = time;
+		event.type = type;
+		eventsWritten = eventsWritten + 1;
 	}
 };
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <Arduino.h>
+#include "AudioConfig.h"
+
+#define DEADLINE_EVENTS 16 // missed deadlines kept for loop() to read
+
+// A transmit interrupt that finished after the DMA had moved on to the half of the
+// buffer it had just filled, i.e. after the next half interrupt was already due.
+// Every cycle of overshoot delays the next interrupt, a half period of it plays stale audio.
+// With AUDIO_DEFERRED_PROCESSING also a callback that published its block after the transmit
+// interrupt had already repeated one for want of it.
+struct DeadlineEvent
+{
+	uint32_t time;        // micros() when the interrupt (or the deferred callback) finished
+	uint32_t overshoot;   // cycles past the deadline
+	uint32_t cycles;      // cycles from the interrupt entry (the deferred callback's start) to the end of the callback
+	const char* context;  // what loop() said it was doing, see AudioOutputI2S::setContext()
+};
+
+struct DeadlineStats
+{
+	uint32_t misses;        // interrupts that finished late
+	uint32_t lastMiss;      // micros() of the last miss, 0 if none
+	uint32_t maxOvershoot;  // cycles past the deadline of the worst miss
+};
+
+// Checks the end of each transmit interrupt against the DMA source address and the cycle
+// budget of a DMA half, and keeps the misses in a ring for loop(), like BufferQueue's xrun events.
+class DeadlineMonitor
+{
+public:
+	DeadlineStats stats;
+	DeadlineEvent events[DEADLINE_EVENTS];
+	volatile uint32_t eventsWritten = 0;
+	uint32_t eventsRead = 0;
+
+	// Set from loop() with a string literal, read by the interrupt when it misses
+	const char* volatile context = nullptr;
+
+	inline DeadlineMonitor() { clearStats(); }
+
+	// Cycles available per DMA half, set when the sample rate changes
+	inline void setBudget(uint32_t cycles) { budget = cycles; }
+	inline uint32_t getBudget() const { return budget; }
+
+	inline void clearStats()
+	{
+		stats.misses = 0;
+		stats.lastMiss = 0;
+		stats.maxOvershoot = 0;
+	}
+
+	// Called at the end of the interrupt that filled [fillStart, fillEnd) while the DMA was in the
+	// other half. `saddr` is the DMA source address now, `entry` the cycle count at the interrupt entry.
+	// The DMA inside the filled half means the boundary has passed, by the frames it has read since;
+	// running longer than the budget catches the DMA having gone all the way around as well.
+	inline void check(uintptr_t saddr, uintptr_t fillStart, uintptr_t fillEnd, uint32_t frameBytes, uint32_t entry, uint32_t now)
+	{
+		uint32_t cycles = now - entry;
+		uint32_t overshoot = 0;
+		bool late = false;
+
+		if (saddr >= fillStart && saddr < fillEnd)
+		{
+			late = true;
+			overshoot = (uint32_t)((saddr - fillStart) / frameBytes) * (budget / AUDIO_DMA_HALF_FRAMES);
+		}
+		if (cycles > budget)
+		{
+			late = true;
+			if (cycles - budget > overshoot)
+				overshoot = cycles - budget;
+		}
+		if (!late)
+			return;
+
+		miss(overshoot, cycles);
+	}
+
+	// Records a miss found elsewhere, e.g. a deferred callback that came too late for its block
+	inline void miss(uint32_t overshoot, uint32_t cycles)
+	{
+		stats.misses++;
+		stats.lastMiss = micros();
+		if (overshoot > stats.maxOvershoot)
+			stats.maxOvershoot = overshoot;
+
+		DeadlineEvent& event = events[eventsWritten % DEADLINE_EVENTS];
+		event.time = stats.lastMiss;
+		event.overshoot = overshoot;
+		event.cycles = cycles;
+		event.context = context;
+		eventsWritten = eventsWritten + 1;
+	}
+
+	// Reads the oldest miss not read yet, returns false if there is none.
+	// When more than DEADLINE_EVENTS misses happen in between the oldest are lost.
+	inline bool readEvent(DeadlineEvent& event)
+	{
+		uint32_t written = eventsWritten;
+		if (eventsRead == written)
+			return false;
+		if (written - eventsRead > DEADLINE_EVENTS)
+			eventsRead = written - DEADLINE_EVENTS;
+
+		event = events[eventsRead % DEADLINE_EVENTS];
+		eventsRead++;
+		return true;
+	}
+
+private:
+	uint32_t budget = 0xFFFFFFFF;
+};
@@ -25,13 +25,10 @@ void processAudio(int32_t** inputs, int32_t** outputs)
     // to use these optimised arm-specific functions whenever possible
     int sig = (int)(arm_sin_f32(acc * 0.001f * 2.0f * M_PI) * 200000000.0f);
 
-    outputs[0][i] = -inputs[0][i] + sig;
-    outputs[1][i] = -inputs[1][i] + sig;
-    
-    if (CHANNELS > 2) {
-      outputs[2][i] = -inputs[2][i] + sig;
-      outputs[3][i] = -inputs[3][i] + sig;
-    }  
+    for (size_t ch = 0; ch < CHANNELS; ch++)
+    {
+      outputs[ch][i] = -inputs[ch][i] + sig;
+    }
     acc++;
     if (acc >= 50000)
       acc -= 50000;
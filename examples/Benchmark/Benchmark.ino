@@ -0,0 +1,29 @@
+#include "AudioConfig.h"
+#include "kernel_bench.h"
+
+// Times the library's copy loops, BufferQueue, WavWriter::Sample, the FLAC encoder, dspinst.h
+// and the passthrough callback with the DWT cycle counter and prints CSV over Serial.
+// The audio interrupts are not started, nothing else runs during the measurement.
+// Save the output to a file and compare two runs with extras/host/tools/bench_compare.py.
+
+struct TeensyClock
+{
+  static uint32_t cycles() { return ARM_DWT_CYCCNT; }
+  static double nsPerCycle() { return 1e9 / F_CPU_ACTUAL; }
+};
+
+void setup(void)
+{
+  Serial.begin(9600);
+  while (!Serial) { }
+
+  Serial.print("# kernel_bench teensy ");
+  Serial.print(F_CPU_ACTUAL / 1000000);
+  Serial.println(" MHz");
+  kernel_bench::run<TeensyClock>(Serial);
+  Serial.println("# done");
+}
+
+void loop(void)
+{
+}
@@ -0,0 +1,314 @@
+/* Benchmarks of the library's hot kernels, shared by the Benchmark sketch (on the Teensy,
+ * timed with the DWT cycle counter) and extras/host/bench/kernel_bench.cpp (on Linux).
+ *
+ * Every kernel runs in batches and the fastest batch counts, so an interrupt or a cache
+ * miss in one batch does not skew the result. The output is CSV, one row per kernel and
+ * shape:
+ *
+ *   kernel,channels,block,ns_per_sample,cycles_per_block
+ *
+ * `block` is AUDIO_BLOCK_SAMPLES-style samples per channel, a sample is one channel of one
+ * frame. Lines starting with # are comments. extras/host/tools/bench_compare.py compares
+ * two runs and fails on regressions.
+ *
+ * A Clock provides `static uint32_t cycles()` and `static double nsPerCycle()`.
+ */
+#pragma once
+
+#include <math.h>
+#include "Arduino.h"
+#include "AudioConfig.h"
+#include "buffer_queue.h"
+#include "output_i2s_tdm.h"
+#include "WavWriter.h"
+#include "utility/tdm_transpose.h"
+#include "utility/tdm_convert.h"
+#include "utility/pcm_pack.h"
+#include "utility/flac_encoder.h"
+#include "utility/dspinst.h"
+
+namespace kernel_bench
+{
+	static const size_t kMaxChannels = 16;
+	static const size_t kMaxBlock = 256;
+	static const int kBatches = 31;
+
+	alignas(32) static int32_t interleaved[kMaxChannels * kMaxBlock];
+	alignas(32) static int32_t planar[kMaxChannels][kMaxBlock];
+	alignas(32) static float planarFloat[kMaxChannels][kMaxBlock];
+	alignas(32) static int32_t dspA[kMaxChannels * kMaxBlock];
+	alignas(32) static int32_t dspB[kMaxChannels * kMaxBlock];
+	alignas(32) static int32_t dspOut[kMaxChannels * kMaxBlock];
+
+	static WavWriter<32768> writer;
+
+	// FLAC streams end at 8 channels
+	static const size_t kFlacChannels = CHANNELS <= 8 ? CHANNELS : 8;
+	static FlacEncoder<kFlacChannels, BIT_DEPTH, AUDIO_BLOCK_SAMPLES> flac;
+
+	// samples per batch, scaled by run()
+	static uint32_t batchSamples = 65536;
+
+	// Fewest cycles of one call of fn over kBatches batches of `reps` calls
+	template <typename Clock, typename Fn>
+	static double measure(Fn fn, uint32_t reps)
+	{
+		uint32_t best = 0xFFFFFFFF;
+		for (int b = 0; b < kBatches; b++)
+		{
+			uint32_t start = Clock::cycles();
+			for (uint32_t n = 0; n < reps; n++)
+			{
+				fn();
+				asm volatile("" ::: "memory");
+			}
+			uint32_t cycles = Clock::cycles() - start;
+			if (cycles < best)
+				best = cycles;
+		}
+		return (double)best / reps;
+	}
+
+	template <typename Clock, typename Out>
+	static void row(Out& out, const char* kernel, size_t channels, size_t block, double cyclesPerBlock)
+	{
+		out.print(kernel);
+		out.print(',');
+		out.print((int)channels);
+		out.print(',');
+		out.print((int)block);
+		out.print(',');
+		out.print(cyclesPerBlock * Clock::nsPerCycle() / (channels * block), 4);
+		out.print(',');
+		out.println(cyclesPerBlock, 1);
+	}
+
+	template <size_t Channels, size_t Block>
+	static uint32_t reps()
+	{
+		return batchSamples / (Channels * Block) + 1;
+	}
+
+	// The DMA interrupts copy a block in two halves (AUDIO_DMA_HALF_FRAMES)
+	template <typename Clock, typename Out, size_t Channels, size_t Block>
+	static void benchCopy(Out& out)
+	{
+		const size_t Half = Block / 2;
+		int32_t* dest[Channels];
+		const int32_t* src[Channels];
+		float* destFloat[Channels];
+		const float* srcFloat[Channels];
+
+		int32_t* destHigh[Channels];
+		const int32_t* srcHigh[Channels];
+		float* destFloatHigh[Channels];
+		const float* srcFloatHigh[Channels];
+		for (size_t k = 0; k < Channels; k++)
+		{
+			dest[k] = planar[k];
+			src[k] = planar[k];
+			destFloat[k] = planarFloat[k];
+			srcFloat[k] = planarFloat[k];
+			destHigh[k] = planar[k] + Half;
+			srcHigh[k] = planar[k] + Half;
+			destFloatHigh[k] = planarFloat[k] + Half;
+			srcFloatHigh[k] = planarFloat[k] + Half;
+		}
+
+		row<Clock>(out, "input_copy", Channels, Block, measure<Clock>([&] {
+			tdm_deinterleave<Channels, Half>(interleaved, dest);
+			tdm_deinterleave<Channels, Half>(interleaved + Channels * Half, destHigh);
+		}, reps<Channels, Block>()));
+
+		row<Clock>(out, "output_copy", Channels, Block, measure<Clock>([&] {
+			tdm_interleave<Channels, Half>(src, interleaved);
+			tdm_interleave<Channels, Half>(srcHigh, interleaved + Channels * Half);
+		}, reps<Channels, Block>()));
+
+		row<Clock>(out, "input_copy_f32", Channels, Block, measure<Clock>([&] {
+			tdm_deinterleave<Channels, Half>(interleaved, destFloat);
+			tdm_deinterleave<Channels, Half>(interleaved + Channels * Half, destFloatHigh);
+		}, reps<Channels, Block>()));
+
+		row<Clock>(out, "output_copy_f32", Channels, Block, measure<Clock>([&] {
+			tdm_interleave<Channels, Half>(srcFloat, interleaved);
+			tdm_interleave<Channels, Half>(srcFloatHigh, interleaved + Channels * Half);
+		}, reps<Channels, Block>()));
+	}
+
+	// One publish and one consume, what each side does per block
+	template <typename Clock, typename Out, size_t Channels, size_t Block>
+	static void benchQueue(Out& out)
+	{
+		BufferQueue<Channels, int32_t, Block>* queue = new BufferQueue<Channels, int32_t, Block>();
+		row<Clock>(out, "queue_publish_consume", Channels, Block, measure<Clock>([&] {
+			queue->publish();
+			queue->consume();
+		}, reps<Channels, Block>()));
+		delete queue;
+	}
+
+	// WavWriter's planar to PCM kernels, one whole block
+	template <typename Clock, typename Out, size_t Channels, size_t Block>
+	static void benchPack(Out& out)
+	{
+		const int32_t* src[Channels];
+		for (size_t k = 0; k < Channels; k++)
+			src[k] = planar[k];
+		uint8_t* dest = (uint8_t*)interleaved;
+		// the samples as BIT_DEPTH words, like the recording gets them
+		const unsigned shift = 32 - BIT_DEPTH;
+
+		row<Clock>(out, "pcm_pack16", Channels, Block, measure<Clock>([&] {
+			pcm_interleave16<Channels>(src, Block, (int16_t*)dest, shift);
+		}, reps<Channels, Block>()));
+
+		row<Clock>(out, "pcm_pack24", Channels, Block, measure<Clock>([&] {
+			pcm_interleave24<Channels>(src, Block, dest, shift);
+		}, reps<Channels, Block>()));
+
+		row<Clock>(out, "pcm_pack32", Channels, Block, measure<Clock>([&] {
+			pcm_interleave32<Channels>(src, Block, (int32_t*)dest, shift);
+		}, reps<Channels, Block>()));
+
+		row<Clock>(out, "pcm_pack_f32", Channels, Block, measure<Clock>([&] {
+			pcm_interleave_f32<Channels>(src, Block, (float*)dest, shift);
+		}, reps<Channels, Block>()));
+	}
+
+	template <typename Clock, typename Out, size_t Channels, size_t Block>
+	static void benchDsp(Out& out)
+	{
+		const size_t n = Channels * Block;
+
+		row<Clock>(out, "dsp_multiply_32x32_rshift32_rounded", Channels, Block, measure<Clock>([&] {
+			for (size_t i = 0; i < n; i++)
+				dspOut[i] = multiply_32x32_rshift32_rounded(dspA[i], dspB[i]);
+		}, reps<Channels, Block>()));
+
+		row<Clock>(out, "dsp_signed_multiply_accumulate_32x16b", Channels, Block, measure<Clock>([&] {
+			for (size_t i = 0; i < n; i++)
+				dspOut[i] = signed_multiply_accumulate_32x16b(dspOut[i], dspA[i], dspB[i]);
+		}, reps<Channels, Block>()));
+
+		row<Clock>(out, "dsp_signed_saturate_rshift", Channels, Block, measure<Clock>([&] {
+			for (size_t i = 0; i < n; i++)
+				dspOut[i] = signed_saturate_rshift(dspA[i], 16, 15);
+		}, reps<Channels, Block>()));
+
+		row<Clock>(out, "dsp_signed_add_16_and_16", Channels, Block, measure<Clock>([&] {
+			for (size_t i = 0; i < n; i++)
+				dspOut[i] = signed_add_16_and_16(dspA[i], dspB[i]);
+		}, reps<Channels, Block>()));
+
+		row<Clock>(out, "dsp_multiply_16tx16t_add_16bx16b", Channels, Block, measure<Clock>([&] {
+			for (size_t i = 0; i < n; i++)
+				dspOut[i] = multiply_16tx16t_add_16bx16b(dspA[i], dspB[i]);
+		}, reps<Channels, Block>()));
+	}
+
+	template <typename Clock, typename Out, size_t Channels, size_t Block>
+	static void benchShape(Out& out)
+	{
+		benchCopy<Clock, Out, Channels, Block>(out);
+		benchQueue<Clock, Out, Channels, Block>(out);
+		benchPack<Clock, Out, Channels, Block>(out);
+		benchDsp<Clock, Out, Channels, Block>(out);
+	}
+
+	template <typename Clock, typename Out, size_t Channels>
+	static void benchChannels(Out& out)
+	{
+		benchShape<Clock, Out, Channels, 16>(out);
+		benchShape<Clock, Out, Channels, 32>(out);
+		benchShape<Clock, Out, Channels, 64>(out);
+		benchShape<Clock, Out, Channels, 128>(out);
+		benchShape<Clock, Out, Channels, 256>(out);
+	}
+
+	// The library's own callback path at the configured CHANNELS and AUDIO_BLOCK_SAMPLES
+	template <typename Clock, typename Out>
+	static void benchConfigured(Out& out)
+	{
+		int32_t* inputs[CHANNELS];
+		int32_t* outputs[CHANNELS];
+		for (size_t k = 0; k < CHANNELS; k++)
+		{
+			inputs[k] = planar[k];
+			outputs[k] = dspOut + k * AUDIO_BLOCK_SAMPLES;
+		}
+
+		// i2sAudioCallback is the passthrough until a sketch replaces it
+		row<Clock>(out, "passthrough", CHANNELS, AUDIO_BLOCK_SAMPLES, measure<Clock>([&] {
+			i2sAudioCallback(inputs, outputs);
+		}, reps<CHANNELS, AUDIO_BLOCK_SAMPLES>()));
+
+		// one Sample() per frame of the block, as a recording callback does. Full segments
+		// are released as loop() would after writing them, so the ring never overruns.
+		writer.WavInit();
+		row<Clock>(out, "wav_sample", CHANNELS, AUDIO_BLOCK_SAMPLES, measure<Clock>([&] {
+			for (size_t i = 0; i < AUDIO_BLOCK_SAMPLES; i++)
+				writer.Sample(&interleaved[i * CHANNELS]);
+			if (writer.PeekSegment())
+				writer.ReleaseSegment();
+		}, reps<CHANNELS, AUDIO_BLOCK_SAMPLES>()));
+
+		// the whole planar block at once
+		row<Clock>(out, "wav_sample_block", CHANNELS, AUDIO_BLOCK_SAMPLES, measure<Clock>([&] {
+			writer.SampleBlock(inputs, AUDIO_BLOCK_SAMPLES);
+			if (writer.PeekSegment())
+				writer.ReleaseSegment();
+		}, reps<CHANNELS, AUDIO_BLOCK_SAMPLES>()));
+
+		// WavWriter's lossless stage, what loop() spends per block: a 24 bit tone per channel
+		// with noise 70 dB down, in the PCM layout of the ring (the tone is left-justified already)
+		const int32_t* tone[kFlacChannels];
+		for (size_t k = 0; k < kFlacChannels; k++)
+		{
+			int32_t* t = dspA + k * AUDIO_BLOCK_SAMPLES;
+			for (size_t i = 0; i < AUDIO_BLOCK_SAMPLES; i++)
+				t[i] = ((int32_t)(0x30000000 * sinf(0.05f * (k + 1) * i)) + (dspB[i] >> 12)) & (int32_t)0xFFFFFF00;
+			tone[k] = t;
+		}
+		uint8_t* pcm = (uint8_t*)interleaved;
+		switch (BIT_DEPTH)
+		{
+			case 16: pcm_interleave16<kFlacChannels>(tone, AUDIO_BLOCK_SAMPLES, (int16_t*)pcm, 0); break;
+			case 24: pcm_interleave24<kFlacChannels>(tone, AUDIO_BLOCK_SAMPLES, pcm, 0); break;
+			default: pcm_interleave32<kFlacChannels>(tone, AUDIO_BLOCK_SAMPLES, (int32_t*)pcm, 0); break;
+		}
+		flac.begin(SAMPLERATE);
+		row<Clock>(out, "flac_encode", kFlacChannels, AUDIO_BLOCK_SAMPLES, measure<Clock>([&] {
+			flac.encodeFrame(pcm, AUDIO_BLOCK_SAMPLES, (uint8_t*)dspOut);
+		}, reps<kFlacChannels, AUDIO_BLOCK_SAMPLES>()));
+	}
+
+	// Runs everything; scale multiplies the batch size (and the run time)
+	template <typename Clock, typename Out>
+	static void run(Out& out, float scale = 1)
+	{
+		batchSamples = (uint32_t)(65536 * scale);
+
+		for (size_t i = 0; i < kMaxChannels * kMaxBlock; i++)
+		{
+			interleaved[i] = (int32_t)(i * 2654435761u);
+			dspA[i] = (int32_t)(i * 40503u) ^ 0x5A5A5A5A;
+			dspB[i] = (int32_t)(i * 2246822519u);
+		}
+		for (size_t k = 0; k < kMaxChannels; k++)
+		{
+			for (size_t i = 0; i < kMaxBlock; i++)
+			{
+				planar[k][i] = (int32_t)((k << 24) ^ (i * 40503u));
+				planarFloat[k][i] = q31_to_float(planar[k][i]);
+			}
+		}
+
+		out.println("kernel,channels,block,ns_per_sample,cycles_per_block");
+		benchChannels<Clock, Out, 2>(out);
+		benchChannels<Clock, Out, 4>(out);
+		benchChannels<Clock, Out, 8>(out);
+		benchChannels<Clock, Out, 16>(out);
+		benchConfigured<Clock, Out>(out);
+	}
+}
@@ -16,15 +16,12 @@ int acc = 0;
 
 void processAudio(int32_t** inputs, int32_t** outputs)
 {
-  for (size_t i = 0; i < AUDIO_BLOCK_SAMPLES; i++)
+  for (size_t ch = 0; ch < CHANNELS; ch++)
   {
-    outputs[0][i] = -inputs[0][i];
-    outputs[1][i] = -inputs[1][i];
-    
-    if (CHANNELS > 2) {
-      outputs[2][i] = -inputs[2][i];
-      outputs[3][i] = -inputs[3][i];
-    }  
+    for (size_t i = 0; i < AUDIO_BLOCK_SAMPLES; i++)
+    {
+      outputs[ch][i] = -inputs[ch][i];
+    }
   }
 }
 
@@ -51,6 +48,25 @@ void debugCPU() {
   Serial.print(" -- Processing period: ");
   Serial.print(period/1000, 3);
   Serial.println("ms");
+
+#if AUDIO_TIMER_HISTOGRAM
+  // The tail matters more than the average: one slow block is a click
+  Serial.print("Processing time p50/p99/p99.9: ");
+  Serial.print(Timers::GetPercentile(Timers::TIMER_TOTAL, 50), 2);
+  Serial.print(" / ");
+  Serial.print(Timers::GetPercentile(Timers::TIMER_TOTAL, 99), 2);
+  Serial.print(" / ");
+  Serial.print(Timers::GetPercentile(Timers::TIMER_TOTAL, 99.9f), 2);
+  Serial.println("us");
+#endif
+
+  DeadlineEvent event;
+  while (AudioOutputI2S::readDeadlineEvent(event)) {
+    Serial.print("Deadline missed by ");
+    Serial.print(Timers::CyclesToMicros(event.overshoot), 2);
+    Serial.print("us during ");
+    Serial.println(event.context ? event.context : "-");
+  }
 }
 
 void setup(void)
@@ -74,5 +90,7 @@ void setup(void)
 void loop(void)
 {
   debugCPU();
+  AudioOutputI2S::setContext("FreqCount");
   debugClockFreq();
+  AudioOutputI2S::setContext(nullptr);
 }
@@ -0,0 +1,76 @@
+#include <Wire.h>
+#include <SPI.h>
+#include <SD.h>
+#include "AudioConfig.h"
+#include "input_i2s_tdm.h"
+#include "output_i2s_tdm.h"
+#include "control_AK4619VN.h"
+#include "WavReader.h"
+
+// Plays a WAV file from the SD card in a loop, e.g. a backing stem for a looper.
+// File channel 1 goes to output 1 and so on, the file should have the sample rate set in AudioConfig.h.
+WavReader<32768> reader;
+
+// Setup classes for Audio codec and I2S
+AK4619VN codec(&Wire, AK4619VN_ADDR);
+AudioOutputI2S audioOutputI2S;
+AudioInputI2S audioInputI2S;
+
+void playAudio(int32_t** inputs, int32_t** outputs)
+{
+  // no SD access here, the block comes from the read-ahead ring
+  reader.ReadBlock(outputs, AUDIO_BLOCK_SAMPLES);
+}
+
+void setup(void)
+{
+  Serial.begin(9600);
+  Serial.println("Started setup");
+
+  // Initialize the SD card
+  if (!(SD.begin(BUILTIN_SDCARD))) {
+    // stop here, but print a message repetitively
+    while (1) {
+      Serial.println("Unable to access the SD card");
+      delay(500);
+    }
+  }
+
+  if (reader.OpenFile("Stem.wav")) {
+    Serial.print("Playing ");
+    Serial.print(reader.GetChannels());
+    Serial.print(" channels, ");
+    Serial.print(reader.GetBitsPerSample());
+    Serial.print(" bit, ");
+    Serial.print(reader.GetSampleRate());
+    Serial.println(" Hz");
+    reader.SetLoop(true);
+  }
+
+  i2sAudioCallback = playAudio;
+
+  // Start the I2S interrupts
+  audioOutputI2S.begin();
+  audioInputI2S.begin();
+
+  // Start the Codec
+  codec.init();
+}
+
+unsigned long lastReport;
+
+void loop(void)
+{
+  // keep the read-ahead ring full
+  reader.Read();
+
+  if (millis() - lastReport > 1000) {
+    lastReport = millis();
+    // blocks that found the ring empty, and how close it came to that
+    WavReaderStats stats = reader.GetStats();
+    Serial.print("Underruns: ");
+    Serial.print(stats.underruns);
+    Serial.print(" -- Fewest segments left: ");
+    Serial.println(stats.lowWater);
+  }
+}
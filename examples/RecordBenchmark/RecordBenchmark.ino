@@ -0,0 +1,39 @@
+#include <SD.h>
+#include "AudioConfig.h"
+#include "record_bench.h"
+
+// Writes a test recording to the SD card twice, growing the file while recording and into a
+// file preallocated by OpenFile(), and prints the write throughput and the average and worst
+// time per Write() as CSV over Serial. The audio interrupts are not started.
+// The file bench.wav on the card is overwritten.
+
+#define MEGABYTES 64
+
+struct TeensyClock
+{
+  static uint32_t cycles() { return ARM_DWT_CYCCNT; }
+  static double nsPerCycle() { return 1e9 / F_CPU_ACTUAL; }
+};
+
+void setup(void)
+{
+  Serial.begin(9600);
+  while (!Serial) { }
+
+  if (!SD.begin(BUILTIN_SDCARD)) {
+    Serial.println("# Unable to access the SD card");
+    return;
+  }
+
+  Serial.print("# record_bench teensy ");
+  Serial.print(CHANNELS);
+  Serial.print(" channels ");
+  Serial.print(BIT_DEPTH);
+  Serial.println(" bit");
+  record_bench::run<TeensyClock>(Serial, "bench.wav", MEGABYTES);
+  Serial.println("# done");
+}
+
+void loop(void)
+{
+}
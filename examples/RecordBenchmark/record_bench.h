@@ -0,0 +1,91 @@
+/* SD write throughput of WavWriter, shared by the RecordBenchmark sketch (on the Teensy, with
+ * the card in the SD slot) and extras/host/bench/record_bench.cpp (on Linux, to a local file).
+ *
+ * Records `megabytes` of the configured CHANNELS and BIT_DEPTH through SampleBlock() and
+ * Write() as fast as the card takes it, once into a file that grows while recording and
+ * once into one preallocated by OpenFile(). Every Write() writes one segment and is timed
+ * on its own. The output is CSV, one row per mode:
+ *
+ *   mode,megabytes,mb_per_s,avg_write_ms,max_write_ms
+ *
+ * The worst write decides how many segments the ring needs, see WavWriter.h.
+ * A Clock provides `static uint32_t cycles()` and `static double nsPerCycle()`.
+ */
+#pragma once
+
+#include "Arduino.h"
+#include "AudioConfig.h"
+#include "WavWriter.h"
+
+namespace record_bench
+{
+	static WavWriter<32768> writer;
+
+	alignas(32) static int32_t planar[CHANNELS][AUDIO_BLOCK_SAMPLES];
+
+	template <typename Clock, typename Out>
+	static bool record(Out& out, const char* mode, const char* path, uint32_t megabytes, bool preallocate)
+	{
+		int32_t* channels[CHANNELS];
+		for (size_t k = 0; k < CHANNELS; k++)
+			channels[k] = planar[k];
+
+		uint64_t bytes = (uint64_t)megabytes * 1000000;
+		float seconds = (float)bytes / ((float)SAMPLERATE * writer.FrameBytes());
+
+		writer.WavInit();
+		if (!writer.OpenFile(path, preallocate ? seconds : 0))
+			return false;
+		if (preallocate && !writer.IsPreallocated())
+			return false;
+
+		double totalCycles = 0;
+		uint32_t maxCycles = 0;
+		uint32_t writes = 0;
+		for (uint64_t written = 0; written < bytes; )
+		{
+			writer.SampleBlock(channels, AUDIO_BLOCK_SAMPLES);
+			if (writer.SegmentsQueued() == 0)
+				continue;
+
+			uint32_t start = Clock::cycles();
+			writer.Write();
+			uint32_t cycles = Clock::cycles() - start;
+
+			totalCycles += cycles;
+			if (cycles > maxCycles)
+				maxCycles = cycles;
+			writes++;
+			written += writer.SegmentBytes();
+		}
+		writer.SaveFile();
+
+		double elapsed = totalCycles * Clock::nsPerCycle() * 1e-9;
+		double mb = (double)writes * writer.SegmentBytes() / 1e6;
+		out.print(mode);
+		out.print(',');
+		out.print((int)megabytes);
+		out.print(',');
+		out.print(mb / elapsed, 2);
+		out.print(',');
+		out.print(totalCycles * Clock::nsPerCycle() * 1e-6 / writes, 3);
+		out.print(',');
+		out.println(maxCycles * Clock::nsPerCycle() * 1e-6, 3);
+		return true;
+	}
+
+	// Records both modes into `path`, which is overwritten
+	template <typename Clock, typename Out>
+	static void run(Out& out, const char* path, uint32_t megabytes)
+	{
+		for (size_t k = 0; k < CHANNELS; k++)
+			for (size_t i = 0; i < AUDIO_BLOCK_SAMPLES; i++)
+				planar[k][i] = (int32_t)((k << 24) ^ (i * 40503u));
+
+		out.println("mode,megabytes,mb_per_s,avg_write_ms,max_write_ms");
+		if (!record<Clock>(out, "grow", path, megabytes, false))
+			out.println("# grow: could not open the file");
+		if (!record<Clock>(out, "preallocated", path, megabytes, true))
+			out.println("# preallocated: could not open or preallocate the file");
+	}
+}
@@ -26,15 +26,12 @@ AudioInputI2S audioInputI2S;
 
 void processAudio(int32_t** inputs, int32_t** outputs)
 {
-  for (size_t i = 0; i < AUDIO_BLOCK_SAMPLES; i++)
+  for (size_t ch = 0; ch < CHANNELS; ch++)
   {
-    outputs[0][i] = -inputs[0][i];
-    outputs[1][i] = -inputs[1][i];
-    
-    if (CHANNELS > 2) {
-      outputs[2][i] = -inputs[2][i];
-      outputs[3][i] = -inputs[3][i];
-    }   
+    for (size_t i = 0; i < AUDIO_BLOCK_SAMPLES; i++)
+    {
+      outputs[ch][i] = -inputs[ch][i];
+    }
   }
 }
 
@@ -45,11 +42,8 @@ void recordAudio(int32_t** inputs, int32_t** outputs)
   //   //Serial.println(sizeof(inputs[0]));
   //   Serial.println(inputs[0][i]);
   // }
-  //Read samples:
-  for (size_t i = 0; i < AUDIO_BLOCK_SAMPLES; i++)
-  {
-    writer.Sample((int32_t *)inputs[0][i]);
-  }
+  // Record all channels of the block
+  writer.SampleBlock(inputs, AUDIO_BLOCK_SAMPLES);
 }
 
 // Use pin9 to test Clock Frequencies on pin 20/21/23
@@ -112,6 +106,8 @@ void setup(void)
   FreqCount.begin(1000000); 
   i2sAudioCallback = recordAudio;
   writer.WavInit();
+  // header on the card once a second, a power cut loses no more than that
+  writer.SetCommitInterval(1000);
   writer.OpenFile("FileName.wav");
 }
 
@@ -132,6 +128,14 @@ void loop(void)
     } else {
       if(modeSet){
         Serial.println("Completed");
+        // frames lost to card stalls, and how many segments of the ring were in use at most
+        WavWriterStats stats = writer.GetStats();
+        Serial.print("Overruns: ");
+        Serial.print(stats.overruns);
+        Serial.print(" -- Dropped frames: ");
+        Serial.print(stats.droppedFrames);
+        Serial.print(" -- Segments used: ");
+        Serial.println(stats.highWater);
         modeSet--;
       }
       
@@ -0,0 +1,125 @@
+/* Host build of the Teensy 4 I2S TDM library
+ *
+ * Records test signals through WavWriter's lossless stage the way a sketch does:
+ * SampleBlock() for every callback block, Write() from the loop in between, which is where
+ * the segments are encoded. Every file is decoded again with bench/flac_decode.h and must
+ * match the recorded samples bit for bit, a mismatch makes the benchmark fail. Prints CSV:
+ *
+ *   signal,channels,bits,seconds,ratio,cycles_per_sample,ns_per_sample,realtime
+ *
+ * `ratio` is the FLAC file over the PCM data, `cycles_per_sample` and `ns_per_sample` are
+ * the cost of Write() (encoding and the file write) per sample of one channel, `realtime`
+ * is audio time over the time spent in Write(). The signals are 24 bit like the AK4619VN's:
+ *
+ *   silence   all zeros
+ *   tones     a sine per channel at -6 dBFS
+ *   mix       two sines and noise at -60 dBFS, closer to a recorded instrument
+ *   noise     full scale white noise, the worst case
+ *
+ *   flac_bench [seconds] [file]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "Arduino.h"
+#include "AudioConfig.h"
+#include "WavWriter.h"
+#include "flac_decode.h"
+#include "host_clock.h"
+
+static WavWriter<32768, 8, WAV_WRITER_FLAC> writer;
+
+static int32_t channel[CHANNELS][AUDIO_BLOCK_SAMPLES];
+
+enum Signal { Silence, Tones, Mix, Noise };
+
+static int32_t sample(Signal signal, uint64_t frame, unsigned k)
+{
+	uint32_t x = (uint32_t)(frame * 2654435761u) ^ (k * 40503u);
+	x ^= x >> 15;
+	x *= 2246822519u;
+	x ^= x >> 13;
+	double t = (double)frame / SAMPLERATE;
+	double v = 0;
+	switch (signal)
+	{
+		case Silence: break;
+		case Tones: v = 0.5 * sin(2 * M_PI * 440 * (k + 1) * t); break;
+		case Mix: v = 0.3 * sin(2 * M_PI * 220 * (k + 1) * t) + 0.2 * sin(2 * M_PI * 3150 * t) + 0.001 * ((int32_t)x / 2147483648.0); break;
+		case Noise: v = (int32_t)x / 2147483648.0; break;
+	}
+	return (int32_t)(v * 2147483647.0) & (int32_t)0xFFFFFF00;
+}
+
+static bool record(const char* path, const char* name, Signal signal, float seconds)
+{
+	uint64_t frames = (uint64_t)(seconds * SAMPLERATE) / AUDIO_BLOCK_SAMPLES * AUDIO_BLOCK_SAMPLES;
+
+	int32_t* inputs[CHANNELS];
+	for (size_t k = 0; k < CHANNELS; k++)
+		inputs[k] = channel[k];
+
+	writer.WavInit();
+	if (!writer.OpenFile(path))
+	{
+		fprintf(stderr, "cannot write %s\n", path);
+		return false;
+	}
+
+	uint64_t cycles = 0, ns = 0;
+	for (uint64_t frame = 0; frame < frames; frame += AUDIO_BLOCK_SAMPLES)
+	{
+		for (size_t k = 0; k < CHANNELS; k++)
+			for (size_t i = 0; i < AUDIO_BLOCK_SAMPLES; i++)
+				channel[k][i] = sample(signal, frame + i, k) >> (32 - AudioOutputI2S::getBitDepth()); // as the SAI delivers it
+		writer.SampleBlock(inputs, AUDIO_BLOCK_SAMPLES);
+
+		uint64_t t0 = sim::hostNs();
+		uint32_t c0 = HostClock::cycles();
+		writer.Write();
+		cycles += HostClock::cycles() - c0;
+		ns += sim::hostNs() - t0;
+	}
+	uint64_t bytes = writer.DataBytes();
+	writer.SaveFile();
+
+	FlacStream stream;
+	bool decoded = flacDecodeFile(path, stream);
+	remove(path);
+	uint64_t mismatches = 0;
+	const uint32_t mask = BIT_DEPTH == 32 ? 0xFFFFFFFF : ~(0xFFFFFFFFu >> BIT_DEPTH);
+	for (uint64_t i = 0; decoded && i < stream.frames && i < frames; i++)
+		for (unsigned k = 0; k < CHANNELS; k++)
+			if ((uint32_t)stream.samples[i * CHANNELS + k] != ((uint32_t)sample(signal, i, k) & mask))
+				mismatches++;
+
+	double samples = (double)frames * CHANNELS;
+	double audio = (double)frames / SAMPLERATE;
+	printf("%s,%d,%d,%.1f,%.3f,%.1f,%.2f,%.1f\n", name, CHANNELS, BIT_DEPTH, audio,
+		(double)bytes / (samples * BIT_DEPTH / 8), cycles / samples, ns / samples, audio / (ns * 1e-9));
+
+	WavWriterStats stats = writer.GetStats();
+	if (!decoded || mismatches || stream.frames != frames || stats.overruns)
+	{
+		fprintf(stderr, "%s: %s, %llu mismatches, %llu of %llu frames, %u overruns\n", name,
+			decoded ? "decoded" : stream.error.c_str(), (unsigned long long)mismatches,
+			(unsigned long long)stream.frames, (unsigned long long)frames, (unsigned)stats.overruns);
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	float seconds = argc > 1 ? atof(argv[1]) : 5;
+	const char* path = argc > 2 ? argv[2] : "flac_bench.flac";
+
+	HostClock::calibrate();
+	printf("# flac_bench host %.0f MHz\n", 1e3 / HostClock::nsPerCycle());
+	printf("signal,channels,bits,seconds,ratio,cycles_per_sample,ns_per_sample,realtime\n");
+	bool ok = record(path, "silence", Silence, seconds);
+	ok = record(path, "tones", Tones, seconds) && ok;
+	ok = record(path, "mix", Mix, seconds) && ok;
+	ok = record(path, "noise", Noise, seconds) && ok;
+	return ok ? 0 : 1;
+}
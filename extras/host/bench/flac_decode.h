@@ -0,0 +1,432 @@
+/* Host build of the Teensy 4 I2S TDM library
+ *
+ * A small FLAC decoder for checking WavWriter's lossless recordings bit for bit. It reads
+ * what utility/flac_encoder.h writes and what the format allows around it: STREAMINFO and
+ * any other metadata blocks, fixed block size frames with CONSTANT, VERBATIM, FIXED and LPC
+ * subframes, wasted bits, stereo decorrelation and both Rice codings including escaped
+ * partitions. Both CRCs of every frame are checked. Written from RFC 9639, shares no code
+ * with the encoder.
+ *
+ * The samples come out interleaved and left-justified like the audio callback's, the
+ * stream's sample size in the top bits of each int32_t.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+struct FlacStream
+{
+	uint32_t sampleRate = 0;
+	unsigned channels = 0;
+	unsigned bits = 0;
+	uint64_t frames = 0;            // from STREAMINFO
+	std::vector<int32_t> samples;   // interleaved, left-justified
+	std::string error;              // set when decoding failed
+};
+
+namespace flac_decode
+{
+	struct BitReader
+	{
+		const uint8_t* data;
+		size_t size;
+		size_t pos = 0; // in bits
+
+		BitReader(const uint8_t* d, size_t n) : data(d), size(n) {}
+
+		bool ok(size_t bits) const { return pos + bits <= size * 8; }
+
+		uint32_t bit()
+		{
+			uint32_t b = (data[pos >> 3] >> (7 - (pos & 7))) & 1;
+			pos++;
+			return b;
+		}
+
+		uint64_t read(unsigned n)
+		{
+			uint64_t v = 0;
+			while (n--)
+				v = (v << 1) | bit();
+			return v;
+		}
+
+		int64_t readSigned(unsigned n)
+		{
+			if (n == 0)
+				return 0;
+			uint64_t v = read(n);
+			return (int64_t)(v << (64 - n)) >> (64 - n);
+		}
+
+		bool unary(uint32_t& q)
+		{
+			q = 0;
+			while (ok(1) && !bit())
+				q++;
+			return ok(0);
+		}
+
+		void align() { pos = (pos + 7) & ~(size_t)7; }
+	};
+
+	static uint8_t crc8(const uint8_t* p, size_t n)
+	{
+		unsigned crc = 0;
+		for (size_t i = 0; i < n; i++)
+		{
+			crc ^= p[i];
+			for (int b = 0; b < 8; b++)
+				crc = (crc & 0x80) ? ((crc << 1) ^ 0x07) & 0xFF : (crc << 1) & 0xFF;
+		}
+		return (uint8_t)crc;
+	}
+
+	static uint16_t crc16(const uint8_t* p, size_t n)
+	{
+		unsigned crc = 0;
+		for (size_t i = 0; i < n; i++)
+		{
+			crc ^= (unsigned)p[i] << 8;
+			for (int b = 0; b < 8; b++)
+				crc = (crc & 0x8000) ? ((crc << 1) ^ 0x8005) & 0xFFFF : (crc << 1) & 0xFFFF;
+		}
+		return (uint16_t)crc;
+	}
+
+	static bool residual(BitReader& br, unsigned order, unsigned blockSize, int64_t* out, std::string& error)
+	{
+		unsigned method = br.read(2);
+		if (method > 1)
+		{
+			error = "reserved residual coding";
+			return false;
+		}
+		unsigned paramBits = method ? 5 : 4;
+		unsigned partitionOrder = br.read(4);
+		unsigned parts = 1u << partitionOrder;
+		if ((blockSize % parts) != 0 || (blockSize >> partitionOrder) < order)
+		{
+			error = "bad partition order";
+			return false;
+		}
+		unsigned i = order;
+		for (unsigned j = 0; j < parts; j++)
+		{
+			unsigned end = (j + 1) * (blockSize >> partitionOrder);
+			unsigned k = br.read(paramBits);
+			if (k == (1u << paramBits) - 1)
+			{
+				unsigned n = br.read(5);
+				for (; i < end; i++)
+					out[i] = br.readSigned(n);
+				continue;
+			}
+			for (; i < end; i++)
+			{
+				uint32_t q;
+				if (!br.unary(q))
+				{
+					error = "truncated residual";
+					return false;
+				}
+				uint64_t u = ((uint64_t)q << k) | br.read(k);
+				out[i] = (int64_t)(u >> 1) ^ -(int64_t)(u & 1);
+			}
+		}
+		return true;
+	}
+
+	static bool subframe(BitReader& br, unsigned bps, unsigned blockSize, int64_t* out, std::string& error)
+	{
+		if (br.bit())
+		{
+			error = "subframe padding bit set";
+			return false;
+		}
+		unsigned type = br.read(6);
+		unsigned wasted = 0;
+		if (br.bit())
+		{
+			uint32_t q;
+			br.unary(q);
+			wasted = q + 1;
+		}
+		if (wasted >= bps)
+		{
+			error = "too many wasted bits";
+			return false;
+		}
+		bps -= wasted;
+
+		if (type == 0)
+		{
+			int64_t v = br.readSigned(bps);
+			for (unsigned i = 0; i < blockSize; i++)
+				out[i] = v;
+		}
+		else if (type == 1)
+		{
+			for (unsigned i = 0; i < blockSize; i++)
+				out[i] = br.readSigned(bps);
+		}
+		else if (type >= 8 && type <= 12)
+		{
+			static const int coeffs[5][4] = {{0, 0, 0, 0}, {1, 0, 0, 0}, {2, -1, 0, 0}, {3, -3, 1, 0}, {4, -6, 4, -1}};
+			unsigned order = type - 8;
+			if (order > blockSize)
+			{
+				error = "predictor order over block size";
+				return false;
+			}
+			for (unsigned i = 0; i < order; i++)
+				out[i] = br.readSigned(bps);
+			if (!residual(br, order, blockSize, out, error))
+				return false;
+			for (unsigned i = order; i < blockSize; i++)
+			{
+				int64_t p = 0;
+				for (unsigned c = 0; c < order; c++)
+					p += coeffs[order][c] * out[i - 1 - c];
+				out[i] += p;
+			}
+		}
+		else if (type >= 32)
+		{
+			unsigned order = type - 31;
+			if (order > blockSize)
+			{
+				error = "predictor order over block size";
+				return false;
+			}
+			for (unsigned i = 0; i < order; i++)
+				out[i] = br.readSigned(bps);
+			unsigned precision = br.read(4) + 1;
+			int shift = (int)br.readSigned(5);
+			if (precision == 16 || shift < 0)
+			{
+				error = "bad LPC precision or shift";
+				return false;
+			}
+			int64_t coeff[32];
+			for (unsigned c = 0; c < order; c++)
+				coeff[c] = br.readSigned(precision);
+			if (!residual(br, order, blockSize, out, error))
+				return false;
+			for (unsigned i = order; i < blockSize; i++)
+			{
+				int64_t p = 0;
+				for (unsigned c = 0; c < order; c++)
+					p += coeff[c] * out[i - 1 - c];
+				out[i] += p >> shift;
+			}
+		}
+		else
+		{
+			error = "reserved subframe type";
+			return false;
+		}
+
+		for (unsigned i = 0; i < blockSize; i++)
+			out[i] = (int64_t)((uint64_t)out[i] << wasted);
+		return true;
+	}
+
+	static bool frame(const uint8_t* data, size_t size, size_t& pos, FlacStream& s, std::vector<int64_t>& work)
+	{
+		const uint8_t* f = data + pos;
+		BitReader br(f, size - pos);
+		if (!br.ok(32) || br.read(15) != 0x7FFC)
+		{
+			s.error = "lost frame sync";
+			return false;
+		}
+		if (br.bit())
+		{
+			s.error = "variable block size, not written by WavWriter";
+			return false;
+		}
+		unsigned blockCode = br.read(4);
+		unsigned rateCode = br.read(4);
+		unsigned assignment = br.read(4);
+		unsigned sizeCode = br.read(3);
+		br.read(1);
+
+		// frame number, UTF-8 style
+		uint32_t first = br.read(8);
+		int extra = 0;
+		while (extra < 7 && (first & (0x80 >> extra)))
+			extra++;
+		if (extra == 1 || extra > 6)
+		{
+			s.error = "bad frame number";
+			return false;
+		}
+		for (int i = 1; i < extra; i++)
+			br.read(8);
+
+		unsigned blockSize;
+		if (blockCode == 1)
+			blockSize = 192;
+		else if (blockCode >= 2 && blockCode <= 5)
+			blockSize = 576u << (blockCode - 2);
+		else if (blockCode == 6)
+			blockSize = br.read(8) + 1;
+		else if (blockCode == 7)
+			blockSize = br.read(16) + 1;
+		else if (blockCode >= 8)
+			blockSize = 256u << (blockCode - 8);
+		else
+		{
+			s.error = "reserved block size";
+			return false;
+		}
+		if (rateCode == 12)
+			br.read(8);
+		else if (rateCode == 13 || rateCode == 14)
+			br.read(16);
+		else if (rateCode == 15)
+		{
+			s.error = "bad sample rate code";
+			return false;
+		}
+
+		static const unsigned sizes[8] = {0, 8, 12, 0, 16, 20, 24, 32};
+		unsigned bps = sizeCode ? sizes[sizeCode] : s.bits;
+		if (bps != s.bits)
+		{
+			s.error = "sample size differs from STREAMINFO";
+			return false;
+		}
+		size_t headerBytes = br.pos / 8;
+		if (crc8(f, headerBytes) != f[headerBytes])
+		{
+			s.error = "frame header CRC";
+			return false;
+		}
+		br.read(8);
+
+		unsigned channels = assignment < 8 ? assignment + 1 : 2;
+		if (assignment > 10 || channels != s.channels)
+		{
+			s.error = "bad channel assignment";
+			return false;
+		}
+		work.assign((size_t)channels * blockSize, 0);
+		for (unsigned k = 0; k < channels; k++)
+		{
+			// the side channel has one bit more
+			unsigned extraBit = (assignment == 8 && k == 1) || (assignment == 9 && k == 0) || (assignment == 10 && k == 1);
+			if (!subframe(br, bps + extraBit, blockSize, &work[k * blockSize], s.error))
+				return false;
+			if (!br.ok(0))
+			{
+				s.error = "truncated frame";
+				return false;
+			}
+		}
+		br.align();
+		size_t end = br.pos / 8;
+		if (!br.ok(16) || crc16(f, end) != ((f[end] << 8) | f[end + 1]))
+		{
+			s.error = "frame CRC";
+			return false;
+		}
+		pos += end + 2;
+
+		int64_t* a = &work[0];
+		int64_t* b = &work[blockSize];
+		for (unsigned i = 0; i < blockSize; i++)
+		{
+			if (assignment == 8) // left, side
+				b[i] = a[i] - b[i];
+			else if (assignment == 9) // side, right
+				a[i] = a[i] + b[i];
+			else if (assignment == 10) // mid, side
+			{
+				int64_t mid = (a[i] << 1) | (b[i] & 1);
+				a[i] = (mid + b[i]) >> 1;
+				b[i] = (mid - b[i]) >> 1;
+			}
+		}
+		for (unsigned i = 0; i < blockSize; i++)
+			for (unsigned k = 0; k < channels; k++)
+				s.samples.push_back((int32_t)((uint32_t)work[k * blockSize + i] << (32 - bps)));
+		return true;
+	}
+}
+
+// Decodes a whole FLAC file, false with s.error set on the first problem
+static bool flacDecodeFile(const char* path, FlacStream& s)
+{
+	FILE* fp = fopen(path, "rb");
+	if (!fp)
+	{
+		s.error = "cannot open file";
+		return false;
+	}
+	std::vector<uint8_t> data;
+	uint8_t buf[65536];
+	size_t n;
+	while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+		data.insert(data.end(), buf, buf + n);
+	fclose(fp);
+
+	if (data.size() < 42 || memcmp(&data[0], "fLaC", 4) != 0)
+	{
+		s.error = "not a FLAC file";
+		return false;
+	}
+	size_t pos = 4;
+	bool last = false, haveInfo = false;
+	while (!last)
+	{
+		if (pos + 4 > data.size())
+		{
+			s.error = "truncated metadata";
+			return false;
+		}
+		last = data[pos] & 0x80;
+		unsigned type = data[pos] & 0x7F;
+		size_t len = (data[pos + 1] << 16) | (data[pos + 2] << 8) | data[pos + 3];
+		pos += 4;
+		if (pos + len > data.size())
+		{
+			s.error = "truncated metadata";
+			return false;
+		}
+		if (type == 0 && len == 34)
+		{
+			flac_decode::BitReader br(&data[pos], len);
+			br.read(16 + 16 + 24 + 24);
+			s.sampleRate = br.read(20);
+			s.channels = br.read(3) + 1;
+			s.bits = br.read(5) + 1;
+			s.frames = br.read(36);
+			haveInfo = true;
+		}
+		pos += len;
+	}
+	if (!haveInfo)
+	{
+		s.error = "no STREAMINFO";
+		return false;
+	}
+
+	std::vector<int64_t> work;
+	while (pos < data.size())
+	{
+		if (!flac_decode::frame(&data[0], data.size(), pos, s, work))
+			return false;
+	}
+	if (s.samples.size() != s.frames * s.channels)
+	{
+		s.error = "frame count differs from STREAMINFO";
+		return false;
+	}
+	return true;
+}
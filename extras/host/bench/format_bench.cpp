@@ -0,0 +1,106 @@
+/* Host build of the Teensy 4 I2S TDM library
+ *
+ * Switches through every entry of audioClockTable with AudioOutputI2S::setFormat while
+ * the loopback runs. For each format it checks the frame rate the simulator decodes from
+ * the PLL4 and SAI registers against the target (within audio_clock::kMaxErrorPpm), that
+ * the data still loops back without errors at the new word width, and reports how long the
+ * switch took.
+ *
+ *   format_bench [seconds per format]
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "Arduino.h"
+#include "AudioConfig.h"
+#include "input_i2s_tdm.h"
+#include "output_i2s_tdm.h"
+#include "sim.h"
+
+AudioOutputI2S audioOutputI2S;
+AudioInputI2S audioInputI2S;
+
+static int64_t latency;
+static uint64_t checked, mismatches;
+
+// Bits of the pattern: the top of the word, up to 24 so float processing carries it exactly
+static unsigned patternBits()
+{
+	return AudioOutputI2S::getBitDepth() < 24 ? AudioOutputI2S::getBitDepth() : 24;
+}
+
+static int32_t pattern(uint64_t frame, unsigned slot)
+{
+	// a word of the current word width, right-aligned and sign-extended like the
+	// simulator transmits it; never zero until it wraps, so the silence the queues
+	// restart with is not mistaken for data
+	unsigned bits = patternBits();
+	uint32_t v = (uint32_t)(((frame + 1) << 4) | slot) << (32 - bits);
+	return (int32_t)v >> (32 - AudioOutputI2S::getBitDepth());
+}
+
+static void verify(uint64_t frame, unsigned slot, int32_t value)
+{
+	if (latency < 0)
+	{
+		if (value == 0)
+			return;
+		// the frame count wraps at the pattern width, the latency is far below that
+		unsigned bits = patternBits();
+		uint32_t count = ((uint32_t)value << (32 - AudioOutputI2S::getBitDepth())) >> (32 - bits + 4);
+		latency = (int64_t)((frame + 1 - count) & ((1u << (bits - 4)) - 1));
+	}
+
+	checked++;
+	if (value != pattern(frame - latency, slot))
+		mismatches++;
+}
+
+int main(int argc, char** argv)
+{
+	double seconds = argc > 1 ? atof(argv[1]) : 0.2;
+	int failures = 0;
+
+	sim::setInput(pattern);
+	sim::setOutput(verify);
+
+	audioOutputI2S.begin();
+	audioInputI2S.begin();
+	sim::runSeconds(0.01);
+
+	printf("channels %d\n", CHANNELS);
+	for (size_t i = 0; i < audioClockTableSize; i++)
+	{
+		const AudioClockConfig& c = audioClockTable[i];
+
+		uint64_t start = sim::hostNs();
+		bool ok = AudioOutputI2S::setFormat(c.sampleRate, c.bitDepth);
+		uint64_t switchNs = sim::hostNs() - start;
+
+		latency = -1;
+		checked = 0;
+		mismatches = 0;
+		sim::runSeconds(seconds);
+
+		double rate = sim::sampleRate();
+		double errorPpm = (rate - c.sampleRate) / c.sampleRate * 1e6;
+		ok = ok && fabs(errorPpm) <= audio_clock::kMaxErrorPpm
+			&& AudioOutputI2S::getSampleRate() == c.sampleRate && AudioOutputI2S::getBitDepth() == c.bitDepth
+			&& checked > 0 && mismatches == 0;
+		if (!ok)
+			failures++;
+
+		printf("%6u Hz %2u bit  pll %2u + %8u / %8u  mclk %4u fs /%u/%-2u  bclk /%u  rate %12.4f Hz (%+.3f ppm)  switch %6.1f us  latency %lld  %s\n",
+			(unsigned)c.sampleRate, c.bitDepth, c.nfact, (unsigned)c.nmult, (unsigned)c.ndiv,
+			c.mclkRatio, c.n1, c.n2, (c.bclkDiv + 1) * 2, rate, errorPpm, switchNs * 1e-3,
+			(long long)latency, ok ? "ok" : "FAIL");
+	}
+
+	if (AudioOutputI2S::setFormat(22050, 16))
+	{
+		printf("22050 Hz was accepted\n");
+		failures++;
+	}
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,206 @@
+/* Host build of the Teensy 4 I2S TDM library
+ *
+ * Runs the input and output ISRs against the simulated SAI with a loopback through the
+ * default passthrough callback. Reports the ISR cost, the Timers CPU load and how much
+ * faster than real time the simulation ran. Every transmitted word is checked against
+ * the word received `latency` frames earlier, a mismatch makes the benchmark fail.
+ * The interrupt line sums all ISR time per second of audio, to compare the overhead of
+ * the modes in AudioConfig.h (e.g. AUDIO_HALF_BLOCK_CALLBACK) on the same callback.
+ *
+ * Transmit interrupts that finish past their deadline are counted and the first few
+ * printed; a CPU scale above 1 stretches the interrupt time to provoke them. With
+ * AUDIO_DEFERRED_PROCESSING the callback is then held off for longer than the output
+ * queue lasts, and the block it comes too late for must be logged as a deadline miss
+ * with the context set at the time.
+ *
+ * With -r it prints a single table row instead, see `make blocks`.
+ *
+ *   isr_bench [-r] [seconds] [queue depth] [cpu scale]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Arduino.h"
+#include "AudioConfig.h"
+#include "input_i2s_tdm.h"
+#include "output_i2s_tdm.h"
+#include "i2s_timers.h"
+#include "profile_zone.h"
+#include "sim.h"
+
+AudioOutputI2S audioOutputI2S;
+AudioInputI2S audioInputI2S;
+
+static int64_t latency = -1;
+static uint64_t checked, mismatches;
+
+// Bits of the pattern: the top of the word, up to 24 so float processing carries it exactly
+static unsigned patternBits()
+{
+	return AudioOutputI2S::getBitDepth() < 24 ? AudioOutputI2S::getBitDepth() : 24;
+}
+
+static int32_t pattern(uint64_t frame, unsigned slot)
+{
+	// a word of the configured width, right-aligned and sign-extended like the simulator
+	// transmits it; never zero until it wraps, so the silence the queues start with is
+	// not mistaken for data
+	unsigned bits = patternBits();
+	uint32_t v = (uint32_t)(((frame + 1) << 4) | slot) << (32 - bits);
+	return (int32_t)v >> (32 - AudioOutputI2S::getBitDepth());
+}
+
+static void verify(uint64_t frame, unsigned slot, int32_t value)
+{
+	if (latency < 0)
+	{
+		if (value == 0)
+			return;
+		// the frame count wraps at the pattern width, the latency is far below that
+		unsigned bits = patternBits();
+		uint32_t count = ((uint32_t)value << (32 - AudioOutputI2S::getBitDepth())) >> (32 - bits + 4);
+		latency = (int64_t)((frame + 1 - count) & ((1u << (bits - 4)) - 1));
+	}
+
+	checked++;
+	if (value != pattern(frame - latency, slot))
+		mismatches++;
+}
+
+#if !AUDIO_ZERO_COPY
+static void printQueue(const char* name, const BufferQueueStats& stats)
+{
+	printf("%-10s overruns %llu  underruns %llu  available %d..%d blocks\n", name,
+		(unsigned long long)stats.overruns, (unsigned long long)stats.underruns,
+		stats.minAvailable, stats.maxAvailable);
+}
+#endif
+
+static void printIsr(const char* name, const sim::IsrStats& stats)
+{
+	printf("%-10s calls %10llu  avg %8.1f ns  max %8llu ns\n", name,
+		(unsigned long long)stats.calls,
+		stats.calls ? (double)stats.totalNs / stats.calls : 0.0,
+		(unsigned long long)stats.maxNs);
+}
+
+int main(int argc, char** argv)
+{
+	bool row = argc > 1 && strcmp(argv[1], "-r") == 0;
+	if (row)
+	{
+		argc--;
+		argv++;
+	}
+	double seconds = argc > 1 ? atof(argv[1]) : 10.0;
+
+	if (argc > 3)
+		sim::setCpuScale(atof(argv[3]));
+
+	sim::setInput(pattern);
+	sim::setOutput(verify);
+
+	audioOutputI2S.begin();
+	audioInputI2S.begin();
+#if !AUDIO_ZERO_COPY
+	if (argc > 2)
+	{
+		AudioOutputI2S::setQueueDepth(atoi(argv[2]));
+		AudioInputI2S::setQueueDepth(atoi(argv[2]));
+	}
+#endif
+
+	// settle the queues, then measure
+	sim::runSeconds(0.1);
+	sim::clearStats();
+	Timers::Clear(Timers::TIMER_TOTAL);
+	ProfileZone::ClearAll();
+	AudioOutputI2S::clearDeadlineStats();
+	AudioOutputI2S::setContext("isr_bench");
+#if !AUDIO_ZERO_COPY
+	AudioOutputI2S::clearQueueStats();
+	AudioInputI2S::clearQueueStats();
+#endif
+	mismatches = 0;
+	checked = 0;
+
+	uint64_t start = sim::hostNs();
+	sim::runSeconds(seconds);
+	double hostSeconds = (sim::hostNs() - start) * 1e-9;
+
+	const sim::IsrStats* isrs[] = { &sim::rxIsr(), &sim::txIsr(), &sim::softwareIsr() };
+	uint64_t isrCalls = 0, isrNs = 0;
+	for (const sim::IsrStats* stats : isrs)
+	{
+		isrCalls += stats->calls;
+		isrNs += stats->totalNs;
+	}
+	double blocksPerSecond = sim::sampleRate() / AUDIO_BLOCK_SAMPLES;
+	bool ok = mismatches == 0 && checked > 0;
+
+	if (row)
+	{
+		// block, interrupts/s, interrupt time per block (ns), per second of audio (us), latency, result
+		printf("| %5d | %6.0f | %9.1f | %8.1f | %7lld | %s |\n", AUDIO_BLOCK_SAMPLES, isrCalls / seconds,
+			isrNs / (seconds * blocksPerSecond), isrNs * 1e-3 / seconds, (long long)latency, ok ? "ok" : "FAIL");
+		return ok ? 0 : 1;
+	}
+
+	printf("channels %d, block %d samples, %.0f Hz\n", CHANNELS, AUDIO_BLOCK_SAMPLES, sim::sampleRate());
+	printf("simulated %.2f s in %.3f s host time (%.1fx real time)\n", seconds, hostSeconds, seconds / hostSeconds);
+	printIsr("input", sim::rxIsr());
+	printIsr("output", sim::txIsr());
+	printIsr("software", sim::softwareIsr());
+#if !AUDIO_ZERO_COPY
+	printQueue("in queue", AudioInputI2S::getQueueStats());
+	printQueue("out queue", AudioOutputI2S::getQueueStats());
+#endif
+	printf("interrupts %.0f per second, %.1f us per second of audio\n", isrCalls / seconds, isrNs * 1e-3 / seconds);
+	printf("timers     total avg %u cycles (%.3f us), max %u cycles, period %u cycles\n",
+		(unsigned)Timers::GetAvgCycles(Timers::TIMER_TOTAL), Timers::GetAvg(Timers::TIMER_TOTAL),
+		(unsigned)Timers::GetMaxCycles(Timers::TIMER_TOTAL), (unsigned)Timers::GetAvgPeriodCycles());
+#if AUDIO_TIMER_HISTOGRAM
+	printf("           p50 %u  p99 %u  p99.9 %u  cycles over %u blocks\n",
+		(unsigned)Timers::GetPercentileCycles(Timers::TIMER_TOTAL, 50),
+		(unsigned)Timers::GetPercentileCycles(Timers::TIMER_TOTAL, 99),
+		(unsigned)Timers::GetPercentileCycles(Timers::TIMER_TOTAL, 99.9f),
+		(unsigned)Timers::GetCount(Timers::TIMER_TOTAL));
+#endif
+	printf("cpu load   %.4f %%\n", Timers::GetCpuLoad() * 100);
+	for (ProfileZone* zone = ProfileZone::First(); zone; zone = zone->Next())
+		printf("zone       %s: incl %u cycles (max %u), excl %u cycles (max %u), %u calls\n", zone->name,
+			(unsigned)zone->GetInclusiveCycles(), (unsigned)zone->InclusiveMax,
+			(unsigned)zone->GetExclusiveCycles(), (unsigned)zone->ExclusiveMax, (unsigned)zone->Calls);
+
+	DeadlineStats deadline = AudioOutputI2S::getDeadlineStats();
+	printf("deadline   %u misses, worst %u cycles late (budget %u cycles)\n", (unsigned)deadline.misses,
+		(unsigned)deadline.maxOvershoot, (unsigned)((uint64_t)F_CPU_ACTUAL * AUDIO_DMA_HALF_FRAMES / sim::sampleRate()));
+	DeadlineEvent event;
+	for (int i = 0; i < 4 && AudioOutputI2S::readDeadlineEvent(event); i++)
+		printf("           at %u us: %u cycles late after %u cycles, during %s\n", (unsigned)event.time,
+			(unsigned)event.overshoot, (unsigned)event.cycles, event.context ? event.context : "-");
+	printf("latency    %lld frames\n", (long long)latency);
+	printf("checked    %llu words, %llu mismatches\n", (unsigned long long)checked, (unsigned long long)mismatches);
+
+	printf("per block  %.1f ns interrupt time\n", isrNs / (seconds * blocksPerSecond));
+
+#if AUDIO_DEFERRED_PROCESSING
+	// hold off the callback the way loop() can with AudioNoInterrupts() until the output
+	// queue runs dry; the repeated blocks are not checked
+	sim::setOutput(nullptr);
+	AudioOutputI2S::clearDeadlineStats();
+	while (AudioOutputI2S::readDeadlineEvent(event)) { }
+	AudioOutputI2S::setContext("isr_bench stall");
+	AudioNoInterrupts();
+	sim::runSeconds((BUFFER_QUEUE_MAX_SIZE + 2.0) * AUDIO_BLOCK_SAMPLES / sim::sampleRate());
+	AudioInterrupts();
+	sim::runSeconds(0.01);
+	AudioOutputI2S::setContext(nullptr);
+	bool logged = AudioOutputI2S::readDeadlineEvent(event) && event.context && strcmp(event.context, "isr_bench stall") == 0;
+	printf("stall      %u underruns, %s", (unsigned)AudioOutputI2S::getQueueStats().underruns, logged ? "" : "no deadline miss logged\n");
+	if (logged)
+		printf("%u cycles late after %u cycles, during %s\n", (unsigned)event.overshoot, (unsigned)event.cycles, event.context);
+	ok = ok && logged;
+#endif
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,23 @@
+/* Host build of the Teensy 4 I2S TDM library
+ *
+ * Runs the kernel benchmarks of examples/Benchmark/kernel_bench.h on the host: the same
+ * code the Benchmark sketch runs on the Teensy, timed with the TSC (x86) or the monotonic
+ * clock, calibrated to nanoseconds. Prints CSV; `make kernels` saves it and compares it
+ * with a baseline.
+ *
+ *   kernel_bench [scale]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "examples/Benchmark/kernel_bench.h"
+#include "host_clock.h"
+
+int main(int argc, char** argv)
+{
+	float scale = argc > 1 ? atof(argv[1]) : 1.0f;
+
+	HostClock::calibrate();
+	printf("# kernel_bench host %.0f MHz\n", 1e3 / HostClock::nsPerCycle());
+	kernel_bench::run<HostClock>(Serial, scale);
+	return 0;
+}
@@ -0,0 +1,163 @@
+/* Host build of the Teensy 4 I2S TDM library
+ *
+ * Plays WAV files through WavReader the way a sketch does: ReadBlock() for every callback
+ * block, Read() from the loop in between, with no pause between blocks, so it shows how
+ * much faster than real time a file of CHANNELS channels at SAMPLERATE streams. One file
+ * per format (16, 24 and 32 bit PCM, 32 bit float) is written first and played at every
+ * SAI word width (16, 24 and 32 bit, switched with AudioOutputI2S::setFormat); every
+ * sample played is checked against the file, right-aligned at the word width, and a
+ * mismatch makes the benchmark fail. Prints CSV:
+ *
+ *   format,word_bits,channels,samplerate,seconds,realtime,mb_per_s,callback_ns_per_block,read_ns_per_block
+ *
+ * `realtime` is audio time over the time spent in both calls.
+ *
+ *   playback_bench [seconds] [file]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "Arduino.h"
+#include "AudioConfig.h"
+#include "WavReader.h"
+#include "output_i2s_tdm.h"
+#include "sim.h"
+
+static WavReader<32768> reader;
+
+static int32_t channel[CHANNELS][AUDIO_BLOCK_SAMPLES];
+
+// Test signal, left-justified with `bits` significant bits; 24 bits fit a float exactly
+static int32_t pattern(uint32_t frame, unsigned k, unsigned bits)
+{
+	uint32_t x = (frame * 2654435761u) ^ (k * 40503u) ^ (frame >> 7);
+	return (int32_t)(x & ~(0xFFFFFFFFu >> bits));
+}
+
+static bool writeFile(const char* path, unsigned bits, bool isFloat, uint32_t frames)
+{
+	unsigned bytes = isFloat ? 4 : bits / 8;
+	unsigned valid = isFloat ? 24 : bits;
+
+	WAV_FormatTypeDef h = {};
+	h.ChunkId = kWavFileChunkId;
+	h.FileFormat = kWavFileWaveId;
+	h.SubChunk1ID = kWavFileSubChunk1Id;
+	h.SubChunk1Size = 40;
+	h.AudioFormat = WAVE_FORMAT_EXTENSIBLE;
+	h.NbrChannels = CHANNELS;
+	h.SampleRate = SAMPLERATE;
+	h.ByteRate = SAMPLERATE * CHANNELS * bytes;
+	h.BlockAlign = CHANNELS * bytes;
+	h.BitPerSample = bytes * 8;
+	h.ExtensionSize = 22;
+	h.ValidBitsPerSample = bytes * 8;
+	memcpy(h.SubFormat, kWavSubFormatGuid, sizeof(h.SubFormat));
+	h.SubFormat[0] = isFloat ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM;
+	h.SubChunk2ID = kWavFileSubChunk2Id;
+	h.SubCHunk2Size = frames * CHANNELS * bytes;
+	h.FileSize = sizeof(h) - 8 + h.SubCHunk2Size;
+
+	FILE* f = fopen(path, "wb");
+	if (!f)
+		return false;
+	fwrite(&h, sizeof(h), 1, f);
+	for (uint32_t i = 0; i < frames; i++)
+	{
+		for (unsigned k = 0; k < CHANNELS; k++)
+		{
+			int32_t x = pattern(i, k, valid);
+			if (isFloat)
+			{
+				float v = q31_to_float(x);
+				fwrite(&v, 4, 1, f);
+			}
+			else
+			{
+				// the top bytes, little endian
+				uint32_t u = (uint32_t)x >> (32 - bits);
+				fwrite(&u, bytes, 1, f);
+			}
+		}
+	}
+	return fclose(f) == 0;
+}
+
+static bool play(const char* path, const char* format, unsigned bits, bool isFloat, float seconds)
+{
+	uint32_t frames = (uint32_t)(seconds * SAMPLERATE) / AUDIO_BLOCK_SAMPLES * AUDIO_BLOCK_SAMPLES;
+	if (!writeFile(path, bits, isFloat, frames))
+	{
+		fprintf(stderr, "cannot write %s\n", path);
+		return false;
+	}
+
+	int32_t* outputs[CHANNELS];
+	for (size_t k = 0; k < CHANNELS; k++)
+		outputs[k] = channel[k];
+
+	// the callback gets words of the current width, the top bits of the file's samples
+	unsigned shift = 32 - AudioOutputI2S::getBitDepth();
+	uint64_t callbackNs = 0, readNs = 0, blocks = 0, played = 0, mismatches = 0;
+	uint64_t start = sim::hostNs();
+	reader.OpenFile(path);
+	readNs += sim::hostNs() - start;
+
+	for (uint32_t frame = 0; !reader.IsFinished(); frame += AUDIO_BLOCK_SAMPLES)
+	{
+		uint64_t t0 = sim::hostNs();
+		size_t got = reader.ReadBlock(outputs, AUDIO_BLOCK_SAMPLES);
+		uint64_t t1 = sim::hostNs();
+		reader.Read();
+		uint64_t t2 = sim::hostNs();
+		callbackNs += t1 - t0;
+		readNs += t2 - t1;
+		blocks++;
+		played += got;
+
+		for (size_t i = 0; i < got; i++)
+			for (unsigned k = 0; k < CHANNELS; k++)
+				if (channel[k][i] != pattern(frame + i, k, isFloat ? 24 : bits) >> shift)
+					mismatches++;
+	}
+	reader.CloseFile();
+	remove(path);
+
+	WavReaderStats stats = reader.GetStats();
+	double audio = (double)frames / SAMPLERATE;
+	double spent = (callbackNs + readNs) * 1e-9;
+	printf("%s,%d,%d,%d,%.1f,%.1f,%.1f,%.0f,%.0f\n", format, 32 - shift, CHANNELS, SAMPLERATE, audio, audio / spent,
+		(double)frames * reader.GetChannels() * (isFloat ? 4 : bits / 8) / 1e6 / spent,
+		(double)callbackNs / blocks, (double)readNs / blocks);
+
+	if (mismatches || stats.underruns || played != frames)
+	{
+		fprintf(stderr, "%s at %u bit words: %llu mismatches, %u underruns, %llu of %u frames\n", format, 32 - shift,
+			(unsigned long long)mismatches, (unsigned)stats.underruns, (unsigned long long)played, frames);
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	float seconds = argc > 1 ? atof(argv[1]) : 10;
+	const char* path = argc > 2 ? argv[2] : "playback_bench.wav";
+
+	printf("format,word_bits,channels,samplerate,seconds,realtime,mb_per_s,callback_ns_per_block,read_ns_per_block\n");
+	bool ok = true;
+	static const uint8_t widths[] = { 16, 24, 32 };
+	for (uint8_t bits : widths)
+	{
+		// not started, setFormat() only selects the format
+		if (!AudioOutputI2S::setFormat(SAMPLERATE, bits))
+		{
+			fprintf(stderr, "%d Hz %u bit not supported\n", SAMPLERATE, bits);
+			return 1;
+		}
+		ok = play(path, "pcm16", 16, false, seconds) && ok;
+		ok = play(path, "pcm24", 24, false, seconds) && ok;
+		ok = play(path, "pcm32", 32, false, seconds) && ok;
+		ok = play(path, "float32", 32, true, seconds) && ok;
+	}
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,30 @@
+/* Host build of the Teensy 4 I2S TDM library
+ *
+ * Runs the SD write benchmark of examples/RecordBenchmark/record_bench.h against a local
+ * file: the same WavWriter code the RecordBenchmark sketch runs on the card, timed with the
+ * monotonic clock. The host file system hides most of what preallocation saves on a FAT
+ * card, the numbers that matter come from the sketch; this one keeps the code path honest.
+ *
+ *   record_bench [megabytes] [file]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "examples/RecordBenchmark/record_bench.h"
+#include "sim.h"
+
+struct HostClock
+{
+	static uint32_t cycles() { return (uint32_t)sim::hostNs(); }
+	static double nsPerCycle() { return 1; }
+};
+
+int main(int argc, char** argv)
+{
+	uint32_t megabytes = argc > 1 ? atoi(argv[1]) : 64;
+	const char* path = argc > 2 ? argv[2] : "record_bench.wav";
+
+	printf("# record_bench host %d channels %d bit\n", CHANNELS, BIT_DEPTH);
+	record_bench::run<HostClock>(Serial, path, megabytes);
+	remove(path);
+	return 0;
+}
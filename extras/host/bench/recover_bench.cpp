@@ -0,0 +1,230 @@
+/* Host build of the Teensy 4 I2S TDM library
+ *
+ * Cuts recordings short and repairs them with WavWriter::RecoverFile(), on an exFAT and
+ * on a FAT card (SD.sdfs.setFatType). On FAT the preallocated file is as long as it was
+ * reserved from the start, over clusters with stale data in them. A child process records
+ * into a preallocated file with a header commit every kCommitMs and exits in the middle
+ * of the recording without SaveFile(), losing its stdio buffers like a power cut loses
+ * the card's. The repaired file must hold at least the audio up to the last commit, every
+ * sample as recorded and nothing after it: a WAV file whose sizes match the file, a FLAC
+ * file that bench/flac_decode.h decodes to the end. A WAV file cut before its first
+ * commit has nothing to recover and must be left alone, and so must every byte of a file
+ * SaveFile() finished.
+ *
+ *   recover_bench [file] [flac file]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <vector>
+#include "Arduino.h"
+#include "AudioConfig.h"
+#include "WavWriter.h"
+#include "output_i2s_tdm.h"
+#include "flac_decode.h"
+#include "sim.h"
+
+static const uint32_t kCommitMs = 100;
+static const float kPreallocateSeconds = 2; // more than is recorded, FAT leaves the rest stale
+static const float kSeconds = 0.75f;
+
+static int32_t channel[CHANNELS][AUDIO_BLOCK_SAMPLES];
+
+// A full scale word of `bits` bits, right-aligned and sign-extended like the SAI receives it
+static int32_t word(uint32_t frame, unsigned k, unsigned bits)
+{
+	uint32_t x = (frame * 2654435761u) ^ (k * 40503u) ^ (frame >> 5);
+	x ^= x >> 15;
+	x *= 2246822519u;
+	return (int32_t)x >> (32 - bits);
+}
+
+static std::vector<uint8_t> readFile(const char* path)
+{
+	std::vector<uint8_t> file;
+	FILE* f = fopen(path, "rb");
+	if (!f)
+		return file;
+	uint8_t buf[65536];
+	size_t n;
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+		file.insert(file.end(), buf, buf + n);
+	fclose(f);
+	return file;
+}
+
+// Records `frames` frames in a child process, which exits after the last Write() without
+// SaveFile() unless `save`; returns false if the recording could not be started
+template <typename Writer>
+static bool recordAndCut(Writer& writer, const char* path, uint32_t commitMs, uint32_t frames, bool save = false)
+{
+	fflush(stdout);
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		unsigned wordBits = AudioOutputI2S::getBitDepth();
+		int32_t* inputs[CHANNELS];
+		for (size_t k = 0; k < CHANNELS; k++)
+			inputs[k] = channel[k];
+
+		writer.WavInit();
+		writer.SetCommitInterval(commitMs);
+		if (!writer.OpenFile(path, kPreallocateSeconds) || !writer.IsPreallocated())
+			_exit(1);
+		for (uint32_t frame = 0; frame < frames; frame += AUDIO_BLOCK_SAMPLES)
+		{
+			for (size_t k = 0; k < CHANNELS; k++)
+				for (size_t i = 0; i < AUDIO_BLOCK_SAMPLES; i++)
+					channel[k][i] = word(frame + i, k, wordBits);
+			writer.SampleBlock(inputs, AUDIO_BLOCK_SAMPLES);
+			sim::run(AUDIO_BLOCK_SAMPLES); // millis() moves on for the commits
+			writer.Write();
+		}
+		if (save)
+			writer.SaveFile();
+		_exit(0);
+	}
+	int status = 0;
+	return pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// The frames recorded up to the last commit at least: less the commit interval, the ring
+// and the segment being filled
+template <typename Writer>
+static uint32_t committedFrames(Writer& writer, uint32_t frames)
+{
+	uint32_t segment = Writer::SegmentBytes() / Writer::FrameBytes();
+	uint32_t lost = (uint32_t)((uint64_t)kCommitMs * AudioOutputI2S::getSampleRate() / 1000) + 5 * segment;
+	return frames > lost ? frames - lost : 0;
+}
+
+template <typename Writer>
+static bool recoverWav(Writer& writer, const char* path, const char* card)
+{
+	unsigned wordBits = AudioOutputI2S::getBitDepth();
+	uint32_t frames = (uint32_t)(kSeconds * AudioOutputI2S::getSampleRate()) / AUDIO_BLOCK_SAMPLES * AUDIO_BLOCK_SAMPLES;
+	bool ok = false;
+	uint32_t recovered = 0;
+	uint64_t mismatches = 0;
+	if (recordAndCut(writer, path, kCommitMs, frames) && Writer::RecoverFile(path))
+	{
+		// RIFF <size> WAVE, the chunks WavWriter writes up to data, and nothing after the data
+		std::vector<uint8_t> file = readFile(path);
+		uint32_t riff = 0;
+		size_t data = 0, size = 0;
+		memcpy(&riff, &file[4], 4);
+		for (size_t pos = 12; pos + 8 <= file.size();)
+		{
+			uint32_t id, n;
+			memcpy(&id, &file[pos], 4);
+			memcpy(&n, &file[pos + 4], 4);
+			pos += 8;
+			if (id == kWavFileSubChunk2Id)
+			{
+				data = pos;
+				size = n;
+				break;
+			}
+			pos += n + (n & 1);
+		}
+		// 24 bit samples, the top bytes of the left-justified words
+		const unsigned bytes = 3;
+		recovered = (uint32_t)(size / (CHANNELS * bytes));
+		const uint8_t* p = file.data() + data;
+		for (uint32_t i = 0; data && i < recovered; i++)
+		{
+			for (unsigned k = 0; k < CHANNELS; k++)
+			{
+				uint32_t expected = ((uint32_t)word(i, k, wordBits) << (32 - wordBits)) >> 8;
+				uint32_t got = 0;
+				memcpy(&got, p, bytes);
+				if (got != expected)
+					mismatches++;
+				p += bytes;
+			}
+		}
+		ok = data && data + size == file.size() && riff == file.size() - 8 && size % (CHANNELS * bytes) == 0
+			&& recovered >= committedFrames(writer, frames) && recovered <= frames && mismatches == 0;
+	}
+	remove(path);
+	printf("%-6s  wav   %6u of %6u frames  %llu mismatches  %s\n", card, (unsigned)recovered, (unsigned)frames,
+		(unsigned long long)mismatches, ok ? "ok" : "FAIL");
+	return ok;
+}
+
+template <typename Writer>
+static bool recoverFlac(Writer& writer, const char* path, const char* card)
+{
+	unsigned wordBits = AudioOutputI2S::getBitDepth();
+	uint32_t frames = (uint32_t)(kSeconds * AudioOutputI2S::getSampleRate()) / AUDIO_BLOCK_SAMPLES * AUDIO_BLOCK_SAMPLES;
+	FlacStream stream;
+	bool ok = false;
+	uint64_t mismatches = 0;
+	if (recordAndCut(writer, path, kCommitMs, frames) && Writer::RecoverFile(path))
+	{
+		// the decoder returns the samples left-justified
+		bool decoded = flacDecodeFile(path, stream);
+		for (uint32_t i = 0; decoded && i < stream.frames && i < frames; i++)
+			for (unsigned k = 0; k < CHANNELS; k++)
+				if ((uint32_t)stream.samples[i * CHANNELS + k] != (((uint32_t)word(i, k, wordBits) << (32 - wordBits)) & 0xFFFFFF00u))
+					mismatches++;
+		ok = decoded && stream.frames >= committedFrames(writer, frames) && stream.frames <= frames && mismatches == 0;
+		if (!decoded)
+			fprintf(stderr, "%s flac: %s\n", card, stream.error.c_str());
+	}
+	remove(path);
+	printf("%-6s  flac  %6u of %6u frames  %llu mismatches  %s\n", card, (unsigned)stream.frames, (unsigned)frames,
+		(unsigned long long)mismatches, ok ? "ok" : "FAIL");
+	return ok;
+}
+
+// Cut before the first commit: the WAV header says 0 bytes and the file must stay as it is
+template <typename Writer>
+static bool uncommittedWav(Writer& writer, const char* path, const char* card)
+{
+	uint32_t frames = (uint32_t)(0.25f * AudioOutputI2S::getSampleRate()) / AUDIO_BLOCK_SAMPLES * AUDIO_BLOCK_SAMPLES;
+	bool recorded = recordAndCut(writer, path, 0, frames);
+	std::vector<uint8_t> before = readFile(path);
+	bool recovered = Writer::RecoverFile(path);
+	bool ok = recorded && !recovered && readFile(path) == before;
+	remove(path);
+	printf("%-6s  wav   not committed, %s  %s\n", card, recovered ? "recovered" : "left alone", ok ? "ok" : "FAIL");
+	return ok;
+}
+
+// A finished recording, the last FLAC frame a short one: RecoverFile() changes nothing
+template <typename Writer>
+static bool savedFile(Writer& writer, const char* path, const char* card, const char* name)
+{
+	uint32_t frames = (uint32_t)(0.25f * AudioOutputI2S::getSampleRate()) / AUDIO_BLOCK_SAMPLES * AUDIO_BLOCK_SAMPLES;
+	bool recorded = recordAndCut(writer, path, kCommitMs, frames, true);
+	std::vector<uint8_t> before = readFile(path);
+	bool recovered = Writer::RecoverFile(path);
+	bool ok = recorded && recovered && readFile(path) == before;
+	remove(path);
+	printf("%-6s  %-4s  saved, %s  %s\n", card, name, ok ? "unchanged" : "changed", ok ? "ok" : "FAIL");
+	return ok;
+}
+
+static WavWriter<8192, 4, WAV_WRITER_PCM, 24> pcm24;
+static WavWriter<8192, 4, WAV_WRITER_FLAC, 24> flac24;
+
+int main(int argc, char** argv)
+{
+	const char* path = argc > 1 ? argv[1] : "recover_bench.wav";
+	const char* flacPath = argc > 2 ? argv[2] : "recover_bench.flac";
+	bool ok = true;
+
+	printf("channels %d, %u bit words, commit every %u ms\n", CHANNELS, AudioOutputI2S::getBitDepth(), (unsigned)kCommitMs);
+	static const struct { uint8_t type; const char* name; } cards[] = { { FAT_TYPE_EXFAT, "exFAT" }, { FAT_TYPE_FAT32, "FAT32" } };
+	for (const auto& card : cards)
+	{
+		SD.sdfs.setFatType(card.type);
+		ok = recoverWav(pcm24, path, card.name) && ok;
+		ok = recoverFlac(flac24, flacPath, card.name) && ok;
+		ok = uncommittedWav(pcm24, path, card.name) && ok;
+		ok = savedFile(pcm24, path, card.name, "wav") && ok;
+		ok = savedFile(flac24, flacPath, card.name, "flac") && ok;
+	}
+	return ok ? 0 : 1;
+}
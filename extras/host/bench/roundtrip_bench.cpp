@@ -0,0 +1,248 @@
+/* Host build of the Teensy 4 I2S TDM library
+ *
+ * Records through WavWriter at every SAI word width (16, 24 and 32 bit, switched with
+ * AudioOutputI2S::setFormat) into 16, 24 and 32 bit PCM and 32 bit float files, and
+ * checks every byte of the data chunk. The callback samples are fed the way the SAI
+ * delivers them, right-aligned in the int32 and sign-extended, half the blocks through
+ * SampleBlock() and half frame by frame through Sample(). The file must hold each sample
+ * left-justified and cut to the file's sample size, with the sample rate and the valid
+ * bits of the format in the header; a mismatch makes the benchmark fail. 16 and 24 bit
+ * FLAC files are decoded with bench/flac_decode.h and checked the same way, sample rate
+ * and sample size of STREAMINFO included. Blocks the callback delivers between WavInit()
+ * and OpenFile() must be dropped without reaching the file or the overrun count.
+ *
+ *   roundtrip_bench [file] [flac file]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "Arduino.h"
+#include "AudioConfig.h"
+#include "WavWriter.h"
+#include "output_i2s_tdm.h"
+#include "flac_decode.h"
+
+static const uint32_t kRate = 44100; // not SAMPLERATE, the header must follow the active format
+static const uint32_t kFrames = 10000; // some segments and a partial one
+
+static int32_t channel[CHANNELS][AUDIO_BLOCK_SAMPLES];
+
+// A full scale word of `bits` bits, right-aligned and sign-extended like the SAI receives it
+static int32_t word(uint32_t frame, unsigned k, unsigned bits)
+{
+	uint32_t x = (frame * 2654435761u) ^ (k * 40503u) ^ (frame >> 5);
+	x ^= x >> 15;
+	x *= 2246822519u;
+	return (int32_t)x >> (32 - bits);
+}
+
+// The data chunk of a WAV file, and the fields of the fmt chunk that are checked
+struct WavFile
+{
+	uint32_t sampleRate = 0;
+	uint16_t bitsPerSample = 0, validBits = 0;
+	std::vector<uint8_t> data;
+};
+
+static bool readWav(const char* path, WavFile& wav)
+{
+	FILE* f = fopen(path, "rb");
+	if (!f)
+		return false;
+	std::vector<uint8_t> file;
+	uint8_t buf[65536];
+	size_t n;
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+		file.insert(file.end(), buf, buf + n);
+	fclose(f);
+
+	// the chunks after "RIFF" <size> "WAVE"
+	bool fmt = false;
+	for (size_t pos = 12; pos + 8 <= file.size();)
+	{
+		uint32_t id, size;
+		memcpy(&id, &file[pos], 4);
+		memcpy(&size, &file[pos + 4], 4);
+		pos += 8;
+		if (pos + size > file.size())
+			return false;
+		if (id == kWavFileSubChunk1Id && size >= 16)
+		{
+			memcpy(&wav.sampleRate, &file[pos + 4], 4);
+			memcpy(&wav.bitsPerSample, &file[pos + 14], 2);
+			wav.validBits = wav.bitsPerSample;
+			if (size >= 40)
+				memcpy(&wav.validBits, &file[pos + 18], 2);
+			fmt = true;
+		}
+		else if (id == kWavFileSubChunk2Id)
+		{
+			wav.data.assign(file.begin() + pos, file.begin() + pos + size);
+			return fmt;
+		}
+		pos += size + (size & 1);
+	}
+	return false;
+}
+
+// Records kFrames, rounded up to whole blocks, of words of the current width; returns the frames
+template <typename Writer>
+static uint32_t record(Writer& writer, const char* path)
+{
+	unsigned wordBits = AudioOutputI2S::getBitDepth();
+
+	int32_t* inputs[CHANNELS];
+	for (size_t k = 0; k < CHANNELS; k++)
+		inputs[k] = channel[k];
+
+	writer.WavInit();
+	// the callback runs before the file is open, more blocks than the ring holds
+	for (size_t k = 0; k < CHANNELS; k++)
+		for (size_t i = 0; i < AUDIO_BLOCK_SAMPLES; i++)
+			channel[k][i] = -1;
+	for (uint32_t frame = 0; frame < kFrames; frame += AUDIO_BLOCK_SAMPLES)
+		writer.SampleBlock(inputs, AUDIO_BLOCK_SAMPLES);
+	if (!writer.OpenFile(path))
+	{
+		fprintf(stderr, "cannot write %s\n", path);
+		return 0;
+	}
+	for (uint32_t frame = 0; frame < kFrames; frame += AUDIO_BLOCK_SAMPLES)
+	{
+		for (size_t k = 0; k < CHANNELS; k++)
+			for (size_t i = 0; i < AUDIO_BLOCK_SAMPLES; i++)
+				channel[k][i] = word(frame + i, k, wordBits);
+
+		if ((frame / AUDIO_BLOCK_SAMPLES) % 2 == 0)
+		{
+			writer.SampleBlock(inputs, AUDIO_BLOCK_SAMPLES);
+		}
+		else
+		{
+			for (size_t i = 0; i < AUDIO_BLOCK_SAMPLES; i++)
+			{
+				int32_t in[CHANNELS];
+				for (size_t k = 0; k < CHANNELS; k++)
+					in[k] = channel[k][i];
+				writer.Sample(in);
+			}
+		}
+		writer.Write();
+	}
+	writer.SaveFile();
+	WavWriterStats stats = writer.GetStats();
+	if (stats.overruns || stats.droppedFrames)
+	{
+		fprintf(stderr, "%u overruns, %u frames dropped\n", (unsigned)stats.overruns, (unsigned)stats.droppedFrames);
+		return 0;
+	}
+	return (kFrames + AUDIO_BLOCK_SAMPLES - 1) / AUDIO_BLOCK_SAMPLES * AUDIO_BLOCK_SAMPLES;
+}
+
+template <typename Writer>
+static bool roundtrip(Writer& writer, const char* path, const char* name, unsigned fileBits, bool isFloat)
+{
+	unsigned wordBits = AudioOutputI2S::getBitDepth();
+	uint32_t frames = record(writer, path);
+
+	WavFile wav;
+	bool read = readWav(path, wav);
+	remove(path);
+
+	unsigned bytes = isFloat ? 4 : fileBits / 8;
+	unsigned valid = isFloat ? 32 : (wordBits < fileBits ? wordBits : fileBits);
+	uint64_t mismatches = 0;
+	if (read && wav.data.size() == (size_t)frames * CHANNELS * bytes)
+	{
+		const uint8_t* p = wav.data.data();
+		for (uint32_t i = 0; i < frames; i++)
+		{
+			for (unsigned k = 0; k < CHANNELS; k++)
+			{
+				uint32_t left = (uint32_t)word(i, k, wordBits) << (32 - wordBits);
+				uint32_t expected;
+				if (isFloat)
+				{
+					float f = q31_to_float((int32_t)left);
+					memcpy(&expected, &f, 4);
+				}
+				else
+				{
+					// the top bytes, little endian
+					expected = left >> (32 - fileBits);
+				}
+				uint32_t got = 0;
+				memcpy(&got, p, bytes);
+				if (got != expected)
+					mismatches++;
+				p += bytes;
+			}
+		}
+	}
+
+	bool ok = read && wav.data.size() == (size_t)frames * CHANNELS * bytes && mismatches == 0
+		&& wav.sampleRate == kRate && wav.bitsPerSample == bytes * 8 && wav.validBits == valid;
+	printf("%2u bit words  %-7s  %u Hz  %2u of %2u bits  %llu mismatches  %s\n", wordBits, name,
+		(unsigned)wav.sampleRate, wav.validBits, wav.bitsPerSample, (unsigned long long)mismatches, ok ? "ok" : "FAIL");
+	return ok;
+}
+
+template <typename Writer>
+static bool roundtripFlac(Writer& writer, const char* path, const char* name, unsigned fileBits)
+{
+	unsigned wordBits = AudioOutputI2S::getBitDepth();
+	uint32_t frames = record(writer, path);
+
+	FlacStream stream;
+	bool decoded = flacDecodeFile(path, stream);
+	remove(path);
+
+	// the decoder returns the samples left-justified
+	const uint32_t mask = ~(0xFFFFFFFFu >> fileBits);
+	uint64_t mismatches = 0;
+	for (uint32_t i = 0; decoded && i < stream.frames && i < frames; i++)
+		for (unsigned k = 0; k < CHANNELS; k++)
+			if ((uint32_t)stream.samples[i * CHANNELS + k] != (((uint32_t)word(i, k, wordBits) << (32 - wordBits)) & mask))
+				mismatches++;
+
+	bool ok = decoded && stream.frames == frames && mismatches == 0
+		&& stream.sampleRate == kRate && stream.bits == fileBits && stream.channels == CHANNELS;
+	printf("%2u bit words  %-7s  %u Hz  %2u bits        %llu mismatches  %s\n", wordBits, name,
+		(unsigned)stream.sampleRate, stream.bits, (unsigned long long)mismatches, ok ? "ok" : "FAIL");
+	if (!decoded)
+		fprintf(stderr, "%s: %s\n", name, stream.error.c_str());
+	return ok;
+}
+
+static WavWriter<8192, 4, WAV_WRITER_PCM, 16> pcm16;
+static WavWriter<8192, 4, WAV_WRITER_PCM, 24> pcm24;
+static WavWriter<8192, 4, WAV_WRITER_PCM, 32> pcm32;
+static WavWriter<8192, 4, WAV_WRITER_FLOAT> float32;
+static WavWriter<8192, 4, WAV_WRITER_FLAC, 16> flac16;
+static WavWriter<8192, 4, WAV_WRITER_FLAC, 24> flac24;
+
+int main(int argc, char** argv)
+{
+	const char* path = argc > 1 ? argv[1] : "roundtrip_bench.wav";
+	const char* flacPath = argc > 2 ? argv[2] : "roundtrip_bench.flac";
+	bool ok = true;
+
+	printf("channels %d\n", CHANNELS);
+	static const uint8_t widths[] = { 16, 24, 32 };
+	for (uint8_t bits : widths)
+	{
+		// not started, setFormat() only selects the format
+		if (!AudioOutputI2S::setFormat(kRate, bits))
+		{
+			fprintf(stderr, "%u Hz %u bit not supported\n", (unsigned)kRate, bits);
+			return 1;
+		}
+		ok = roundtrip(pcm16, path, "pcm16", 16, false) && ok;
+		ok = roundtrip(pcm24, path, "pcm24", 24, false) && ok;
+		ok = roundtrip(pcm32, path, "pcm32", 32, false) && ok;
+		ok = roundtrip(float32, path, "float32", 32, true) && ok;
+		ok = roundtripFlac(flac16, flacPath, "flac16", 16) && ok;
+		ok = roundtripFlac(flac24, flacPath, "flac24", 24) && ok;
+	}
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,47 @@
+/* Host build of the Teensy 4 I2S TDM library
+ *
+ * Runs the simulation with AUDIO_TRACE and drains the trace the way a sketch would from
+ * loop(): a slice of audio, then audio_trace::drain(Serial). The "loop" span around each
+ * slice shows where the interrupts preempt it. Pipe the output into tools/trace2json.py,
+ * `make trace` does both and writes trace.json.
+ *
+ *   trace_dump [milliseconds]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "Arduino.h"
+#include "AudioConfig.h"
+#include "input_i2s_tdm.h"
+#include "output_i2s_tdm.h"
+#include "utility/audio_trace.h"
+#include "sim.h"
+
+AudioOutputI2S audioOutputI2S;
+AudioInputI2S audioInputI2S;
+
+int main(int argc, char** argv)
+{
+#if !AUDIO_TRACE
+	fprintf(stderr, "trace_dump needs a build with -DAUDIO_TRACE=1, see make trace\n");
+	return 1;
+#else
+	double ms = argc > 1 ? atof(argv[1]) : 10.0;
+
+	audioOutputI2S.begin();
+	audioInputI2S.begin();
+	sim::runSeconds(0.01);
+	audio_trace::clear();
+
+	uint64_t end = sim::frames() + (uint64_t)(sim::sampleRate() * ms / 1000);
+	while (sim::frames() < end)
+	{
+		{
+			AUDIO_TRACE_SCOPE("loop");
+			sim::run(AUDIO_BLOCK_SAMPLES / 4);
+		}
+		while (audio_trace::drain(Serial)) { }
+	}
+	Serial.flush();
+	return 0;
+#endif
+}
@@ -0,0 +1,252 @@
+/* Host build of the Teensy 4 I2S TDM library
+ *
+ * Micro-benchmark of the TDM transpose kernels in utility/tdm_transpose.h.
+ * Every kernel available on the host is timed for each channel count and number of
+ * frames per DMA half (the ISR copies AUDIO_BLOCK_SAMPLES / 2 frames per interrupt),
+ * and its output is compared against the scalar reference.
+ * The float kernels of utility/tdm_convert.h are timed against the int32 transpose
+ * followed by a separate conversion pass over the planar buffers ("split").
+ *
+ *   transpose_bench [iterations]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utility/tdm_transpose.h"
+#include "utility/tdm_convert.h"
+#include "sim.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static inline uint64_t cycles() { return __rdtsc(); }
+#else
+static inline uint64_t cycles() { return sim::hostNs(); }
+#endif
+
+static const size_t kMaxFrames = 128;
+
+alignas(32) static int32_t interleaved[TDM_MAX_CHANNELS * kMaxFrames];
+alignas(32) static int32_t reference[TDM_MAX_CHANNELS * kMaxFrames];
+alignas(32) static int32_t planar[TDM_MAX_CHANNELS][kMaxFrames];
+alignas(32) static int32_t planarRef[TDM_MAX_CHANNELS][kMaxFrames];
+alignas(32) static float planarFloat[TDM_MAX_CHANNELS][kMaxFrames];
+alignas(32) static float planarFloatRef[TDM_MAX_CHANNELS][kMaxFrames];
+
+static int iterations = 20000;
+static int failures;
+
+typedef void (*DeinterleaveFn)(const int32_t*, int32_t* const*);
+typedef void (*InterleaveFn)(const int32_t* const*, int32_t*);
+
+static void report(const char* kernel, const char* direction, size_t channels, size_t frames, uint64_t ns, uint64_t cyc, bool ok)
+{
+	double perBlock = (double)ns / iterations;
+	printf("%-5s %-12s %2zu ch %4zu frames  %9.1f ns/block  %6.3f ns/sample  %9.1f cycles/block  %s\n",
+		kernel, direction, channels, frames, perBlock, perBlock / (channels * frames),
+		(double)cyc / iterations, ok ? "ok" : "MISMATCH");
+	if (!ok)
+		failures++;
+}
+
+template <size_t Channels, size_t Frames>
+static void benchDeinterleave(const char* name, DeinterleaveFn fn)
+{
+	int32_t* dest[Channels];
+	int32_t* destRef[Channels];
+	for (size_t k = 0; k < Channels; k++)
+	{
+		dest[k] = planar[k];
+		destRef[k] = planarRef[k];
+	}
+	memset(planar, 0, sizeof(planar));
+	tdm_deinterleave_ref<Channels, Frames>(interleaved, destRef);
+
+	uint64_t start = sim::hostNs();
+	uint64_t c0 = cycles();
+	for (int n = 0; n < iterations; n++)
+	{
+		fn(interleaved, dest);
+		asm volatile("" ::: "memory");
+	}
+	uint64_t cyc = cycles() - c0;
+	uint64_t ns = sim::hostNs() - start;
+
+	bool ok = true;
+	for (size_t k = 0; k < Channels; k++)
+		ok &= memcmp(planar[k], planarRef[k], Frames * sizeof(int32_t)) == 0;
+	report(name, "deinterleave", Channels, Frames, ns, cyc, ok);
+}
+
+template <size_t Channels, size_t Frames>
+static void benchInterleave(const char* name, InterleaveFn fn)
+{
+	const int32_t* src[Channels];
+	for (size_t k = 0; k < Channels; k++)
+		src[k] = planarRef[k];
+	memset(interleaved, 0, sizeof(interleaved));
+	tdm_interleave_ref<Channels, Frames>(src, reference);
+
+	uint64_t start = sim::hostNs();
+	uint64_t c0 = cycles();
+	for (int n = 0; n < iterations; n++)
+	{
+		fn(src, interleaved);
+		asm volatile("" ::: "memory");
+	}
+	uint64_t cyc = cycles() - c0;
+	uint64_t ns = sim::hostNs() - start;
+
+	bool ok = memcmp(interleaved, reference, Channels * Frames * sizeof(int32_t)) == 0;
+	report(name, "interleave", Channels, Frames, ns, cyc, ok);
+}
+
+template <size_t Channels, size_t Frames>
+static void benchShape()
+{
+	for (size_t i = 0; i < TDM_MAX_CHANNELS * kMaxFrames; i++)
+		interleaved[i] = (int32_t)(i * 2654435761u);
+	for (size_t k = 0; k < TDM_MAX_CHANNELS; k++)
+		for (size_t i = 0; i < kMaxFrames; i++)
+			planarRef[k][i] = (int32_t)((k << 24) ^ (i * 40503u));
+
+	benchInterleave<Channels, Frames>("ref", tdm_interleave_ref<Channels, Frames>);
+#if defined(__SSE2__)
+	benchInterleave<Channels, Frames>("sse2", tdm_interleave_sse2<Channels, Frames>);
+#endif
+#if defined(__AVX2__)
+	benchInterleave<Channels, Frames>("avx2", tdm_interleave_avx2<Channels, Frames>);
+#endif
+
+	for (size_t i = 0; i < TDM_MAX_CHANNELS * kMaxFrames; i++)
+		interleaved[i] = (int32_t)(i * 2654435761u);
+	benchDeinterleave<Channels, Frames>("ref", tdm_deinterleave_ref<Channels, Frames>);
+#if defined(__SSE2__)
+	benchDeinterleave<Channels, Frames>("sse2", tdm_deinterleave_sse2<Channels, Frames>);
+#endif
+#if defined(__AVX2__)
+	benchDeinterleave<Channels, Frames>("avx2", tdm_deinterleave_avx2<Channels, Frames>);
+#endif
+}
+
+template <size_t Channels, size_t Frames, bool Fused>
+static void deinterleaveFloat(const int32_t* src, float* const* dest)
+{
+	if (Fused)
+	{
+		tdm_deinterleave<Channels, Frames>(src, dest);
+		return;
+	}
+
+	int32_t* tmp[Channels];
+	for (size_t k = 0; k < Channels; k++)
+		tmp[k] = planar[k];
+	tdm_deinterleave<Channels, Frames>(src, tmp);
+	for (size_t k = 0; k < Channels; k++)
+		for (size_t i = 0; i < Frames; i++)
+			dest[k][i] = q31_to_float(tmp[k][i]);
+}
+
+template <size_t Channels, size_t Frames, bool Fused>
+static void interleaveFloat(const float* const* src, int32_t* dest)
+{
+	if (Fused)
+	{
+		tdm_interleave<Channels, Frames>(src, dest);
+		return;
+	}
+
+	const int32_t* tmp[Channels];
+	for (size_t k = 0; k < Channels; k++)
+	{
+		for (size_t i = 0; i < Frames; i++)
+			planar[k][i] = float_to_q31(src[k][i]);
+		tmp[k] = planar[k];
+	}
+	tdm_interleave<Channels, Frames>(tmp, dest);
+}
+
+template <size_t Channels, size_t Frames>
+static void benchFloat(const char* name, void (*deinterleave)(const int32_t*, float* const*), void (*interleave)(const float* const*, int32_t*))
+{
+	float* dest[Channels];
+	float* destRef[Channels];
+	const float* src[Channels];
+	for (size_t k = 0; k < Channels; k++)
+	{
+		dest[k] = planarFloat[k];
+		destRef[k] = planarFloatRef[k];
+		src[k] = planarFloatRef[k];
+	}
+	for (size_t i = 0; i < TDM_MAX_CHANNELS * kMaxFrames; i++)
+		interleaved[i] = (int32_t)(i * 2654435761u);
+	tdm_deinterleave_q31_ref<Channels, Frames>(interleaved, destRef);
+
+	uint64_t start = sim::hostNs();
+	uint64_t c0 = cycles();
+	for (int n = 0; n < iterations; n++)
+	{
+		deinterleave(interleaved, dest);
+		asm volatile("" ::: "memory");
+	}
+	uint64_t cyc = cycles() - c0;
+	uint64_t ns = sim::hostNs() - start;
+
+	bool ok = true;
+	for (size_t k = 0; k < Channels; k++)
+		ok &= memcmp(planarFloat[k], planarFloatRef[k], Frames * sizeof(float)) == 0;
+	report(name, "deint q31>f", Channels, Frames, ns, cyc, ok);
+
+	// out of range samples must saturate
+	planarFloatRef[0][0] = 1.5f;
+	planarFloatRef[Channels - 1][Frames - 1] = -3.0f;
+	tdm_interleave_q31_ref<Channels, Frames>(src, reference);
+
+	start = sim::hostNs();
+	c0 = cycles();
+	for (int n = 0; n < iterations; n++)
+	{
+		interleave(src, interleaved);
+		asm volatile("" ::: "memory");
+	}
+	cyc = cycles() - c0;
+	ns = sim::hostNs() - start;
+
+	ok = memcmp(interleaved, reference, Channels * Frames * sizeof(int32_t)) == 0
+		&& reference[0] == INT32_MAX && reference[Channels * Frames - 1] == INT32_MIN;
+	report(name, "int f>q31", Channels, Frames, ns, cyc, ok);
+}
+
+template <size_t Channels>
+static void benchFloatChannels()
+{
+	benchFloat<Channels, 64>("split", deinterleaveFloat<Channels, 64, false>, interleaveFloat<Channels, 64, false>);
+	benchFloat<Channels, 64>("fused", deinterleaveFloat<Channels, 64, true>, interleaveFloat<Channels, 64, true>);
+}
+
+template <size_t Channels>
+static void benchChannels()
+{
+	benchShape<Channels, 8>();
+	benchShape<Channels, 16>();
+	benchShape<Channels, 32>();
+	benchShape<Channels, 64>();
+	benchShape<Channels, 128>();
+}
+
+int main(int argc, char** argv)
+{
+	if (argc > 1)
+		iterations = atoi(argv[1]);
+
+	benchChannels<2>();
+	benchChannels<4>();
+	benchChannels<8>();
+	benchChannels<16>();
+
+	benchFloatChannels<2>();
+	benchFloatChannels<4>();
+	benchFloatChannels<8>();
+	benchFloatChannels<16>();
+
+	return failures == 0 ? 0 : 1;
+}
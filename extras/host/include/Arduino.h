@@ -0,0 +1,76 @@
+/* Host build of the Teensy 4 I2S TDM library
+ *
+ * Minimal stand-in for the Teensyduino core so the library sources compile on Linux.
+ * Only what the library itself uses is provided. Time is taken from the simulated
+ * sample clock in sim/sim.h, so micros() advances with the audio stream and not with
+ * the wall clock.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "imxrt.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define FLASHMEM
+#define DMAMEM
+#define EXTMEM
+#define FASTRUN
+
+#define F_CPU_ACTUAL 600000000
+
+// The DWT cycle counter runs at F_CPU_ACTUAL on the simulated clock, in step with micros().
+// Inside an interrupt it moves on with the host clock (clock_gettime), so cycle counts
+// measure the host time spent in the handler.
+uint32_t sim_cycle_count(void);
+#define ARM_DWT_CYCCNT (sim_cycle_count())
+
+uint32_t micros(void);
+uint32_t millis(void);
+void delay(uint32_t msec);
+void delayMicroseconds(uint32_t usec);
+
+static inline void __disable_irq(void) { }
+static inline void __enable_irq(void) { }
+
+// The data cache does not exist on the host, the simulated DMA reads and writes the
+// same memory as the CPU. Calls are counted by the simulator instead.
+void arm_dcache_delete(void *addr, uint32_t size);
+void arm_dcache_flush(void *addr, uint32_t size);
+void arm_dcache_flush_delete(void *addr, uint32_t size);
+
+#define DEC 10
+#define HEX 16
+
+class HostSerial
+{
+public:
+	void begin(uint32_t) { }
+	operator bool() const { return true; }
+	int available() { return 0; }
+	int read() { return -1; }
+	size_t write(uint8_t c) { return fwrite(&c, 1, 1, stdout); }
+	size_t write(const uint8_t *buf, size_t size) { return fwrite(buf, 1, size, stdout); }
+	size_t print(const char *s) { return printf("%s", s); }
+	size_t print(char c) { return printf("%c", c); }
+	size_t print(int n, int base = DEC) { return base == HEX ? printf("%x", n) : printf("%d", n); }
+	size_t print(unsigned int n, int base = DEC) { return base == HEX ? printf("%x", n) : printf("%u", n); }
+	size_t print(long n, int base = DEC) { return base == HEX ? printf("%lx", n) : printf("%ld", n); }
+	size_t print(unsigned long n, int base = DEC) { return base == HEX ? printf("%lx", n) : printf("%lu", n); }
+	size_t print(long long n, int base = DEC) { return base == HEX ? printf("%llx", n) : printf("%lld", n); }
+	size_t print(unsigned long long n, int base = DEC) { return base == HEX ? printf("%llx", n) : printf("%llu", n); }
+	size_t print(double n, int digits = 2) { return printf("%.*f", digits, n); }
+	size_t println() { return printf("\n"); }
+	template <typename T> size_t println(T v) { size_t n = print(v); return n + println(); }
+	template <typename T> size_t println(T v, int f) { size_t n = print(v, f); return n + println(); }
+	void flush() { fflush(stdout); }
+};
+
+extern HostSerial Serial;
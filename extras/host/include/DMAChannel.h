@@ -0,0 +1,68 @@
+/* Host build of the Teensy 4 I2S TDM library
+ *
+ * Software model of the Teensyduino DMAChannel class. The transfer control descriptor
+ * has the same fields as the eDMA TCD, and the simulator in sim/sim.cpp executes the
+ * minor and major loops for the channels triggered by the SAI1 requests, raising the
+ * half and major interrupts the same way the hardware does.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#define DMA_TCD_ATTR_SSIZE(n)   (((n) & 0x7) << 8)
+#define DMA_TCD_ATTR_DSIZE(n)   (((n) & 0x7) << 0)
+#define DMA_TCD_CSR_INTHALF     0x0004
+#define DMA_TCD_CSR_INTMAJOR    0x0002
+
+class DMABaseClass
+{
+public:
+	typedef struct
+	{
+		volatile const void * volatile SADDR;
+		int16_t SOFF;
+		uint16_t ATTR;
+		uint32_t NBYTES_MLNO;
+		int32_t SLAST;
+		volatile void * volatile DADDR;
+		int16_t DOFF;
+		volatile uint16_t CITER_ELINKNO;
+		int32_t DLASTSGA;
+		volatile uint16_t CSR;
+		volatile uint16_t BITER_ELINKNO;
+	} TCD_t;
+
+	TCD_t *TCD;
+};
+
+class DMAChannel : public DMABaseClass
+{
+public:
+	DMAChannel() { init(); }
+	DMAChannel(bool allocate) { init(); if (allocate) begin(); }
+	~DMAChannel();
+
+	void begin(bool force_initialization = false);
+	void triggerAtHardwareEvent(uint8_t source) { this->source = source; }
+	void enable(void) { enabled = true; }
+	void disable(void) { enabled = false; }
+	void attachInterrupt(void (*isr)(void)) { this->isr = isr; }
+	void attachInterrupt(void (*isr)(void), uint8_t) { this->isr = isr; }
+	void detachInterrupt(void) { isr = nullptr; }
+	void clearInterrupt(void) { interruptPending = false; }
+	void clearComplete(void) { }
+	bool complete(void) { return false; }
+	bool error(void) { return false; }
+
+	uint8_t channel;
+
+	// simulator state, not part of the Teensyduino API
+	TCD_t tcd;
+	uint8_t source;
+	bool enabled;
+	bool interruptPending;
+	void (*isr)(void);
+
+private:
+	void init();
+};
@@ -0,0 +1,190 @@
+/* Host build of the Teensy 4 I2S TDM library
+ *
+ * Stand-in for the Teensyduino SD library on top of stdio, so WavWriter compiles and
+ * writes real files on Linux. Paths are relative to the working directory. Only the
+ * calls the library uses are provided, with the same signatures as the SdFat based
+ * File of Teensyduino 1.54 and later, and the SdFat FsFile behind SD.sdfs.
+ *
+ * The card is exFAT unless SD.sdfs.setFatType(FAT_TYPE_FAT32) makes it FAT, which only
+ * changes what preAllocate() does to the file size.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define FILE_READ  0
+#define FILE_WRITE 1
+#define FILE_WRITE_BEGIN 2
+
+#define BUILTIN_SDCARD 254
+
+class File
+{
+public:
+	File() : fp(nullptr) { }
+	explicit File(FILE* fp) : fp(fp) { }
+
+	operator bool() const { return fp != nullptr; }
+
+	size_t write(const void* buf, size_t size) { return fp ? fwrite(buf, 1, size, fp) : 0; }
+	size_t write(uint8_t c) { return write(&c, 1); }
+	int read(void* buf, size_t size) { return fp ? (int)fread(buf, 1, size, fp) : -1; }
+	int read() { uint8_t c; return read(&c, 1) == 1 ? c : -1; }
+	int available() { return fp ? (int)(size() - position()) : 0; }
+
+	bool seek(uint64_t pos) { return fp && fseeko(fp, (off_t)pos, SEEK_SET) == 0; }
+	uint64_t position() { return fp ? (uint64_t)ftello(fp) : 0; }
+	uint64_t size()
+	{
+		if (!fp)
+			return 0;
+		off_t pos = ftello(fp);
+		fseeko(fp, 0, SEEK_END);
+		off_t end = ftello(fp);
+		fseeko(fp, pos, SEEK_SET);
+		return (uint64_t)end;
+	}
+	bool truncate(uint64_t size) { return fp && fflush(fp) == 0 && ftruncate(fileno(fp), (off_t)size) == 0; }
+	void flush() { if (fp) fflush(fp); }
+	void close() { if (fp) fclose(fp); fp = nullptr; }
+
+private:
+	FILE* fp;
+};
+
+// SdFat open flags
+#ifndef O_RDONLY
+#define O_RDONLY 0
+#endif
+#define O_READ  O_RDONLY
+#define O_WRITE O_WRONLY
+
+// SdFat volume types, SdFs::fatType()
+#define FAT_TYPE_EXFAT 64
+#define FAT_TYPE_FAT32 32
+#define FAT_TYPE_FAT16 16
+
+class SdFs
+{
+public:
+	bool exists(const char* path) { return access(path, F_OK) == 0; }
+	bool remove(const char* path) { return unlink(path) == 0; }
+
+	uint8_t fatType() const { return fatType_; }
+	// host only: the volume type the next opened files see
+	void setFatType(uint8_t type) { fatType_ = type; }
+
+private:
+	uint8_t fatType_ = FAT_TYPE_EXFAT;
+};
+
+// SdFat file, what SD.sdfs opens
+class FsFile
+{
+public:
+	FsFile() : fp(nullptr), fat(false) { }
+
+	bool open(SdFs* fs, const char* path, int oflag = O_RDONLY)
+	{
+		close();
+		fat = fs && fs->fatType() != FAT_TYPE_EXFAT;
+		int fd = ::open(path, oflag, 0644);
+		if (fd < 0)
+			return false;
+		fp = fdopen(fd, (oflag & O_ACCMODE) == O_RDONLY ? "rb" : "r+b");
+		return fp != nullptr;
+	}
+
+	operator bool() const { return fp != nullptr; }
+	bool isOpen() const { return fp != nullptr; }
+
+	size_t write(const void* buf, size_t size) { return fp ? fwrite(buf, 1, size, fp) : 0; }
+	int read(void* buf, size_t size) { return fp ? (int)fread(buf, 1, size, fp) : -1; }
+
+	bool seekSet(uint64_t pos) { return fp && fseeko(fp, (off_t)pos, SEEK_SET) == 0; }
+	uint64_t curPosition() { return fp ? (uint64_t)ftello(fp) : 0; }
+	uint64_t fileSize()
+	{
+		if (!fp)
+			return 0;
+		off_t pos = ftello(fp);
+		fseeko(fp, 0, SEEK_END);
+		off_t end = ftello(fp);
+		fseeko(fp, pos, SEEK_SET);
+		return (uint64_t)end;
+	}
+
+	// Reserves `length` bytes of disk space for an empty file. exFAT keeps the file size
+	// at 0. FAT sets it to `length` at once, over clusters that still hold what the card
+	// held before, here noise.
+	bool preAllocate(uint64_t length)
+	{
+		if (!fp || fileSize() != 0)
+			return false;
+		if (fat)
+		{
+			uint8_t stale[4096];
+			uint32_t x = 0x9E3779B9u;
+			for (uint64_t left = length; left > 0;)
+			{
+				size_t n = left < sizeof(stale) ? (size_t)left : sizeof(stale);
+				for (size_t i = 0; i < n; i++)
+				{
+					x = x * 1664525u + 1013904223u;
+					stale[i] = (uint8_t)(x >> 24);
+				}
+				if (fwrite(stale, 1, n, fp) != n)
+					return false;
+				left -= n;
+			}
+			return seekSet(0);
+		}
+#ifdef FALLOC_FL_KEEP_SIZE
+		return fallocate(fileno(fp), FALLOC_FL_KEEP_SIZE, 0, (off_t)length) == 0;
+#else
+		return true;
+#endif
+	}
+
+	// Cuts the file at `length` and releases the space after it, preallocated or not
+	bool truncate(uint64_t length) { return fp && fflush(fp) == 0 && ftruncate(fileno(fp), (off_t)length) == 0 && seekSet(length); }
+	bool sync() { return fp && fflush(fp) == 0; }
+	bool close()
+	{
+		bool ok = fp && fclose(fp) == 0;
+		fp = nullptr;
+		return ok;
+	}
+
+private:
+	FILE* fp;
+	bool fat; // preAllocate() sets the file size
+};
+
+class SDClass
+{
+public:
+	SdFs sdfs;
+
+	bool begin(uint8_t csPin = BUILTIN_SDCARD) { return true; }
+	bool exists(const char* path) { return access(path, F_OK) == 0; }
+	bool remove(const char* path) { return unlink(path) == 0; }
+
+	// FILE_WRITE appends to an existing file like the SD library, FILE_WRITE_BEGIN writes from the start
+	File open(const char* path, uint8_t mode = FILE_READ)
+	{
+		if (mode == FILE_READ)
+			return File(fopen(path, "rb"));
+		FILE* fp = fopen(path, "r+b");
+		if (!fp)
+			fp = fopen(path, "w+b");
+		if (fp && mode == FILE_WRITE)
+			fseeko(fp, 0, SEEK_END);
+		return File(fp);
+	}
+};
+
+extern SDClass SD;
@@ -0,0 +1,136 @@
+/* Host build of the Teensy 4 I2S TDM library
+ *
+ * The i.MX RT1062 registers used by the library, modelled as plain memory.
+ * Field macros follow the layout of the reference manual so the simulator can decode
+ * the SAI frame size, word width and clock dividers the library programs.
+ */
+#pragma once
+
+#include <stdint.h>
+
+// Registers the simulator only stores
+extern volatile uint32_t I2S1_TCSR, I2S1_TCR1, I2S1_TCR2, I2S1_TCR3, I2S1_TCR4, I2S1_TCR5, I2S1_TMR;
+extern volatile uint32_t I2S1_RCSR, I2S1_RCR1, I2S1_RCR2, I2S1_RCR3, I2S1_RCR4, I2S1_RCR5, I2S1_RMR;
+extern volatile uint32_t I2S1_TDR0, I2S1_RDR0;
+extern volatile uint32_t CCM_CCGR5, CCM_CSCMR1, CCM_CS1CDR, IOMUXC_GPR_GPR1;
+extern volatile uint32_t CCM_ANALOG_MISC2, CCM_ANALOG_PLL_AUDIO_NUM, CCM_ANALOG_PLL_AUDIO_DENOM;
+extern volatile uint32_t CORE_PIN7_CONFIG, CORE_PIN8_CONFIG, CORE_PIN20_CONFIG, CORE_PIN21_CONFIG, CORE_PIN23_CONFIG;
+extern volatile uint32_t IOMUXC_SAI1_RX_DATA0_SELECT_INPUT;
+
+// SAI transmit/receive control
+#define I2S_TCSR_TE             ((uint32_t)(1u << 31))
+#define I2S_TCSR_BCE            ((uint32_t)(1u << 28))
+#define I2S_TCSR_FR             ((uint32_t)(1u << 25))
+#define I2S_TCSR_SR             ((uint32_t)(1u << 24))
+#define I2S_TCSR_FRDE           ((uint32_t)(1u << 0))
+#define I2S_RCSR_RE             ((uint32_t)(1u << 31))
+#define I2S_RCSR_BCE            ((uint32_t)(1u << 28))
+#define I2S_RCSR_FR             ((uint32_t)(1u << 25))
+#define I2S_RCSR_SR             ((uint32_t)(1u << 24))
+#define I2S_RCSR_FRDE           ((uint32_t)(1u << 0))
+
+#define I2S_TCR1_RFW(n)         ((uint32_t)((n) & 0x1F))
+#define I2S_RCR1_RFW(n)         ((uint32_t)((n) & 0x1F))
+
+#define I2S_TCR2_SYNC(n)        ((uint32_t)(((n) & 0x03) << 30))
+#define I2S_TCR2_MSEL(n)        ((uint32_t)(((n) & 0x03) << 26))
+#define I2S_TCR2_BCP            ((uint32_t)(1u << 25))
+#define I2S_TCR2_BCD            ((uint32_t)(1u << 24))
+#define I2S_TCR2_DIV(n)         ((uint32_t)((n) & 0xFF))
+#define I2S_RCR2_SYNC(n)        ((uint32_t)(((n) & 0x03) << 30))
+#define I2S_RCR2_MSEL(n)        ((uint32_t)(((n) & 0x03) << 26))
+#define I2S_RCR2_BCP            ((uint32_t)(1u << 25))
+#define I2S_RCR2_BCD            ((uint32_t)(1u << 24))
+#define I2S_RCR2_DIV(n)         ((uint32_t)((n) & 0xFF))
+
+#define I2S_TCR3_TCE            ((uint32_t)(1u << 16))
+#define I2S_RCR3_RCE            ((uint32_t)(1u << 16))
+
+#define I2S_TCR4_FRSZ(n)        ((uint32_t)(((n) & 0x1F) << 16))
+#define I2S_TCR4_SYWD(n)        ((uint32_t)(((n) & 0x1F) << 8))
+#define I2S_TCR4_MF             ((uint32_t)(1u << 4))
+#define I2S_TCR4_FSE            ((uint32_t)(1u << 3))
+#define I2S_TCR4_FSP            ((uint32_t)(1u << 1))
+#define I2S_TCR4_FSD            ((uint32_t)(1u << 0))
+#define I2S_RCR4_FRSZ(n)        ((uint32_t)(((n) & 0x1F) << 16))
+#define I2S_RCR4_SYWD(n)        ((uint32_t)(((n) & 0x1F) << 8))
+#define I2S_RCR4_MF             ((uint32_t)(1u << 4))
+#define I2S_RCR4_FSE            ((uint32_t)(1u << 3))
+#define I2S_RCR4_FSP            ((uint32_t)(1u << 1))
+#define I2S_RCR4_FSD            ((uint32_t)(1u << 0))
+
+#define I2S_TCR5_WNW(n)         ((uint32_t)(((n) & 0x1F) << 24))
+#define I2S_TCR5_W0W(n)         ((uint32_t)(((n) & 0x1F) << 16))
+#define I2S_TCR5_FBT(n)         ((uint32_t)(((n) & 0x1F) << 8))
+#define I2S_RCR5_WNW(n)         ((uint32_t)(((n) & 0x1F) << 24))
+#define I2S_RCR5_W0W(n)         ((uint32_t)(((n) & 0x1F) << 16))
+#define I2S_RCR5_FBT(n)         ((uint32_t)(((n) & 0x1F) << 8))
+
+// Clock gating and SAI1 clock root
+#define CCM_CCGR_ON                             3
+#define CCM_CCGR5_SAI1(n)                       ((uint32_t)(((n) & 0x03) << 18))
+#define CCM_CSCMR1_SAI1_CLK_SEL_MASK            ((uint32_t)(0x03 << 10))
+#define CCM_CSCMR1_SAI1_CLK_SEL(n)              ((uint32_t)(((n) & 0x03) << 10))
+#define CCM_CS1CDR_SAI1_CLK_PRED_MASK           ((uint32_t)(0x07 << 6))
+#define CCM_CS1CDR_SAI1_CLK_PODF_MASK           ((uint32_t)(0x3F))
+#define CCM_CS1CDR_SAI1_CLK_PRED(n)             ((uint32_t)(((n) & 0x07) << 6))
+#define CCM_CS1CDR_SAI1_CLK_PODF(n)             ((uint32_t)((n) & 0x3F))
+#define IOMUXC_GPR_GPR1_SAI1_MCLK1_SEL_MASK     ((uint32_t)(0x07))
+#define IOMUXC_GPR_GPR1_SAI1_MCLK1_SEL(n)       ((uint32_t)((n) & 0x07))
+#define IOMUXC_GPR_GPR1_SAI1_MCLK_DIR           ((uint32_t)(1u << 19))
+
+// PLL4, the audio PLL
+#define CCM_ANALOG_PLL_AUDIO_LOCK               ((uint32_t)(1u << 31))
+#define CCM_ANALOG_PLL_AUDIO_POST_DIV_SELECT(n) ((uint32_t)(((n) & 0x03) << 19))
+#define CCM_ANALOG_PLL_AUDIO_BYPASS             ((uint32_t)(1u << 16))
+#define CCM_ANALOG_PLL_AUDIO_ENABLE             ((uint32_t)(1u << 13))
+#define CCM_ANALOG_PLL_AUDIO_POWERDOWN          ((uint32_t)(1u << 12))
+#define CCM_ANALOG_PLL_AUDIO_DIV_SELECT(n)      ((uint32_t)((n) & 0x7F))
+#define CCM_ANALOG_PLL_AUDIO_NUM_MASK           ((uint32_t)0x3FFFFFFF)
+#define CCM_ANALOG_PLL_AUDIO_DENOM_MASK         ((uint32_t)0x3FFFFFFF)
+#define CCM_ANALOG_MISC2_DIV_MSB                ((uint32_t)(1u << 23))
+#define CCM_ANALOG_MISC2_DIV_LSB                ((uint32_t)(1u << 15))
+
+// The PLL reports lock as soon as it is enabled and powered up
+struct SimPllAudioRegister
+{
+	volatile uint32_t value;
+
+	operator uint32_t() const
+	{
+		uint32_t v = value;
+		if ((v & CCM_ANALOG_PLL_AUDIO_ENABLE) && !(v & CCM_ANALOG_PLL_AUDIO_POWERDOWN))
+			v |= CCM_ANALOG_PLL_AUDIO_LOCK;
+		return v;
+	}
+	SimPllAudioRegister& operator=(uint32_t v) { value = v; return *this; }
+	SimPllAudioRegister& operator&=(uint32_t v) { value = value & v; return *this; }
+	SimPllAudioRegister& operator|=(uint32_t v) { value = value | v; return *this; }
+};
+extern SimPllAudioRegister CCM_ANALOG_PLL_AUDIO;
+
+// DMA request sources
+#define DMAMUX_SOURCE_SAI1_RX   19
+#define DMAMUX_SOURCE_SAI1_TX   20
+
+// Interrupts. The DMA interrupts are dispatched by the simulator, the software
+// interrupt runs after the DMA interrupt that pended it has returned.
+enum IRQ_NUMBER_t
+{
+	IRQ_DMA_CH0 = 0,
+	IRQ_SOFTWARE = 70,
+	NVIC_NUM_INTERRUPTS = 160
+};
+
+void sim_nvic_enable_irq(int irq);
+void sim_nvic_disable_irq(int irq);
+void sim_nvic_set_pending(int irq);
+void sim_nvic_set_priority(int irq, int priority);
+int sim_nvic_is_enabled(int irq);
+void attachInterruptVector(enum IRQ_NUMBER_t irq, void (*function)(void));
+
+#define NVIC_ENABLE_IRQ(n)        sim_nvic_enable_irq(n)
+#define NVIC_DISABLE_IRQ(n)       sim_nvic_disable_irq(n)
+#define NVIC_SET_PENDING(n)       sim_nvic_set_pending(n)
+#define NVIC_SET_PRIORITY(n, p)   sim_nvic_set_priority(n, p)
+#define NVIC_IS_ENABLED(n)        sim_nvic_is_enabled(n)
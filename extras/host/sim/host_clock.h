@@ -0,0 +1,39 @@
+/* Host build of the Teensy 4 I2S TDM library
+ *
+ * Cycle clock for the host benchmarks, the stand-in for the Teensy's DWT cycle counter:
+ * the TSC on x86, calibrated against the monotonic clock, else the monotonic clock itself.
+ * Provides what the shared benchmark code expects of a Clock, `static uint32_t cycles()`
+ * and `static double nsPerCycle()`.
+ */
+#pragma once
+
+#include "sim.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+
+struct HostClock
+{
+	static uint32_t cycles() { return (uint32_t)__rdtsc(); }
+	static double nsPerCycle() { return scale; }
+
+	// TSC ticks against the monotonic clock over 50 ms
+	static void calibrate()
+	{
+		uint64_t ns0 = sim::hostNs();
+		uint64_t c0 = __rdtsc();
+		while (sim::hostNs() - ns0 < 50000000) { }
+		scale = (double)(sim::hostNs() - ns0) / (double)(__rdtsc() - c0);
+	}
+
+	static double scale;
+};
+double HostClock::scale = 1;
+#else
+struct HostClock
+{
+	static uint32_t cycles() { return (uint32_t)sim::hostNs(); }
+	static double nsPerCycle() { return 1; }
+	static void calibrate() { }
+};
+#endif
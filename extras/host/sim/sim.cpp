@@ -0,0 +1,318 @@
+/* Host build of the Teensy 4 I2S TDM library
+ *
+ * Simulated SAI1 + eDMA backend, see sim.h
+ */
+#include <string.h>
+#include <time.h>
+#include "Arduino.h"
+#include "DMAChannel.h"
+#include "SD.h"
+#include "imxrt.h"
+#include "AudioConfig.h"
+#include "sim.h"
+
+volatile uint32_t I2S1_TCSR, I2S1_TCR1, I2S1_TCR2, I2S1_TCR3, I2S1_TCR4, I2S1_TCR5, I2S1_TMR;
+volatile uint32_t I2S1_RCSR, I2S1_RCR1, I2S1_RCR2, I2S1_RCR3, I2S1_RCR4, I2S1_RCR5, I2S1_RMR;
+volatile uint32_t I2S1_TDR0, I2S1_RDR0;
+volatile uint32_t CCM_CCGR5, CCM_CSCMR1, CCM_CS1CDR, IOMUXC_GPR_GPR1;
+volatile uint32_t CCM_ANALOG_MISC2, CCM_ANALOG_PLL_AUDIO_NUM, CCM_ANALOG_PLL_AUDIO_DENOM;
+volatile uint32_t CORE_PIN7_CONFIG, CORE_PIN8_CONFIG, CORE_PIN20_CONFIG, CORE_PIN21_CONFIG, CORE_PIN23_CONFIG;
+volatile uint32_t IOMUXC_SAI1_RX_DATA0_SELECT_INPUT;
+SimPllAudioRegister CCM_ANALOG_PLL_AUDIO;
+
+HostSerial Serial;
+SDClass SD;
+
+namespace
+{
+	const int kMaxChannels = 32;
+
+	DMAChannel* channels[kMaxChannels];
+
+	struct Nvic
+	{
+		bool enabled;
+		bool pending;
+		uint8_t priority;
+		void (*vector)(void);
+	} nvic[NVIC_NUM_INTERRUPTS];
+
+	sim::InputSource inputSource;
+	sim::OutputSink outputSink;
+	double cpuScale = 1.0;
+
+	uint64_t frameCount;
+	double frameTime;      // ns at the start of the current frame, follows sample rate changes
+	uint64_t isrEntryHost; // host time the running interrupt was entered
+	uint64_t lastNow;      // keeps the simulated time monotonic when an interrupt overruns
+	int isrDepth;
+
+	sim::IsrStats txStats, rxStats, swStats;
+	uint64_t dcacheInvalidated, dcacheFlushed;
+
+	int32_t defaultInput(uint64_t frame, unsigned slot)
+	{
+		return (int32_t)((frame << 5) | slot);
+	}
+
+	void discardOutput(uint64_t, unsigned, int32_t) { }
+
+	// Executes a handler as an interrupt: measured on the host clock, micros() moves on
+	// from the time of the interrupt while it runs.
+	void dispatch(void (*handler)(void), sim::IsrStats& stats)
+	{
+		uint64_t start = sim::hostNs();
+		if (isrDepth++ == 0)
+			isrEntryHost = start;
+
+		handler();
+
+		uint64_t elapsed = sim::hostNs() - start;
+		isrDepth--;
+
+		stats.calls++;
+		stats.totalNs += elapsed;
+		if (elapsed > stats.maxNs)
+			stats.maxNs = elapsed;
+	}
+
+	// A lower priority software interrupt can only run once the DMA interrupt that
+	// pended it has returned.
+	void serviceSoftwareInterrupts()
+	{
+		Nvic& sw = nvic[IRQ_SOFTWARE];
+		while (sw.pending && sw.enabled && sw.vector && isrDepth == 0)
+		{
+			sw.pending = false;
+			dispatch(sw.vector, swStats);
+		}
+	}
+
+	void raiseInterrupt(DMAChannel* ch)
+	{
+		ch->interruptPending = true;
+		if (!ch->isr)
+			return;
+
+		dispatch(ch->isr, ch->source == DMAMUX_SOURCE_SAI1_TX ? txStats : rxStats);
+		serviceSoftwareInterrupts();
+	}
+
+	// One minor loop of a channel, followed by the major loop bookkeeping
+	void minorLoop(DMAChannel* ch)
+	{
+		DMABaseClass::TCD_t* tcd = ch->TCD;
+
+		memcpy((void*)tcd->DADDR, (const void*)tcd->SADDR, tcd->NBYTES_MLNO);
+		tcd->SADDR = (const uint8_t*)tcd->SADDR + tcd->SOFF;
+		tcd->DADDR = (uint8_t*)tcd->DADDR + tcd->DOFF;
+		tcd->CITER_ELINKNO = tcd->CITER_ELINKNO - 1;
+
+		if (tcd->CITER_ELINKNO == 0)
+		{
+			tcd->SADDR = (const uint8_t*)tcd->SADDR + tcd->SLAST;
+			tcd->DADDR = (uint8_t*)tcd->DADDR + tcd->DLASTSGA;
+			tcd->CITER_ELINKNO = tcd->BITER_ELINKNO;
+			if (tcd->CSR & DMA_TCD_CSR_INTMAJOR)
+				raiseInterrupt(ch);
+		}
+		else if (tcd->CITER_ELINKNO == tcd->BITER_ELINKNO / 2 && (tcd->CSR & DMA_TCD_CSR_INTHALF))
+		{
+			raiseInterrupt(ch);
+		}
+	}
+
+	unsigned frameSlots(uint32_t cr4)
+	{
+		return ((cr4 >> 16) & 0x1F) + 1;
+	}
+
+	unsigned wordBits(uint32_t cr5)
+	{
+		return ((cr5 >> 24) & 0x1F) + 1;
+	}
+
+	// The received word as it lands in RDR: `bits` bits with the MSB at the first bit index
+	uint32_t receiveWord(int32_t value, uint32_t cr5)
+	{
+		unsigned bits = wordBits(cr5), fbt = (cr5 >> 8) & 0x1F;
+		uint32_t word = bits == 32 ? (uint32_t)value : (uint32_t)value & ((1u << bits) - 1);
+		return fbt + 1 >= bits ? word << (fbt + 1 - bits) : word >> (bits - fbt - 1);
+	}
+
+	// What the transmitter shifts out of TDR, sign-extended from the word width
+	int32_t transmitWord(uint32_t tdr, uint32_t cr5)
+	{
+		unsigned bits = wordBits(cr5), fbt = (cr5 >> 8) & 0x1F;
+		return (int32_t)(tdr << (31 - fbt)) >> (32 - bits);
+	}
+
+	void serviceRequests(uint8_t source)
+	{
+		for (int i = 0; i < kMaxChannels; i++)
+		{
+			DMAChannel* ch = channels[i];
+			if (ch && ch->enabled && ch->source == source)
+				minorLoop(ch);
+		}
+	}
+}
+
+DMAChannel::~DMAChannel()
+{
+	for (int i = 0; i < kMaxChannels; i++)
+	{
+		if (channels[i] == this)
+			channels[i] = nullptr;
+	}
+}
+
+void DMAChannel::init()
+{
+	memset(&tcd, 0, sizeof(tcd));
+	TCD = &tcd;
+	channel = kMaxChannels;
+	source = 0;
+	enabled = false;
+	interruptPending = false;
+	isr = nullptr;
+}
+
+void DMAChannel::begin(bool force_initialization)
+{
+	(void)force_initialization;
+	if (channel < kMaxChannels)
+		return;
+
+	for (int i = 0; i < kMaxChannels; i++)
+	{
+		if (!channels[i])
+		{
+			channels[i] = this;
+			channel = i;
+			return;
+		}
+	}
+}
+
+void sim_nvic_enable_irq(int irq) { nvic[irq].enabled = true; serviceSoftwareInterrupts(); }
+void sim_nvic_disable_irq(int irq) { nvic[irq].enabled = false; }
+void sim_nvic_set_pending(int irq) { nvic[irq].pending = true; }
+void sim_nvic_set_priority(int irq, int priority) { nvic[irq].priority = priority; }
+int sim_nvic_is_enabled(int irq) { return nvic[irq].enabled; }
+void attachInterruptVector(enum IRQ_NUMBER_t irq, void (*function)(void)) { nvic[irq].vector = function; }
+
+void arm_dcache_delete(void *, uint32_t size) { dcacheInvalidated += size; }
+void arm_dcache_flush(void *, uint32_t size) { dcacheFlushed += size; }
+void arm_dcache_flush_delete(void *, uint32_t size) { dcacheFlushed += size; }
+
+uint32_t sim_cycle_count(void) { return (uint32_t)(uint64_t)(sim::nowNs() * (F_CPU_ACTUAL / 1e9)); }
+uint32_t micros(void) { return (uint32_t)(sim::nowNs() / 1000); }
+uint32_t millis(void) { return (uint32_t)(sim::nowNs() / 1000000); }
+void delay(uint32_t msec) { sim::runSeconds(msec / 1000.0); }
+void delayMicroseconds(uint32_t usec) { sim::runSeconds(usec / 1000000.0); }
+
+namespace sim
+{
+	void setInput(InputSource source) { inputSource = source; }
+	void setOutput(OutputSink sink) { outputSink = sink; }
+	void setCpuScale(double scale) { cpuScale = scale; }
+
+	void run(uint64_t count)
+	{
+		InputSource in = inputSource ? inputSource : defaultInput;
+		OutputSink out = outputSink ? outputSink : discardOutput;
+		double framePeriod = 1e9 / sampleRate(); // the format only changes between runs
+
+		for (uint64_t f = 0; f < count; f++)
+		{
+			// the DMA requests are only raised while the FIFO request DMA enable is set
+			bool tx = (I2S1_TCSR & I2S_TCSR_TE) && (I2S1_TCSR & I2S_TCSR_FRDE);
+			bool rx = (I2S1_RCSR & I2S_RCSR_RE) && (I2S1_RCSR & I2S_RCSR_FRDE);
+			unsigned txWords = tx ? frameSlots(I2S1_TCR4) : 0;
+			unsigned rxWords = rx ? frameSlots(I2S1_RCR4) : 0;
+			unsigned words = txWords > rxWords ? txWords : rxWords;
+
+			for (unsigned w = 0; w < words; w++)
+			{
+				if (w < txWords)
+				{
+					serviceRequests(DMAMUX_SOURCE_SAI1_TX);
+					out(frameCount, w, transmitWord(I2S1_TDR0, I2S1_TCR5));
+				}
+				if (w < rxWords)
+				{
+					I2S1_RDR0 = receiveWord(in(frameCount, w), I2S1_RCR5);
+					serviceRequests(DMAMUX_SOURCE_SAI1_RX);
+				}
+			}
+
+			frameCount++;
+			frameTime += framePeriod;
+		}
+	}
+
+	void runSeconds(double seconds)
+	{
+		run((uint64_t)(seconds * sampleRate() + 0.5));
+	}
+
+	uint64_t frames() { return frameCount; }
+
+	uint64_t nowNs()
+	{
+		uint64_t t = (uint64_t)frameTime;
+		if (isrDepth > 0)
+			t += (uint64_t)((hostNs() - isrEntryHost) * cpuScale);
+		if (t < lastNow)
+			t = lastNow;
+		lastNow = t;
+		return t;
+	}
+
+	double sampleRate()
+	{
+		uint32_t pll = CCM_ANALOG_PLL_AUDIO;
+		uint32_t denom = CCM_ANALOG_PLL_AUDIO_DENOM;
+		uint32_t slots = frameSlots(I2S1_TCR4);
+		uint32_t wordWidth = wordBits(I2S1_TCR5);
+		if (!(pll & CCM_ANALOG_PLL_AUDIO_LOCK) || denom == 0 || !(I2S1_TCR2 & I2S_TCR2_BCD))
+			return SAMPLERATE;
+
+		static const double postDiv[4] = { 4, 2, 1, 1 };
+		double freq = 24e6 * ((pll & 0x7F) + (double)CCM_ANALOG_PLL_AUDIO_NUM / denom);
+		freq /= postDiv[(pll >> 19) & 0x03];
+		if (CCM_ANALOG_MISC2 & CCM_ANALOG_MISC2_DIV_LSB)
+			freq /= (CCM_ANALOG_MISC2 & CCM_ANALOG_MISC2_DIV_MSB) ? 4 : 2;
+
+		double mclk = freq / (((CCM_CS1CDR >> 6) & 0x07) + 1) / ((CCM_CS1CDR & 0x3F) + 1);
+		double bclk = mclk / (((I2S1_TCR2 & 0xFF) + 1) * 2);
+		return bclk / (slots * wordWidth);
+	}
+
+	unsigned txSlots() { return frameSlots(I2S1_TCR4); }
+	unsigned rxSlots() { return frameSlots(I2S1_RCR4); }
+
+	const IsrStats& txIsr() { return txStats; }
+	const IsrStats& rxIsr() { return rxStats; }
+	const IsrStats& softwareIsr() { return swStats; }
+
+	void clearStats()
+	{
+		txStats = IsrStats();
+		rxStats = IsrStats();
+		swStats = IsrStats();
+		dcacheInvalidated = 0;
+		dcacheFlushed = 0;
+	}
+
+	uint64_t dcacheInvalidatedBytes() { return dcacheInvalidated; }
+	uint64_t dcacheFlushedBytes() { return dcacheFlushed; }
+
+	uint64_t hostNs()
+	{
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+	}
+}
@@ -0,0 +1,66 @@
+/* Host build of the Teensy 4 I2S TDM library
+ *
+ * Simulated SAI1 + eDMA backend. The simulator clocks frames through the SAI at the
+ * sample rate decoded from the PLL4 / SAI divider registers, executes the DMA minor
+ * loops for every TDM word and calls the attached DMA interrupts at the half and major
+ * loop points, exactly where the hardware would. Everything runs as fast as the host
+ * allows, time seen by micros() follows the simulated sample clock.
+ *
+ * While an interrupt runs, micros() advances from the time of the interrupt by the
+ * host time spent in it (scaled by setCpuScale), so the library's Timers report a CPU
+ * load relative to the simulated block period.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace sim
+{
+	// Provides the word the codec sends in TDM slot `slot` of frame `frame`. Only the low
+	// word width bits count (W0W/WNW + 1, 16, 24 or 32): like the SAI, the simulator puts
+	// them into the receive data register at the first bit index (FBT) and zeroes the rest.
+	typedef int32_t (*InputSource)(uint64_t frame, unsigned slot);
+	// Receives the word the Teensy transmits in TDM slot `slot` of frame `frame`: the word
+	// width bits of the transmit data register from FBT down, sign-extended
+	typedef void (*OutputSink)(uint64_t frame, unsigned slot, int32_t value);
+
+	struct IsrStats
+	{
+		uint64_t calls;
+		uint64_t totalNs;
+		uint64_t maxNs;
+	};
+
+	void setInput(InputSource source);
+	void setOutput(OutputSink sink);
+
+	// Host nanoseconds inside an interrupt are multiplied by this factor before they are
+	// added to the simulated time. Use it to approximate a slower target CPU.
+	void setCpuScale(double scale);
+
+	// Clocks `frames` SAI frames through the DMA channels.
+	void run(uint64_t frames);
+	void runSeconds(double seconds);
+
+	uint64_t frames();
+	uint64_t nowNs();
+
+	// Sample rate decoded from the PLL4, SAI1 clock root and SAI bit clock registers.
+	// Falls back to SAMPLERATE as long as the clocks are not configured.
+	double sampleRate();
+	// Number of words in a SAI frame (FRSZ + 1) for the transmitter and receiver
+	unsigned txSlots();
+	unsigned rxSlots();
+
+	const IsrStats& txIsr();
+	const IsrStats& rxIsr();
+	const IsrStats& softwareIsr();
+	void clearStats();
+
+	uint64_t dcacheInvalidatedBytes();
+	uint64_t dcacheFlushedBytes();
+
+	// Host monotonic clock in nanoseconds, for benchmarks
+	uint64_t hostNs();
+}
@@ -0,0 +1,60 @@
+#!/usr/bin/env python3
+"""Compares two kernel_bench CSV files and fails when a kernel got slower.
+
+    bench_compare.py baseline.csv current.csv [--threshold 10] [--min-cycles 20]
+
+Rows are matched on kernel, channels and block. A row whose cycles per block grew by
+more than the threshold (percent) is a regression; rows below --min-cycles in both runs
+are only reported, they are too short to time reliably. Works on host and Teensy output
+alike, but only compare runs from the same machine. Exits with 1 on any regression.
+"""
+import argparse
+import csv
+import sys
+
+
+def load(path):
+    rows = {}
+    with open(path) as f:
+        lines = [line for line in f if line.strip() and not line.startswith("#")]
+    for row in csv.DictReader(lines):
+        key = (row["kernel"], int(row["channels"]), int(row["block"]))
+        rows[key] = float(row["cycles_per_block"])
+    return rows
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    parser.add_argument("--threshold", type=float, default=10.0)
+    parser.add_argument("--min-cycles", type=float, default=20.0)
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    current = load(args.current)
+    regressions = 0
+
+    for key in sorted(set(baseline) & set(current)):
+        before, after = baseline[key], current[key]
+        if before <= 0:
+            continue
+        change = (after - before) / before * 100
+        if abs(change) <= args.threshold:
+            continue
+        noisy = before < args.min_cycles and after < args.min_cycles
+        slower = change > 0 and not noisy
+        regressions += slower
+        print("%-12s %-40s %2d ch %4d block  %10.1f -> %10.1f cycles  %+6.1f %%%s" % (
+            "REGRESSION" if slower else ("noise" if noisy else "faster"),
+            key[0], key[1], key[2], before, after, change, ""))
+
+    for key in sorted(set(baseline) - set(current)):
+        print("missing      %-40s %2d ch %4d block" % key)
+
+    print("%d rows compared, %d regressions over %.0f %%" % (len(set(baseline) & set(current)), regressions, args.threshold))
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,76 @@
+#!/usr/bin/env python3
+"""Converts the text audio_trace::drain() prints into Chrome trace_event JSON.
+
+Reads a Serial capture (or the output of trace_dump) from a file or stdin, ignores
+every line that is not part of the trace and writes JSON for chrome://tracing or
+https://ui.perfetto.dev:
+
+    trace2json.py capture.txt > trace.json
+
+Each "# audio_trace <cpu hz> <dropped>" line sets the clock for the cycle stamps that
+follow; the DWT counter wraps every few seconds, so the stamps are unwrapped against
+the previous event. Interrupts preempt each other and loop() strictly nested, so all
+spans share one track; queue fill levels become counter tracks.
+"""
+import json
+import sys
+
+
+def convert(lines):
+    events = []
+    hz = 600e6
+    dropped = 0
+    prev = None
+    now = 0
+
+    for line in lines:
+        line = line.strip()
+        if line.startswith("# audio_trace "):
+            fields = line.split()
+            hz = float(fields[2])
+            if int(fields[3]) > dropped:
+                events.append({"name": "dropped %d" % (int(fields[3]) - dropped), "ph": "i", "s": "g",
+                               "ts": now / hz * 1e6, "pid": 1, "tid": 1})
+                dropped = int(fields[3])
+            continue
+
+        fields = line.split()
+        if len(fields) < 4 or not fields[0].isdigit() or fields[1] not in ("B", "E", "i", "C"):
+            continue
+        cycles = int(fields[0])
+        phase = fields[1]
+        name = " ".join(fields[2:-1])
+        try:
+            arg = int(fields[-1])
+        except ValueError:
+            continue
+
+        # signed 32 bit difference: events written by a preempted context can be a little older
+        if prev is not None:
+            delta = (cycles - prev) & 0xFFFFFFFF
+            if delta >= 0x80000000:
+                delta -= 0x100000000
+            now += delta
+        prev = cycles
+
+        event = {"name": name, "ph": phase, "ts": now / hz * 1e6, "pid": 1, "tid": 1}
+        if phase == "C":
+            event["args"] = {"available": arg}
+        elif phase == "i":
+            event["s"] = "t"
+            event["args"] = {"arg": arg}
+        elif arg:
+            event["args"] = {"arg": arg}
+        events.append(event)
+
+    return {"traceEvents": events, "displayTimeUnit": "ns"}
+
+
+def main():
+    source = open(sys.argv[1]) if len(sys.argv) > 1 else sys.stdin
+    json.dump(convert(source), sys.stdout, indent=None, separators=(",", ":"))
+    sys.stdout.write("\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -1,10 +1,15 @@
 #include "i2s_timers.h"
-
-float Timers::TimeAvg[Timers::TIMER_COUNT];
-float Timers::TimePeak[Timers::TIMER_COUNT];
-float Timers::TimeMax[Timers::TIMER_COUNT];
-int Timers::TimeFrameStart = 0;
-float Timers::TimeFramePeriod = 1333.33f; // 64 sample blocks at 48khz
+#include "profile_zone.h"
+
+uint32_t Timers::CyclesAvgQ8[Timers::TIMER_COUNT];
+uint32_t Timers::CyclesPeak[Timers::TIMER_COUNT];
+uint32_t Timers::CyclesMax[Timers::TIMER_COUNT];
+#if AUDIO_TIMER_HISTOGRAM
+CycleHistogram Timers::Histograms[Timers::TIMER_COUNT];
+#endif
+bool Timers::FrameStarted = false;
+uint32_t Timers::FrameStartCycles = 0;
+uint32_t Timers::FramePeriodQ8 = 0;
 
 void Timers::Lap(uint8_t timerIndex)
 {
@@ -19,16 +24,77 @@ void Timers::LapInner(uint8_t timerIndex)
     if (timerIndex >= TIMER_COUNT)
         return;
 
-    int val = float(micros() - TimeFrameStart);
-    
-    TimeAvg[timerIndex] = 0.995 * TimeAvg[timerIndex] + 0.005 * val;
-    
-    TimePeak[timerIndex] = 0.995 * TimePeak[timerIndex];
-    if (val > TimePeak[timerIndex])
-        TimePeak[timerIndex] = val;
+    // unsigned difference, correct across the counter wrapping around
+    uint32_t val = Cycles() - FrameStartCycles;
+
+    // avg = avg * 255/256 + val / 256, in Q8
+    CyclesAvgQ8[timerIndex] += val - (CyclesAvgQ8[timerIndex] >> 8);
+
+    CyclesPeak[timerIndex] -= CyclesPeak[timerIndex] >> 8;
+    if (val > CyclesPeak[timerIndex])
+        CyclesPeak[timerIndex] = val;
 
-    if (val > TimeMax[timerIndex])
-        TimeMax[timerIndex] = val;
+    if (val > CyclesMax[timerIndex])
+        CyclesMax[timerIndex] = val;
+
+#if AUDIO_TIMER_HISTOGRAM
+    Histograms[timerIndex].record(val);
+#endif
+}
+
+uint32_t Timers::GetAvgCycles(uint8_t timerIndex)
+{
+    if (timerIndex >= TIMER_COUNT)
+        return 0;
+
+    return Timers::CyclesAvgQ8[timerIndex] >> 8;
+}
+
+uint32_t Timers::GetPeakCycles(uint8_t timerIndex)
+{
+    if (timerIndex >= TIMER_COUNT)
+        return 0;
+
+    return Timers::CyclesPeak[timerIndex];
+}
+
+uint32_t Timers::GetMaxCycles(uint8_t timerIndex)
+{
+    if (timerIndex >= TIMER_COUNT)
+        return 0;
+
+    return Timers::CyclesMax[timerIndex];
+}
+
+#if AUDIO_TIMER_HISTOGRAM
+uint32_t Timers::GetPercentileCycles(uint8_t timerIndex, float percent)
+{
+    if (timerIndex >= TIMER_COUNT)
+        return 0;
+
+    return Timers::Histograms[timerIndex].percentile(percent);
+}
+
+float Timers::GetPercentile(uint8_t timerIndex, float percent)
+{
+    if (timerIndex >= TIMER_COUNT)
+        return -1;
+
+    return CyclesToMicros(GetPercentileCycles(timerIndex, percent));
+}
+
+uint32_t Timers::GetCount(uint8_t timerIndex)
+{
+    if (timerIndex >= TIMER_COUNT)
+        return 0;
+
+    return Timers::Histograms[timerIndex].count();
+}
+#endif
+
+uint32_t Timers::GetAvgPeriodCycles()
+{
+    return FramePeriodQ8 >> 8;
 }
 
 float Timers::GetAvg(uint8_t timerIndex)
@@ -36,7 +102,7 @@ float Timers::GetAvg(uint8_t timerIndex)
     if (timerIndex >= TIMER_COUNT)
         return -1;
 
-    return Timers::TimeAvg[timerIndex];
+    return CyclesToMicros(Timers::CyclesAvgQ8[timerIndex]) / 256;
 }
 
 float Timers::GetPeak(uint8_t timerIndex)
@@ -44,7 +110,7 @@ float Timers::GetPeak(uint8_t timerIndex)
     if (timerIndex >= TIMER_COUNT)
         return -1;
 
-    return Timers::TimePeak[timerIndex];
+    return CyclesToMicros(Timers::CyclesPeak[timerIndex]);
 }
 
 float Timers::GetMax(uint8_t timerIndex)
@@ -52,7 +118,7 @@ float Timers::GetMax(uint8_t timerIndex)
     if (timerIndex >= TIMER_COUNT)
         return -1;
 
-    return Timers::TimeMax[timerIndex];
+    return CyclesToMicros(Timers::CyclesMax[timerIndex]);
 }
 
 void Timers::Clear(uint8_t timerIndex)
@@ -60,30 +126,51 @@ void Timers::Clear(uint8_t timerIndex)
     if (timerIndex >= TIMER_COUNT)
         return;
 
-    Timers::TimeAvg[timerIndex] = 0;
-    Timers::TimePeak[timerIndex] = 0;
-    Timers::TimeMax[timerIndex] = 0;
+    // the audio interrupt may lap this timer while it is cleared
+    __disable_irq();
+    Timers::CyclesAvgQ8[timerIndex] = 0;
+    Timers::CyclesPeak[timerIndex] = 0;
+    Timers::CyclesMax[timerIndex] = 0;
+#if AUDIO_TIMER_HISTOGRAM
+    Timers::Histograms[timerIndex].clear();
+#endif
+    __enable_irq();
 }
 
 float Timers::GetAvgPeriod()
 {
-    return TimeFramePeriod;
+    return CyclesToMicros(FramePeriodQ8) / 256;
 }
 
 float Timers::GetCpuLoad()
 {
-    return Timers::TimeAvg[Timers::TIMER_TOTAL] / TimeFramePeriod;
+    if (FramePeriodQ8 == 0)
+        return 0;
+
+    return (float)Timers::CyclesAvgQ8[Timers::TIMER_TOTAL] / FramePeriodQ8;
 }
 
 void Timers::ResetFrame()
 {
-    if (TimeFrameStart == 0)
+#if AUDIO_PROFILE
+    // the zones sum their cycles per block
+    ProfileZone::EndBlock();
+#endif
+
+    uint32_t now = Cycles();
+    if (!FrameStarted)
     {
-        TimeFrameStart = micros();
+        FrameStarted = true;
+        FrameStartCycles = now;
         return;
     }
 
-    int oldStart = TimeFrameStart;
-    TimeFrameStart = micros();
-    TimeFramePeriod = 0.995f * TimeFramePeriod + 0.005f * (TimeFrameStart - oldStart);
+    uint32_t period = now - FrameStartCycles;
+    FrameStartCycles = now;
+
+    // the first period seeds the average, after that the same EMA as the timers
+    if (FramePeriodQ8 == 0)
+        FramePeriodQ8 = period << 8;
+    else
+        FramePeriodQ8 += period - (FramePeriodQ8 >> 8);
 }
@@ -1,17 +1,34 @@
 #pragma once
 
 #include "Arduino.h"
+#include "AudioConfig.h"
+#if AUDIO_TIMER_HISTOGRAM
+#include "utility/cycle_histogram.h"
+#endif
 class AudioOutputI2S;
 
+// Processing time per block, measured with the DWT cycle counter (ARM_DWT_CYCCNT, enabled
+// by the Teensy 4 startup code; on the host it follows the simulated clock).
+// Lap() records the cycles since the start of the current block for a timer index.
+// The statistics are kept in integer cycles, the float getters convert to microseconds
+// (or a fraction of the block period) when they are read.
 class Timers
 {
     friend class AudioOutputI2S;
 public:
     static const int TIMER_COUNT = 20;
     static const uint8_t TIMER_TOTAL = 19;
-    static float TimeAvg[TIMER_COUNT];
-    static float TimePeak[TIMER_COUNT];
-    static float TimeMax[TIMER_COUNT];
+
+    // The averages are exponential moving averages over ~256 blocks, stored as cycles * 256.
+    // The peak decays at the same rate, the max holds until Clear().
+    static uint32_t CyclesAvgQ8[TIMER_COUNT];
+    static uint32_t CyclesPeak[TIMER_COUNT];
+    static uint32_t CyclesMax[TIMER_COUNT];
+
+#if AUDIO_TIMER_HISTOGRAM
+    // Every lap also goes into a log-bucketed histogram, for the percentiles
+    static CycleHistogram Histograms[TIMER_COUNT];
+#endif
 
     static void Lap(uint8_t timerIndex);
     static float GetAvg(uint8_t timerIndex=0);
@@ -20,9 +37,26 @@ public:
     static void Clear(uint8_t timerIndex=0);
     static float GetAvgPeriod();
     static float GetCpuLoad();
+
+    static uint32_t GetAvgCycles(uint8_t timerIndex=0);
+    static uint32_t GetPeakCycles(uint8_t timerIndex=0);
+    static uint32_t GetMaxCycles(uint8_t timerIndex=0);
+    static uint32_t GetAvgPeriodCycles();
+
+#if AUDIO_TIMER_HISTOGRAM
+    // Percentile (e.g. 50, 99, 99.9) of all laps since Clear(), within 1/8 of the value.
+    static float GetPercentile(uint8_t timerIndex, float percent);
+    static uint32_t GetPercentileCycles(uint8_t timerIndex, float percent);
+    static uint32_t GetCount(uint8_t timerIndex=0);
+#endif
+
+    static inline uint32_t Cycles() { return ARM_DWT_CYCCNT; }
+    static inline float CyclesToMicros(uint32_t cycles) { return cycles * (1e6f / F_CPU_ACTUAL); }
+
 private:
-    static int TimeFrameStart;
-    static float TimeFramePeriod;
+    static bool FrameStarted;
+    static uint32_t FrameStartCycles;
+    static uint32_t FramePeriodQ8;
     static void ResetFrame();
     static void LapInner(uint8_t timerIndex);
 };
@@ -26,11 +26,18 @@
 
 #include "AudioConfig.h"
 #include "input_i2s_tdm.h"
-
-DMAMEM __attribute__((aligned(32))) static uint32_t i2s_rx_buffer[AUDIO_BLOCK_SAMPLES * CHANNELS];
-BufferQueue AudioInputI2S::buffers;
+#include "output_i2s_tdm.h"
+
+DMAMEM __attribute__((aligned(32))) static uint32_t i2s_rx_buffer[AUDIO_DMA_HALF_FRAMES * CHANNELS * 2];
+#if !AUDIO_ZERO_COPY
+#if AUDIO_DEFERRED_PROCESSING
+BufferQueue<CHANNELS, audio_sample_t> AudioInputI2S::buffers(0, "in queue"); // blocks are processed as soon as they arrive
+#else
+BufferQueue<CHANNELS, audio_sample_t> AudioInputI2S::buffers(BUFFER_QUEUE_SIZE - 1, "in queue");
+#endif
+static audio_sample_t* outBuffers[CHANNELS]; // temporary holder for the values returned by getData
+#endif
 DMAChannel AudioInputI2S::dma(false);
-int32_t* outBuffers[4]; // temporary holder for the values returned by getData
 
 void AudioInputI2S::begin()
 {
@@ -39,7 +46,7 @@ void AudioInputI2S::begin()
 	CORE_PIN8_CONFIG  = 3;  //1:RX_DATA0
 	IOMUXC_SAI1_RX_DATA0_SELECT_INPUT = 2;
 
-	dma.TCD->SADDR = (void *)((uint32_t)&I2S1_RDR0 + 0) ; // source address, read from 0 byte offset as we want the full 32 bits
+	dma.TCD->SADDR = (void *)((uintptr_t)&I2S1_RDR0 + 0) ; // source address, read from 0 byte offset as we want the full 32 bits
 	dma.TCD->SOFF = 0; // how many bytes to jump from current address on the next move. We're always reading the same register so no jump.
 	dma.TCD->ATTR = DMA_TCD_ATTR_SSIZE(2) | DMA_TCD_ATTR_DSIZE(2); // 1=16bits, 2=32 bits. size of source, size of dest
 	dma.TCD->NBYTES_MLNO = 4; // number of bytes to move, minor loop.
@@ -47,7 +54,7 @@ void AudioInputI2S::begin()
 	dma.TCD->DADDR = i2s_rx_buffer; // Destination address.
 	dma.TCD->DOFF = 4; // how many bytes to move the destination at each minor loop. jump 4 bytes.
 	dma.TCD->CITER_ELINKNO = sizeof(i2s_rx_buffer) / 4; // how many iterations are in the major loop
-	dma.TCD->DLASTSGA = -sizeof(i2s_rx_buffer); // how many bytes to jump the destination address at the end of the major loop
+	dma.TCD->DLASTSGA = -(int32_t)sizeof(i2s_rx_buffer); // how many bytes to jump the destination address at the end of the major loop
 	dma.TCD->BITER_ELINKNO = sizeof(i2s_rx_buffer) / 4; // beginning iteration count
 	dma.TCD->CSR = DMA_TCD_CSR_INTHALF | DMA_TCD_CSR_INTMAJOR; // Tells the DMA mechanism to trigger interrupt at half and full population of the buffer
 	dma.triggerAtHardwareEvent(DMAMUX_SOURCE_SAI1_RX); // run DMA at hardware event when new I2S data transmitted.
@@ -59,36 +66,114 @@ void AudioInputI2S::begin()
 	dma.attachInterrupt(isr);
 }
 
-int32_t** AudioInputI2S::getData()
+// Starts receiving again from the start of the buffer with a freshly filled queue,
+// called by AudioOutputI2S::setFormat once the SAI is set up for the new format.
+void AudioInputI2S::restart(void)
+{
+	dma.TCD->DADDR = i2s_rx_buffer;
+	dma.TCD->CITER_ELINKNO = dma.TCD->BITER_ELINKNO;
+	dma.clearInterrupt();
+#if AUDIO_DEFERRED_PROCESSING
+	buffers.reset(buffers.depth, 0);
+#elif !AUDIO_ZERO_COPY
+	buffers.reset(buffers.depth, buffers.depth - 1);
+#endif
+	dma.enable();
+
+	I2S1_RCSR = I2S_RCSR_RE | I2S_RCSR_BCE | I2S_RCSR_FRDE | I2S_RCSR_FR;
+}
+
+#if AUDIO_ZERO_COPY
+
+// In zero-copy mode the receive interrupt drives the processing: a half of the buffer
+// has just been completed and stays untouched by the DMA for the next half block.
+void AudioInputI2S::isr(void)
 {
-	outBuffers[0] = buffers.readPtr[0]; 
-  outBuffers[1] = buffers.readPtr[1]; 
-  if (CHANNELS > 2) {
-    outBuffers[2] = buffers.readPtr[2]; 
-    outBuffers[3] = buffers.readPtr[3]; 
-  }
+	AUDIO_TRACE_SCOPE("rx isr");
+	uintptr_t daddr;
+	const int32_t *src;
+
+	daddr = (uintptr_t)(dma.TCD->DADDR);
+	dma.clearInterrupt();
+
+	if (daddr < (uintptr_t)i2s_rx_buffer + sizeof(i2s_rx_buffer) / 2)
+	{
+		// DMA is receiving to the first half of the buffer, the second half is complete
+		src = (int32_t *)&i2s_rx_buffer[AUDIO_DMA_HALF_FRAMES * CHANNELS];
+	}
+	else
+	{
+		// DMA is receiving to the second half of the buffer, the first half is complete
+		src = (int32_t *)&i2s_rx_buffer[0];
+	}
+
+	// drop stale cache lines before the callback reads what the DMA wrote
+	arm_dcache_delete((void*)src, sizeof(i2s_rx_buffer) / 2);
+
+	AudioOutputI2S::processViews(src);
+}
+
+#else
+
+audio_sample_t** AudioInputI2S::getData()
+{
+	for (size_t k = 0; k < CHANNELS; k++)
+	{
+		outBuffers[k] = buffers.readPtr[k];
+	}
 	buffers.consume();
 	return outBuffers;
 }
 
+void AudioInputI2S::setQueueDepth(size_t blocks)
+{
+	__disable_irq();
+#if AUDIO_DEFERRED_PROCESSING
+	buffers.reset(blocks, 0);
+#else
+	buffers.reset(blocks, blocks - 1);
+#endif
+	__enable_irq();
+}
+
+BufferQueueStats AudioInputI2S::getQueueStats()
+{
+	__disable_irq();
+	BufferQueueStats stats = buffers.stats;
+	__enable_irq();
+	return stats;
+}
+
+void AudioInputI2S::clearQueueStats()
+{
+	__disable_irq();
+	buffers.clearStats();
+	__enable_irq();
+}
+
+bool AudioInputI2S::readQueueEvent(BufferQueueEvent& event)
+{
+	return buffers.readEvent(event);
+}
+
 void AudioInputI2S::isr(void)
 {
-	uint32_t daddr, offset;
+	AUDIO_TRACE_SCOPE("rx isr");
+	uintptr_t daddr;
+	uint32_t offset;
 	const int32_t *src;
-	int32_t* dest[CHANNELS];
-  int32_t* temp[CHANNELS];
-  
+	audio_sample_t* dest[CHANNELS];
 	bool incrementQueue;
 
-	daddr = (uint32_t)(dma.TCD->DADDR);
+	daddr = (uintptr_t)(dma.TCD->DADDR);
 	dma.clearInterrupt();
 
-	if (daddr < (uint32_t)i2s_rx_buffer + sizeof(i2s_rx_buffer) / 2) 
+	if (daddr < (uintptr_t)i2s_rx_buffer + sizeof(i2s_rx_buffer) / 2) 
 	{
 		// DMA is receiving to the first half of the buffer
 		// need to remove data from the second half
-		src = (int32_t *)&i2s_rx_buffer[(AUDIO_BLOCK_SAMPLES * CHANNELS / 2)];
-		offset = AUDIO_BLOCK_SAMPLES/2;
+		src = (int32_t *)&i2s_rx_buffer[AUDIO_DMA_HALF_FRAMES * CHANNELS];
+		offset = AUDIO_BLOCK_SAMPLES - AUDIO_DMA_HALF_FRAMES;
 		incrementQueue = true;
 	} 
 	else 
@@ -97,39 +182,32 @@ void AudioInputI2S::isr(void)
 		// need to remove data from the first half
 		src = (int32_t *)&i2s_rx_buffer[0];
 		offset = 0;
-		incrementQueue = false;
+		incrementQueue = AUDIO_HALF_BLOCK_CALLBACK; // in half-block mode every half is a block
 	}
-	
-  temp[0] = buffers.writePtr[0];
-  temp[1] = buffers.writePtr[1];
-  
-  dest[0] = &(temp[0][offset]);
-  dest[1] = &(temp[1][offset]);
-
-  if (CHANNELS > 2) {
-    temp[2] = buffers.writePtr[2];
-    temp[3] = buffers.writePtr[3];
 
-    dest[2] = &(temp[2][offset]);
-    dest[3] = &(temp[3][offset]);
-  }
-
-
-	for (size_t i = 0; i < AUDIO_BLOCK_SAMPLES/2; i++)
+	for (size_t k = 0; k < CHANNELS; k++)
 	{
-	  dest[0][i]  = src[CHANNELS * i + 0];
-    dest[1][i]  = src[CHANNELS * i + 1];
-    
-    if (CHANNELS >2) {
-      dest[2][i]  = src[CHANNELS * i + 2];
-      dest[3][i]  = src[CHANNELS * i + 3];
-    }
-  }
+		dest[k] = &(buffers.writePtr[k][offset]);
+	}
+
+	// split the TDM frames into one buffer per channel
+#if AUDIO_FLOAT_PROCESSING
+	// converting to float, scaled for the word width setFormat() chose
+	tdm_deinterleave<CHANNELS, AUDIO_DMA_HALF_FRAMES>(src, dest, 32 - AudioOutputI2S::getBitDepth());
+#else
+	tdm_deinterleave<CHANNELS, AUDIO_DMA_HALF_FRAMES>(src, dest);
+#endif
 
 	if (incrementQueue)
 	{
 		buffers.publish();
+#if AUDIO_DEFERRED_PROCESSING
+		// a new block is ready for the callback
+		NVIC_SET_PENDING(IRQ_SOFTWARE);
+#endif
 	}
 	
 	arm_dcache_delete((void*)src, sizeof(i2s_rx_buffer) / 2);
 }
+
+#endif
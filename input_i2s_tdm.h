@@ -28,18 +28,33 @@
 
 #include <Arduino.h>
 #include <DMAChannel.h>
+#include "AudioConfig.h"
 #include "buffer_queue.h"
 
 class AudioInputI2S
 {
+	friend class AudioOutputI2S;
 public:
+	static const size_t BlockSamples = AUDIO_BLOCK_SAMPLES; // samples per channel per callback
+
 	AudioInputI2S() { }
 	void begin();
-	static int32_t** getData();
+#if !AUDIO_ZERO_COPY
+	static audio_sample_t** getData();
+
+	// Queue depth in blocks (2 to BUFFER_QUEUE_MAX_SIZE), resets the queue
+	static void setQueueDepth(size_t blocks);
+	static BufferQueueStats getQueueStats();
+	static void clearQueueStats();
+	static bool readQueueEvent(BufferQueueEvent& event);
+#endif
 protected:	
 	static DMAChannel dma;
 	static void isr(void);
+	static void restart(void);
 
 private:
-	static BufferQueue buffers;	
+#if !AUDIO_ZERO_COPY
+	static BufferQueue<CHANNELS, audio_sample_t> buffers;	
+#endif
 };
@@ -33,39 +33,66 @@
 #include "AudioConfig.h"
 #include "output_i2s_tdm.h"
 #include "input_i2s_tdm.h"
-#include <cmath>
 
 // high-level explanation of how this I2S & DMA code works:
 // https://forum.pjrc.com/threads/65229?p=263104&viewfull=1#post263104
 
-BufferQueue AudioOutputI2S::buffers;
+#if !AUDIO_ZERO_COPY
+BufferQueue<CHANNELS, audio_sample_t> AudioOutputI2S::buffers(BUFFER_QUEUE_SIZE - 1, "out queue");
+#endif
 DMAChannel AudioOutputI2S::dma(false);
+DeadlineMonitor AudioOutputI2S::deadline;
+const AudioClockConfig* AudioOutputI2S::clock = &audioClockTable[audio_clock_index(SAMPLERATE, BIT_DEPTH)];
 
 void audioCallbackPassthrough(int32_t** inputs, int32_t** outputs)
 {
-	for (size_t i = 0; i < AUDIO_BLOCK_SAMPLES; i++)
+	for (size_t k = 0; k < CHANNELS; k++)
 	{
-    outputs[0][i] = inputs[0][i];
-		outputs[1][i] = inputs[1][i];
-    
-    if (CHANNELS > 2) {
-      outputs[2][i] = inputs[2][i];
-		  outputs[3][i] = inputs[3][i];
-    }
-  }
+		for (size_t i = 0; i < AUDIO_BLOCK_SAMPLES; i++)
+		{
+			outputs[k][i] = inputs[k][i];
+		}
+	}
 }
 
 void (*i2sAudioCallback)(int32_t** inputs, int32_t** outputs) = audioCallbackPassthrough;
 
-DMAMEM __attribute__((aligned(32))) static uint32_t i2s_tx_buffer[AUDIO_BLOCK_SAMPLES * CHANNELS];
+void audioFloatCallbackPassthrough(float** inputs, float** outputs)
+{
+	for (size_t k = 0; k < CHANNELS; k++)
+	{
+		for (size_t i = 0; i < AUDIO_BLOCK_SAMPLES; i++)
+		{
+			outputs[k][i] = inputs[k][i];
+		}
+	}
+}
+
+void (*i2sAudioFloatCallback)(float** inputs, float** outputs) = audioFloatCallbackPassthrough;
+
+// Calls the callback for the sample type of the queues
+static inline void runCallback(int32_t** inputs, int32_t** outputs) { i2sAudioCallback(inputs, outputs); }
+static inline void runCallback(float** inputs, float** outputs) { i2sAudioFloatCallback(inputs, outputs); }
+
+void audioViewCallbackPassthrough(const AudioInputView& inputs, const AudioOutputView& outputs)
+{
+	// same layout on both sides, the whole block is one copy
+	memcpy(outputs.data(), inputs.data(), AUDIO_BLOCK_SAMPLES * CHANNELS * sizeof(int32_t));
+}
+
+void (*i2sAudioViewCallback)(const AudioInputView& inputs, const AudioOutputView& outputs) = audioViewCallbackPassthrough;
+
+DMAMEM __attribute__((aligned(32))) static uint32_t i2s_tx_buffer[AUDIO_DMA_HALF_FRAMES * CHANNELS * 2];
 #include "utility/imxrt_hw.h"
 #include "imxrt.h"
 #include "i2s_timers.h"
+#include "profile_zone.h"
 
 void AudioOutputI2S::begin()
 {
 	dma.begin(true); // Allocate the DMA channel first
 	config_i2s();
+	setDeadlineBudget();
 
 	// Minor loop = each individual transmission, in this case, 4 bytes of data
 	// Major loop = the buffer size, events can run when we hit the half and end of the major loop
@@ -75,13 +102,17 @@ void AudioOutputI2S::begin()
 	dma.TCD->SOFF = 4; // how many bytes to jump from current address on the next move
 	dma.TCD->ATTR = DMA_TCD_ATTR_SSIZE(2) | DMA_TCD_ATTR_DSIZE(2); // 1=16bits, 2=32 bits. size of source, size of dest
 	dma.TCD->NBYTES_MLNO = 4; // number of bytes to move, (minor loop?)
-	dma.TCD->SLAST = -sizeof(i2s_tx_buffer); // how many bytes to jump when hitting the end of the major loop. In this case, jump back to start of buffer
+	dma.TCD->SLAST = -(int32_t)sizeof(i2s_tx_buffer); // how many bytes to jump when hitting the end of the major loop. In this case, jump back to start of buffer
 	dma.TCD->DOFF = 0; // how many bytes to move the destination at each minor loop. In this case we're always writing to the same memory register.
 	dma.TCD->CITER_ELINKNO = sizeof(i2s_tx_buffer) / 4; // how many iterations are in the major loop
 	dma.TCD->DLASTSGA = 0; // how many bytes to jump the destination address at the end of the major loop
 	dma.TCD->BITER_ELINKNO = sizeof(i2s_tx_buffer) / 4; // beginning iteration count
+#if AUDIO_ZERO_COPY
+	dma.TCD->CSR = 0; // No interrupts, the receive interrupt fills the transmit buffer in zero-copy mode
+#else
 	dma.TCD->CSR = DMA_TCD_CSR_INTHALF | DMA_TCD_CSR_INTMAJOR; // Tells the DMA mechanism to trigger interrupt at half and full population of the buffer
-	dma.TCD->DADDR = (void *)((uint32_t)&I2S1_TDR0 + 0); // Destination address. for 16 bit values we use +2 byte offset from the I2S register. for 32 bits we use a zero offset.
+#endif
+	dma.TCD->DADDR = (void *)((uintptr_t)&I2S1_TDR0 + 0); // Destination address. for 16 bit values we use +2 byte offset from the I2S register. for 32 bits we use a zero offset.
 	dma.triggerAtHardwareEvent(DMAMUX_SOURCE_SAI1_TX); // run DMA at hardware event when new I2S data transmitted.
 	dma.enable();
 
@@ -97,59 +128,225 @@ void AudioOutputI2S::begin()
     I2S_TCSR_TE       // Transmitter Enabled
   | I2S_TCSR_BCE      // Transmitter Bit Clock Enabled
   | I2S_TCSR_FRDE;    // FIFO Request Interrupt Enable
+#if !AUDIO_ZERO_COPY
 	dma.attachInterrupt(isr);
+#endif
+
+#if AUDIO_DEFERRED_PROCESSING
+	// The callback runs below the DMA interrupts, which can preempt it at any time
+	attachInterruptVector(IRQ_SOFTWARE, process);
+	NVIC_SET_PRIORITY(IRQ_SOFTWARE, 208);
+	NVIC_ENABLE_IRQ(IRQ_SOFTWARE);
+#endif
+}
+
+bool AudioOutputI2S::setFormat(uint32_t sampleRate, uint8_t bitDepth)
+{
+	int index = audio_clock_index(sampleRate, bitDepth);
+	if (index < 0)
+		return false;
+	if (&audioClockTable[index] == clock)
+		return true;
+
+	// not started yet, begin() picks it up
+	if ((I2S1_RCSR & I2S_RCSR_RE) == 0)
+	{
+		clock = &audioClockTable[index];
+		setDeadlineBudget();
+		return true;
+	}
+
+	// The PLL relocks within the switch, nothing may touch the buffers or queues meanwhile
+	__disable_irq();
+
+	// stop the DMA requests first, then the transmitter and receiver at the end of the current frame
+	I2S1_TCSR &= ~I2S_TCSR_FRDE;
+	I2S1_RCSR &= ~I2S_RCSR_FRDE;
+	I2S1_TCSR &= ~I2S_TCSR_TE;
+	I2S1_RCSR &= ~I2S_RCSR_RE;
+	while ((I2S1_TCSR & I2S_TCSR_TE) || (I2S1_RCSR & I2S_RCSR_RE)) { }
+	dma.disable();
+	AudioInputI2S::dma.disable();
+
+	clock = &audioClockTable[index];
+	config_i2s(false, true);
+	setDeadlineBudget();
+
+	restart();
+	AudioInputI2S::restart();
+
+	__enable_irq();
+	return true;
+}
+
+// Starts transmitting again from the start of a silent buffer with a freshly filled queue,
+// the DMA and SAI transmitter have to be stopped.
+void AudioOutputI2S::restart(void)
+{
+	memset(i2s_tx_buffer, 0, sizeof(i2s_tx_buffer));
+	arm_dcache_flush_delete(i2s_tx_buffer, sizeof(i2s_tx_buffer));
+
+	dma.TCD->SADDR = i2s_tx_buffer;
+	dma.TCD->CITER_ELINKNO = dma.TCD->BITER_ELINKNO;
+	dma.clearInterrupt();
+#if !AUDIO_ZERO_COPY
+	buffers.reset(buffers.depth, buffers.depth - 1);
+#endif
+	dma.enable();
+
+	I2S1_TCSR = I2S_TCSR_TE | I2S_TCSR_BCE | I2S_TCSR_FRDE | I2S_TCSR_FR;
+}
+
+// One DMA half of frames at the current sample rate
+void AudioOutputI2S::setDeadlineBudget(void)
+{
+	deadline.setBudget((uint32_t)((uint64_t)F_CPU_ACTUAL * AUDIO_DMA_HALF_FRAMES / clock->sampleRate));
+}
+
+// The interrupt that filled `dest` is done: the DMA must still be in the other half
+void AudioOutputI2S::checkDeadline(const int32_t* dest, uint32_t entry)
+{
+	uintptr_t start = (uintptr_t)dest;
+	deadline.check((uintptr_t)(dma.TCD->SADDR), start, start + sizeof(i2s_tx_buffer) / 2,
+		CHANNELS * sizeof(int32_t), entry, Timers::Cycles());
+}
+
+DeadlineStats AudioOutputI2S::getDeadlineStats()
+{
+	__disable_irq();
+	DeadlineStats stats = deadline.stats;
+	__enable_irq();
+	return stats;
+}
+
+void AudioOutputI2S::clearDeadlineStats()
+{
+	__disable_irq();
+	deadline.clearStats();
+	__enable_irq();
+}
+
+bool AudioOutputI2S::readDeadlineEvent(DeadlineEvent& event)
+{
+	return deadline.readEvent(event);
+}
+
+#if AUDIO_ZERO_COPY
+
+// Called from the receive interrupt with the half of the receive buffer that was just completed.
+// The transmitter runs a few frames ahead of the receiver (it fills the FIFO first), so it has
+// already moved on to the next half and the other half of the transmit buffer is free for the
+// next half block.
+void AudioOutputI2S::processViews(const int32_t* rx)
+{
+	uint32_t entry = Timers::Cycles();
+	uintptr_t saddr;
+	int32_t* dest;
+
+	saddr = (uintptr_t)(dma.TCD->SADDR);
+	if (saddr < (uintptr_t)i2s_tx_buffer + sizeof(i2s_tx_buffer) / 2)
+	{
+		// DMA is transmitting the first half of the buffer
+		// so we must fill the second half
+		dest = (int32_t *)&i2s_tx_buffer[AUDIO_DMA_HALF_FRAMES * CHANNELS];
+	}
+	else
+	{
+		// DMA is transmitting the second half of the buffer
+		// so we must fill the first half
+		dest = (int32_t *)i2s_tx_buffer;
+	}
+
+	Timers::ResetFrame();
+
+	{
+		PROFILE_ZONE("callback");
+		AUDIO_TRACE_BEGIN("callback");
+		i2sAudioViewCallback(AudioInputView(rx), AudioOutputView(dest));
+		AUDIO_TRACE_END("callback");
+	}
+
+	arm_dcache_flush_delete(dest, sizeof(i2s_tx_buffer) / 2);
+
+	Timers::LapInner(Timers::TIMER_TOTAL);
+	checkDeadline(dest, entry);
+}
+
+#else
+
+void AudioOutputI2S::setQueueDepth(size_t blocks)
+{
+	__disable_irq();
+	buffers.reset(blocks, blocks - 1);
+	__enable_irq();
+}
+
+BufferQueueStats AudioOutputI2S::getQueueStats()
+{
+	__disable_irq();
+	BufferQueueStats stats = buffers.stats;
+	__enable_irq();
+	return stats;
+}
+
+void AudioOutputI2S::clearQueueStats()
+{
+	__disable_irq();
+	buffers.clearStats();
+	__enable_irq();
+}
+
+bool AudioOutputI2S::readQueueEvent(BufferQueueEvent& event)
+{
+	return buffers.readEvent(event);
 }
 
 // This gets called twice per block, when buffer is half full and completely full
 // Every other call, after we've pushed the second half of the current block onto the tx_buffer, we trigger the
 // process() call again, computing a new block of data
+// In half-block mode (AUDIO_HALF_BLOCK_CALLBACK) every half of the buffer is a block and every call computes one.
 void AudioOutputI2S::isr(void)
 {
-	uint32_t* dest;
-  int32_t* block[CHANNELS];	
-	uint32_t saddr, offset;
+	AUDIO_TRACE_SCOPE("tx isr");
+	uint32_t entry = Timers::Cycles();
+	int32_t* dest;
+	const audio_sample_t* block[CHANNELS];
+	uintptr_t saddr;
+	uint32_t offset;
 	bool callUpdate;
 
-	saddr = (uint32_t)(dma.TCD->SADDR);
+	saddr = (uintptr_t)(dma.TCD->SADDR);
 	dma.clearInterrupt();
-	if (saddr < (uint32_t)i2s_tx_buffer + sizeof(i2s_tx_buffer) / 2) 
+	if (saddr < (uintptr_t)i2s_tx_buffer + sizeof(i2s_tx_buffer) / 2) 
 	{
 		// DMA is transmitting the first half of the buffer
 		// so we must fill the second half
-		//dest = (int32_t *)&i2s_tx_buffer[AUDIO_BLOCK_SAMPLES/2];
-		dest = i2s_tx_buffer + AUDIO_BLOCK_SAMPLES * CHANNELS/2;
-    // dest = (int32_t *)((uint32_t)i2s_tx_buffer + sizeof(i2s_tx_buffer) / 2);
+		dest = (int32_t *)&i2s_tx_buffer[AUDIO_DMA_HALF_FRAMES * CHANNELS];
 		callUpdate = true;
-		offset = AUDIO_BLOCK_SAMPLES / 2;
+		offset = AUDIO_BLOCK_SAMPLES - AUDIO_DMA_HALF_FRAMES;
 	}
 	else
 	{
 		// DMA is transmitting the second half of the buffer
 		// so we must fill the first half
-		dest = i2s_tx_buffer;
-		callUpdate = false;
+		dest = (int32_t *)i2s_tx_buffer;
+		callUpdate = AUDIO_HALF_BLOCK_CALLBACK; // in half-block mode every half is a block
 		offset = 0;
 	}
 
-  block[0] = buffers.readPtr[0];
-	block[1] = buffers.readPtr[1];
+	for (size_t k = 0; k < CHANNELS; k++)
+	{
+		block[k] = &(buffers.readPtr[k][offset]);
+	}
 
-  if (CHANNELS > 2) {
-    block[2] = buffers.readPtr[2];
-	  block[3] = buffers.readPtr[3];
-  }
+	// merge one buffer per channel into the TDM frames
+#if AUDIO_FLOAT_PROCESSING
+	// converting from float, scaled for the word width setFormat() chose
+	tdm_interleave<CHANNELS, AUDIO_DMA_HALF_FRAMES>(block, dest, 32 - clock->bitDepth);
+#else
+	tdm_interleave<CHANNELS, AUDIO_DMA_HALF_FRAMES>(block, dest);
+#endif
 
-	for (size_t i = 0; i < AUDIO_BLOCK_SAMPLES/2; i++)
-	{
-		dest[CHANNELS*i + 0] = block[0][i + offset];
-		dest[CHANNELS*i + 1] = block[1][i + offset];
-    
-    if (CHANNELS > 2) {
-      dest[CHANNELS*i + 2] = block[2][i + offset];
-		  dest[CHANNELS*i + 3] = block[3][i + offset];
-    }
-  }
-	
 	arm_dcache_flush_delete(dest, sizeof(i2s_tx_buffer) / 2 );
 
 	if (callUpdate)
@@ -159,20 +356,79 @@ void AudioOutputI2S::isr(void)
 		// We've finished reading all the data from the current read block
 		buffers.consume();
 
+#if AUDIO_DEFERRED_PROCESSING
+		// a block is free for the callback
+		NVIC_SET_PENDING(IRQ_SOFTWARE);
+#else
 		// Fetch the input samples
-		int32_t** dataInPtr = AudioInputI2S::getData();
+		audio_sample_t** dataInPtr = AudioInputI2S::getData();
 
 		// populate the next block
-		i2sAudioCallback(dataInPtr, buffers.writePtr);
+		{
+			PROFILE_ZONE("callback");
+			AUDIO_TRACE_BEGIN("callback");
+			runCallback(dataInPtr, buffers.writePtr);
+			AUDIO_TRACE_END("callback");
+		}
 		// publish the block
 		buffers.publish();
 
+		Timers::LapInner(Timers::TIMER_TOTAL);
+#endif
+	}
+
+	checkDeadline(dest, entry);
+}
+
+#if AUDIO_DEFERRED_PROCESSING
+
+uint32_t AudioOutputI2S::deferredUnderruns = 0;
+
+// Software interrupt: runs the callback for every received block while there is room for
+// its output. The queues are shared with the DMA interrupts, so they are only moved on with
+// interrupts disabled. The Timers total measures from the block boundary in the transmit
+// interrupt to the end of the callback, so it includes the time the callback was waiting.
+// The transmit interrupt only times its own copy here; a callback that comes too late is
+// caught after the publish, when the output queue has underrun since the last one.
+void AudioOutputI2S::process(void)
+{
+	AUDIO_TRACE_SCOPE("process");
+	while (AudioInputI2S::buffers.available > 0 && buffers.available < buffers.depth)
+	{
+		uint32_t start = Timers::Cycles();
+		{
+			PROFILE_ZONE("callback");
+			AUDIO_TRACE_BEGIN("callback");
+			runCallback(AudioInputI2S::buffers.readPtr, buffers.writePtr);
+			AUDIO_TRACE_END("callback");
+		}
+
+		__disable_irq();
+		AudioInputI2S::buffers.consume();
+		buffers.publish();
+		// the transmit interrupt repeated blocks while this one was not ready: a missed deadline,
+		// late by the blocks repeated before the last boundary and the time since it
+		// (fewer underruns than before: the stats were cleared)
+		uint32_t underruns = buffers.stats.underruns;
+		uint32_t repeated = underruns > deferredUnderruns ? underruns - deferredUnderruns : 0;
+		deferredUnderruns = underruns;
+		uint32_t boundary = Timers::FrameStartCycles;
+		__enable_irq();
+
+		uint32_t now = Timers::Cycles();
+		if (repeated)
+			deadline.miss((repeated - 1) * Timers::GetAvgPeriodCycles() + (now - boundary), now - start);
+
 		Timers::LapInner(Timers::TIMER_TOTAL);
 	}
 }
 
+#endif
+
+#endif
+
 // This function sets all the necessary PLL and I2S flags necessary for running
-void AudioOutputI2S::config_i2s(bool only_bclk)
+void AudioOutputI2S::config_i2s(bool only_bclk, bool force_pll)
 {
 	CCM_CCGR5 |= CCM_CCGR5_SAI1(CCM_CCGR_ON);
 
@@ -187,17 +443,10 @@ void AudioOutputI2S::config_i2s(bool only_bclk)
 	  return ;
 	}
 
-	//PLL:
-	int fs = SAMPLERATE;
-	// PLL between 27*24 = 648MHz und 54*24=1296MHz
-	int n1 = 4; //SAI prescaler 4 => (n1*n2) = multiple of 4
-	int n2 = 1 + (24000000 * 27) / (fs * 256 * n1);
-
-	double C = ((double)fs * 256 * n1 * n2) / 24000000;
-	int c0 = C;
-	int c2 = 10000;
-	int c1 = C * c2 - (c0 * c2);
-	set_audioClock(c0, c1, c2);
+	//PLL: precomputed for the sample rate and bit depth in utility/audio_clock.h
+	int n1 = clock->n1;
+	int n2 = clock->n2;
+	set_audioClock(clock->nfact, clock->nmult, clock->ndiv, force_pll);
 
 	// Clear SAI1_CLK register locations
 	CCM_CSCMR1 = (CCM_CSCMR1 & ~(CCM_CSCMR1_SAI1_CLK_SEL_MASK))
@@ -232,7 +481,7 @@ void AudioOutputI2S::config_i2s(bool only_bclk)
     I2S_TCR2_SYNC(1)            // Synchronous Mode     : 1=sync, 0=async
   | I2S_TCR2_BCP                // Bit Clock Polarity   : 1=Outputs falling edge, inputs on rising edge, 0 is inverse.
 	| I2S_TCR2_BCD                // Bit Clock Direction  : 1=Bit clock is generated internally in Master mode. 0=Slave, externally
-  | I2S_TCR2_DIV(0)             // Bit Clock Divide     : Divides the mclk as (DIV + 1) * 2
+  | I2S_TCR2_DIV(clock->bclkDiv) // Bit Clock Divide     : Divides the mclk as (DIV + 1) * 2
   | I2S_TCR2_MSEL(1);           // Master Clock Select  : 0=bus clock, 1=I2S0_MCLK
 	
   // SAI Transmit Configuration 3: Transmit channel settings
@@ -241,16 +490,16 @@ void AudioOutputI2S::config_i2s(bool only_bclk)
   // SAI Transmit Configuration 4: FIFO Combine Mode, FIFO Packing Mode, and frame sync settings.
 	I2S1_TCR4 = 
     I2S_TCR4_FRSZ(CHANNELS - 1) // Frame Size           : Number of words (=channels) in each frame (minus one)
-  | I2S_TCR4_SYWD(BIT_DEPTH -1) // Sync Width           : Length of the frame sync in number of bit clocks (minus one)
+  | I2S_TCR4_SYWD(clock->bitDepth - 1) // Sync Width           : Length of the frame sync in number of bit clocks (minus one)
   | I2S_TCR4_MF                 // MSB First            : 0=LSB First, 1=MSB First
   | I2S_TCR4_FSE                // Frame Sync Early     : 1=One bit before the frame, 0=With the first bit of the frame
   | I2S_TCR4_FSP                // Frame Sync Polarity  : 1=Active low, 0=Active high
   | I2S_TCR4_FSD;               // Frame Sync Direction : 1=Internally in Master mode, 0=Externally in Slave mode.
   // SAI Transmit Configuration 5: Word width and bit index settings
 	I2S1_TCR5 = 
-    I2S_TCR5_W0W(BIT_DEPTH - 1)  // Word 0 Width        : Number of Bits per word, first frame
-  | I2S_TCR5_WNW(BIT_DEPTH - 1)  // Word N Width        : Number of Bits per word, nth frame
-  | I2S_TCR5_FBT(BIT_DEPTH - 1); // First Bit Shifted   : Bit index for the first bit for each word in the frame minus one.
+    I2S_TCR5_W0W(clock->bitDepth - 1)  // Word 0 Width        : Number of Bits per word, first frame
+  | I2S_TCR5_WNW(clock->bitDepth - 1)  // Word N Width        : Number of Bits per word, nth frame
+  | I2S_TCR5_FBT(clock->bitDepth - 1); // First Bit Shifted   : Bit index for the first bit for each word in the frame minus one.
 
   // Receive Mask
 	I2S1_RMR = 0;                 // Allows masked words in each frame to change from frame to frame. 0=no mask
@@ -263,7 +512,7 @@ void AudioOutputI2S::config_i2s(bool only_bclk)
     I2S_RCR2_SYNC(0)             // Synchronous Mode     : 1=sync with transmitter, 0=async
   | I2S_RCR2_BCP                 // Bit Clock Polarity   : 1=Outputs falling edge, inputs on rising edge, 0 is inverse.
 	| I2S_RCR2_BCD                 // Bit Clock Direction  : 1=Bit clock is generated internally in Master mode. 0=Slave, externally
-  | I2S_RCR2_DIV(0)              // Bit Clock Divide     : Divides the mclk as (DIV + 1) * 2
+  | I2S_RCR2_DIV(clock->bclkDiv)  // Bit Clock Divide     : Divides the mclk as (DIV + 1) * 2
   | I2S_RCR2_MSEL(1);            // Master Clock Select  : 0=bus clock, 1=I2S0_MCLK
 	
    // SAI Receive Configuration 3
@@ -272,7 +521,7 @@ void AudioOutputI2S::config_i2s(bool only_bclk)
    // SAI Receive Configuration 4
 	I2S1_RCR4 = 
     I2S_RCR4_FRSZ(CHANNELS - 1)   // Frame Size           : Number of words (=channels) in each frame (minus one)
-  | I2S_RCR4_SYWD(BIT_DEPTH -1)   // Sync Width           : Length of the frame sync in number of bit clocks (minus one)
+  | I2S_RCR4_SYWD(clock->bitDepth - 1)   // Sync Width           : Length of the frame sync in number of bit clocks (minus one)
   | I2S_RCR4_MF                   // MSB First            : 0=LSB First, 1=MSB First
 	| I2S_RCR4_FSE                  // Frame Sync Early     : 1=One bit before the frame, 0=With the first bit of the frame
   | I2S_RCR4_FSD                  // Frame Sync Direction : 1=Internally in Master mode, 0=Externally in Slave mode.
@@ -280,8 +529,8 @@ void AudioOutputI2S::config_i2s(bool only_bclk)
 
    // SAI Receive Configuration 5
 	I2S1_RCR5 = 
-    I2S_RCR5_WNW(BIT_DEPTH - 1)   // Word 0 Width        : Number of Bits per word, first frame
-  | I2S_RCR5_W0W(BIT_DEPTH - 1)   // Word N Width        : Number of Bits per word, nth frame
-  | I2S_RCR5_FBT(BIT_DEPTH - 1);  // First Bit Shifted   : Bit index for the first bit for each word in the frame minus one.
+    I2S_RCR5_WNW(clock->bitDepth - 1)   // Word 0 Width        : Number of Bits per word, first frame
+  | I2S_RCR5_W0W(clock->bitDepth - 1)   // Word N Width        : Number of Bits per word, nth frame
+  | I2S_RCR5_FBT(clock->bitDepth - 1);  // First Bit Shifted   : Bit index for the first bit for each word in the frame minus one.
 
 }
@@ -28,20 +28,77 @@
 
 #include <Arduino.h>
 #include <DMAChannel.h>
+#include "AudioConfig.h"
 #include "buffer_queue.h"
+#include "deadline_monitor.h"
+#include "strided_view.h"
+#include "utility/audio_clock.h"
 
 extern void (*i2sAudioCallback)(int32_t** inputs, int32_t** outputs);
 
+// Float callback (AUDIO_FLOAT_PROCESSING), samples in [-1.0, 1.0), outputs are saturated
+extern void (*i2sAudioFloatCallback)(float** inputs, float** outputs);
+
+// Zero-copy callback (AUDIO_ZERO_COPY), the views point straight into the DMA buffers
+typedef StridedBlock<const int32_t, CHANNELS, AUDIO_BLOCK_SAMPLES> AudioInputView;
+typedef StridedBlock<int32_t, CHANNELS, AUDIO_BLOCK_SAMPLES> AudioOutputView;
+extern void (*i2sAudioViewCallback)(const AudioInputView& inputs, const AudioOutputView& outputs);
+
 class AudioOutputI2S
 {
 public:
+	static const size_t BlockSamples = AUDIO_BLOCK_SAMPLES; // samples per channel per callback
+
 	AudioOutputI2S(void) { }
 	void begin(void);
 	friend class AudioInputI2S;
 
+	// Switches sample rate (44100, 48000, 96000, 192000) and bit depth (16, 24, 32) while running.
+	// Stops the DMA and SAI, reprograms PLL4 and the SAI dividers and restarts both directions
+	// from silence. Returns false for a combination that is not in audioClockTable.
+	//
+	// The bit depth is the SAI word width, and the callback samples follow it: at 16 and 24
+	// bit each int32_t carries a right-aligned word (the receiver leaves the bits above it 0,
+	// the transmitter ignores them), at 32 bit the whole word. Code that depends on the
+	// format reads getSampleRate() and getBitDepth() instead of SAMPLERATE and BIT_DEPTH,
+	// which only give the format at begin(): WavWriter and WavReader take it when a file is
+	// opened, so switch before OpenFile(), not while a file is recording or playing.
+	static bool setFormat(uint32_t sampleRate, uint8_t bitDepth);
+	static uint32_t getSampleRate() { return clock->sampleRate; }
+	static uint8_t getBitDepth() { return clock->bitDepth; }
+
+	// Transmit interrupts that finished after the DMA reached the half they had just filled.
+	// setContext() tags the misses with what loop() is doing, pass a string literal (or nullptr):
+	//   AudioOutputI2S::setContext("SD write"); file.write(...); AudioOutputI2S::setContext(nullptr);
+	static void setContext(const char* context) { deadline.context = context; }
+	static DeadlineStats getDeadlineStats();
+	static void clearDeadlineStats();
+	static bool readDeadlineEvent(DeadlineEvent& event);
+#if !AUDIO_ZERO_COPY
+
+	// Queue depth in blocks (2 to BUFFER_QUEUE_MAX_SIZE), resets the queue
+	static void setQueueDepth(size_t blocks);
+	static BufferQueueStats getQueueStats();
+	static void clearQueueStats();
+	static bool readQueueEvent(BufferQueueEvent& event);
+#endif
+
 protected:
-	static void config_i2s(bool only_bclk = false);
-	static BufferQueue buffers;
+	static const AudioClockConfig* clock;
+	static DeadlineMonitor deadline;
+	static void setDeadlineBudget(void);
+	static void checkDeadline(const int32_t* dest, uint32_t entry);
+	static void config_i2s(bool only_bclk = false, bool force_pll = false);
+	static void restart(void);
+#if AUDIO_ZERO_COPY
+	static void processViews(const int32_t* rx);
+#else
+	static BufferQueue<CHANNELS, audio_sample_t> buffers;
+#endif
+#if AUDIO_DEFERRED_PROCESSING
+	static void process(void);
+	static uint32_t deferredUnderruns; // output underruns process() has seen
+#endif
 	static DMAChannel dma;
 	static void isr(void);
 };
@@ -0,0 +1,65 @@
+#include "profile_zone.h"
+
+ProfileZone* ProfileZone::FirstZone = nullptr;
+ProfileScope* ProfileScope::Current = nullptr;
+
+void ProfileZone::Register(ProfileZone& zone)
+{
+    __disable_irq();
+    if (!zone.registered)
+    {
+        // append, so the zones list in the order they first ran
+        ProfileZone** link = &FirstZone;
+        while (*link)
+            link = &(*link)->next;
+        *link = &zone;
+        zone.registered = true;
+    }
+    __enable_irq();
+}
+
+// Called by Timers::ResetFrame at the start of every block
+void ProfileZone::EndBlock()
+{
+    for (ProfileZone* zone = FirstZone; zone; zone = zone->next)
+    {
+        uint32_t inclusive = zone->blockInclusive;
+        uint32_t exclusive = zone->blockExclusive;
+        zone->blockInclusive = 0;
+        zone->blockExclusive = 0;
+
+        // avg = avg * 255/256 + val / 256, in Q8
+        zone->InclusiveAvgQ8 += inclusive - (zone->InclusiveAvgQ8 >> 8);
+        zone->ExclusiveAvgQ8 += exclusive - (zone->ExclusiveAvgQ8 >> 8);
+        if (inclusive > zone->InclusiveMax)
+            zone->InclusiveMax = inclusive;
+        if (exclusive > zone->ExclusiveMax)
+            zone->ExclusiveMax = exclusive;
+    }
+}
+
+float ProfileZone::GetCpuLoad() const
+{
+    uint32_t period = Timers::GetAvgPeriodCycles();
+    if (period == 0)
+        return 0;
+
+    return (float)InclusiveAvgQ8 / 256 / period;
+}
+
+void ProfileZone::Clear()
+{
+    __disable_irq();
+    InclusiveAvgQ8 = 0;
+    ExclusiveAvgQ8 = 0;
+    InclusiveMax = 0;
+    ExclusiveMax = 0;
+    Calls = 0;
+    __enable_irq();
+}
+
+void ProfileZone::ClearAll()
+{
+    for (ProfileZone* zone = FirstZone; zone; zone = zone->next)
+        zone->Clear();
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include "Arduino.h"
+#include "AudioConfig.h"
+#include "i2s_timers.h"
+
+// Named profiling zones (AUDIO_PROFILE). PROFILE_ZONE("reverb") at the top of a scope times
+// that scope with the DWT cycle counter:
+//
+//   void processAudio(int32_t** inputs, int32_t** outputs)
+//   {
+//       { PROFILE_ZONE("filter"); filter(inputs, outputs); }
+//       { PROFILE_ZONE("reverb"); reverb(outputs); }
+//   }
+//
+// Each PROFILE_ZONE is a function-local static with a constexpr constructor, so it is
+// constant-initialized: no allocation, no guard, nothing to set up. It links itself into
+// the list of zones on its first run. Zones nest: a zone's inclusive time is everything
+// between its start and end, its exclusive time leaves out the zones inside it (and any
+// interrupt that preempted it and ran zones of its own).
+//
+// The cycles are summed per audio block; at the start of every block (Timers::ResetFrame)
+// the sums go into an average over ~256 blocks and a max, like Timers. The library opens a
+// "callback" zone around i2sAudioCallback, so zones in the callback nest inside it and its
+// exclusive time is whatever no zone covers. Zones are meant for the audio callback, a zone
+// in loop() may lose a lap that ends exactly as a block starts.
+//
+// With AUDIO_PROFILE 0 PROFILE_ZONE compiles to nothing.
+class ProfileZone
+{
+    friend class ProfileScope;
+    friend class Timers;
+public:
+    const char* const name;
+
+    constexpr ProfileZone(const char* name) : name(name) { }
+
+    // Per block, stored as cycles * 256 like Timers::CyclesAvgQ8
+    uint32_t InclusiveAvgQ8 = 0;
+    uint32_t ExclusiveAvgQ8 = 0;
+    uint32_t InclusiveMax = 0;
+    uint32_t ExclusiveMax = 0;
+    uint32_t Calls = 0; // times the zone ran since Clear()
+
+    uint32_t GetInclusiveCycles() const { return InclusiveAvgQ8 >> 8; }
+    uint32_t GetExclusiveCycles() const { return ExclusiveAvgQ8 >> 8; }
+    float GetInclusive() const { return Timers::CyclesToMicros(InclusiveAvgQ8) / 256; }
+    float GetExclusive() const { return Timers::CyclesToMicros(ExclusiveAvgQ8) / 256; }
+    float GetInclusiveMax() const { return Timers::CyclesToMicros(InclusiveMax); }
+    float GetExclusiveMax() const { return Timers::CyclesToMicros(ExclusiveMax); }
+    // Share of the block period, like Timers::GetCpuLoad
+    float GetCpuLoad() const;
+
+    void Clear();
+
+    // Zones in the order they first ran
+    static ProfileZone* First() { return FirstZone; }
+    ProfileZone* Next() const { return next; }
+    static void ClearAll();
+
+    // One line per zone: name, inclusive and exclusive average and max in microseconds
+    template <typename Out>
+    static void PrintAll(Out& out)
+    {
+        for (ProfileZone* zone = First(); zone; zone = zone->Next())
+        {
+            out.print(zone->name);
+            out.print(": incl ");
+            out.print(zone->GetInclusive(), 2);
+            out.print(" / ");
+            out.print(zone->GetInclusiveMax(), 2);
+            out.print("us, excl ");
+            out.print(zone->GetExclusive(), 2);
+            out.print(" / ");
+            out.print(zone->GetExclusiveMax(), 2);
+            out.println("us");
+        }
+    }
+
+private:
+    uint32_t blockInclusive = 0;
+    uint32_t blockExclusive = 0;
+    ProfileZone* next = nullptr;
+    bool registered = false;
+
+    static ProfileZone* FirstZone;
+    static void Register(ProfileZone& zone);
+    static void EndBlock();
+};
+
+// Times one run of a zone, see PROFILE_ZONE
+class ProfileScope
+{
+public:
+    inline ProfileScope(ProfileZone& zone) : zone(zone), parent(Current), children(0)
+    {
+        if (!zone.registered)
+            ProfileZone::Register(zone);
+        Current = this;
+        start = Timers::Cycles();
+    }
+
+    inline ~ProfileScope()
+    {
+        uint32_t elapsed = Timers::Cycles() - start;
+        zone.blockInclusive += elapsed;
+        zone.blockExclusive += elapsed - children;
+        zone.Calls++;
+        if (parent)
+            parent->children += elapsed;
+        Current = parent;
+    }
+
+private:
+    ProfileZone& zone;
+    ProfileScope* parent;
+    uint32_t children;
+    uint32_t start;
+
+    static ProfileScope* Current;
+};
+
+#if AUDIO_PROFILE
+#define PROFILE_ZONE_JOIN2(a, b) a##b
+#define PROFILE_ZONE_JOIN(a, b) PROFILE_ZONE_JOIN2(a, b)
+#define PROFILE_ZONE(name) \
+    static ProfileZone PROFILE_ZONE_JOIN(profileZone, __LINE__)(name); \
+    ProfileScope PROFILE_ZONE_JOIN(profileScope, __LINE__)(PROFILE_ZONE_JOIN(profileZone, __LINE__))
+#else
+#define PROFILE_ZONE(name) do { } while (0)
+#endif
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Views on interleaved TDM frames, used by the zero-copy callback (AUDIO_ZERO_COPY).
+// The DMA buffers hold the samples as ch0 ch1 ... chN-1 ch0 ch1 ..., a channel is
+// read and written with a stride of Channels words, so the callback indexes the DMA
+// memory directly: outputs[ch][i] = inputs[ch][i] just like with planar buffers.
+
+// One channel: sample i lives at base[i * Stride]
+template <typename T, size_t Stride>
+class StridedChannel
+{
+public:
+	inline StridedChannel(T* base) : base(base) { }
+
+	inline T& operator[](size_t i) const { return base[i * Stride]; }
+
+private:
+	T* base;
+};
+
+// All channels of a block of Frames interleaved frames
+template <typename T, size_t Channels, size_t Frames>
+class StridedBlock
+{
+public:
+	inline StridedBlock(T* frames) : frames(frames) { }
+
+	inline StridedChannel<T, Channels> operator[](size_t channel) const
+	{
+		return StridedChannel<T, Channels>(frames + channel);
+	}
+
+	// The Channels samples of frame i, for code that works frame by frame
+	inline T* frame(size_t i) const { return frames + i * Channels; }
+
+	// The underlying interleaved memory, Channels * Frames words
+	inline T* data() const { return frames; }
+
+	static constexpr size_t channels() { return Channels; }
+	static constexpr size_t size() { return Frames; }
+
+private:
+	T* frames;
+};
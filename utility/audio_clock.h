@@ -0,0 +1,118 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "../AudioConfig.h"
+
+// PLL4 and SAI1 clock settings for every supported sample rate and bit depth, solved at
+// compile time for CHANNELS slots per frame with integer math only:
+//   PLL4 = 24 MHz * (nfact + nmult / ndiv)      between 648 and 1296 MHz
+//   MCLK = PLL4 / (n1 * n2)                      mclkRatio * fs, 256 fs or more
+//   BCLK = MCLK / ((bclkDiv + 1) * 2)            CHANNELS * bitDepth * fs
+// The fraction is exact (ndiv divides 24 MHz), the static_asserts below check every entry
+// against its target rate.
+struct AudioClockConfig
+{
+	uint32_t sampleRate;
+	uint8_t bitDepth;
+	uint8_t nfact;    // PLL4 DIV_SELECT
+	uint32_t nmult;   // PLL4 NUM
+	uint32_t ndiv;    // PLL4 DENOM
+	uint8_t n1;       // SAI1_CLK_PRED + 1
+	uint8_t n2;       // SAI1_CLK_PODF + 1
+	uint8_t bclkDiv;  // TCR2/RCR2 DIV
+	uint16_t mclkRatio;
+};
+
+namespace audio_clock
+{
+	static constexpr uint32_t kOscillator = 24000000;
+	static constexpr uint64_t kPllMin = 648000000;  // 27 * 24 MHz
+	static constexpr uint64_t kPllMax = 1296000000; // 54 * 24 MHz
+	static constexpr uint32_t kMaxErrorPpm = 1;
+
+	constexpr uint32_t gcd(uint32_t a, uint32_t b)
+	{
+		return b == 0 ? a : gcd(b, a % b);
+	}
+
+	// Smallest multiple of the two bit clocks per frame the SAI divider can make that is
+	// at least 256 fs, the MCLK most codecs expect
+	constexpr uint32_t mclkRatio(uint32_t frameBits)
+	{
+		return 2 * frameBits * ((256 + 2 * frameBits - 1) / (2 * frameBits));
+	}
+
+	constexpr AudioClockConfig make(uint32_t fs, uint8_t bits)
+	{
+		uint32_t ratio = mclkRatio(CHANNELS * bits);
+		uint32_t n1 = 4; // SAI prescaler 4 => (n1*n2) = multiple of 4
+		uint64_t step = (uint64_t)fs * ratio * n1;
+		uint32_t n2 = 1 + (uint32_t)(kPllMin / step);
+		uint64_t pll = step * n2;
+		uint32_t rest = (uint32_t)(pll % kOscillator);
+		uint32_t common = gcd(rest, kOscillator);
+
+		return AudioClockConfig {
+			fs,
+			bits,
+			(uint8_t)(pll / kOscillator),
+			rest / common,
+			kOscillator / common,
+			(uint8_t)n1,
+			(uint8_t)n2,
+			(uint8_t)(ratio / (2 * CHANNELS * bits) - 1),
+			(uint16_t)ratio
+		};
+	}
+
+	// Frame rate the settings produce, compared with the target without floating point
+	constexpr bool accurate(const AudioClockConfig& c)
+	{
+		uint64_t pllTimesDenom = (uint64_t)kOscillator * ((uint64_t)c.nfact * c.ndiv + c.nmult);
+		uint64_t divider = (uint64_t)c.ndiv * c.n1 * c.n2 * (c.bclkDiv + 1) * 2 * CHANNELS * c.bitDepth;
+		uint64_t target = (uint64_t)c.sampleRate * divider;
+		uint64_t error = pllTimesDenom > target ? pllTimesDenom - target : target - pllTimesDenom;
+		return error <= target / 1000000 * kMaxErrorPpm;
+	}
+
+	constexpr bool valid(const AudioClockConfig& c)
+	{
+		return c.nfact >= 27 && c.nfact <= 54 && c.nmult < c.ndiv && c.ndiv <= 0x3FFFFFFF
+			&& c.n1 >= 1 && c.n1 <= 8 && c.n2 >= 1 && c.n2 <= 64
+			&& (uint64_t)kOscillator * c.nfact + (uint64_t)kOscillator * c.nmult / c.ndiv <= kPllMax;
+	}
+}
+
+static constexpr AudioClockConfig audioClockTable[] = {
+	audio_clock::make(44100, 16), audio_clock::make(44100, 24), audio_clock::make(44100, 32),
+	audio_clock::make(48000, 16), audio_clock::make(48000, 24), audio_clock::make(48000, 32),
+	audio_clock::make(96000, 16), audio_clock::make(96000, 24), audio_clock::make(96000, 32),
+	audio_clock::make(192000, 16), audio_clock::make(192000, 24), audio_clock::make(192000, 32),
+};
+
+static constexpr size_t audioClockTableSize = sizeof(audioClockTable) / sizeof(audioClockTable[0]);
+
+// Index of the settings for a sample rate and bit depth, -1 if they are not supported
+constexpr int audio_clock_index(uint32_t sampleRate, uint8_t bitDepth)
+{
+	for (size_t i = 0; i < audioClockTableSize; i++)
+	{
+		if (audioClockTable[i].sampleRate == sampleRate && audioClockTable[i].bitDepth == bitDepth)
+			return (int)i;
+	}
+	return -1;
+}
+
+constexpr bool audio_clock_table_ok()
+{
+	for (size_t i = 0; i < audioClockTableSize; i++)
+	{
+		if (!audio_clock::valid(audioClockTable[i]) || !audio_clock::accurate(audioClockTable[i]))
+			return false;
+	}
+	return true;
+}
+
+static_assert(audio_clock_table_ok(), "PLL4/SAI settings out of range or off the target rate");
+static_assert(audio_clock_index(SAMPLERATE, BIT_DEPTH) >= 0, "SAMPLERATE and BIT_DEPTH must be one of the rates and depths in audioClockTable");
@@ -0,0 +1,66 @@
+#include "audio_trace.h"
+
+namespace audio_trace
+{
+	uint32_t dropped = 0;
+
+#if AUDIO_TRACE
+
+	AudioTraceEvent events[AUDIO_TRACE_EVENTS];
+	uint32_t head = 0;
+	uint32_t tail = 0;
+
+	bool read(AudioTraceEvent& event)
+	{
+		for (;;)
+		{
+			uint32_t written = __atomic_load_n(&head, __ATOMIC_RELAXED);
+			if (tail == written)
+				return false;
+
+			// the writers went around the ring, the oldest events are gone
+			if (written - tail > AUDIO_TRACE_EVENTS)
+			{
+				dropped += written - AUDIO_TRACE_EVENTS - tail;
+				tail = written - AUDIO_TRACE_EVENTS;
+			}
+
+			AudioTraceEvent& slot = events[tail & (AUDIO_TRACE_EVENTS - 1)];
+			uint32_t seq = slot.seq;
+			if (seq != tail + 1)
+			{
+				// being written, or overwritten since: try again once head has moved on
+				if ((uint32_t)(__atomic_load_n(&head, __ATOMIC_RELAXED) - tail) <= AUDIO_TRACE_EVENTS)
+					return false;
+				continue;
+			}
+
+			event.cycles = slot.cycles;
+			event.name = slot.name;
+			event.arg = slot.arg;
+			event.phase = slot.phase;
+			__atomic_signal_fence(__ATOMIC_SEQ_CST);
+
+			// a writer that claimed the slot meanwhile clears seq first
+			if (slot.seq != seq)
+				continue;
+
+			event.seq = seq;
+			tail++;
+			return true;
+		}
+	}
+
+	void clear()
+	{
+		tail = __atomic_load_n(&head, __ATOMIC_RELAXED);
+		dropped = 0;
+	}
+
+#else
+
+	bool read(AudioTraceEvent& event) { return false; }
+	void clear() { }
+
+#endif
+}
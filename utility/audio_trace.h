@@ -0,0 +1,112 @@
+#pragma once
+
+#include <Arduino.h>
+#include "../AudioConfig.h"
+
+// Event trace for timeline views of the interrupts, queues and callback (AUDIO_TRACE).
+// Every event is a DWT cycle timestamp, a phase, a name (string literal) and an argument,
+// written into a ring of AUDIO_TRACE_EVENTS slots by whichever context raises it: the DMA
+// interrupts, the software interrupt and loop() can all preempt each other. A writer claims
+// a slot with one atomic increment (LDREX/STREX) and marks it complete by storing its
+// sequence number last, so nothing waits and nothing disables interrupts. The ring keeps
+// the newest events; loop() drains it with audio_trace::drain() and extras/host/tools/trace2json.py
+// turns the text into Chrome trace_event JSON (chrome://tracing, ui.perfetto.dev).
+//
+// With AUDIO_TRACE 0 the macros compile to nothing.
+
+struct AudioTraceEvent
+{
+	enum Phase : uint8_t { Begin = 'B', End = 'E', Instant = 'i', Counter = 'C' };
+
+	volatile uint32_t seq; // sequence number + 1 once the event is complete
+	uint32_t cycles;
+	const char* name;
+	int32_t arg;
+	Phase phase;
+};
+
+namespace audio_trace
+{
+	static_assert((AUDIO_TRACE_EVENTS & (AUDIO_TRACE_EVENTS - 1)) == 0, "AUDIO_TRACE_EVENTS must be a power of two");
+
+	extern AudioTraceEvent events[AUDIO_TRACE_EVENTS];
+	extern uint32_t head;     // next sequence number to hand out
+	extern uint32_t tail;     // next sequence number to drain
+	extern uint32_t dropped;  // events overwritten before they were drained
+
+	inline void record(AudioTraceEvent::Phase phase, const char* name, int32_t arg = 0)
+	{
+		uint32_t cycles = ARM_DWT_CYCCNT;
+		uint32_t n = __atomic_fetch_add(&head, 1, __ATOMIC_RELAXED);
+		AudioTraceEvent& event = events[n & (AUDIO_TRACE_EVENTS - 1)];
+		event.seq = 0;
+		__atomic_signal_fence(__ATOMIC_SEQ_CST);
+		event.cycles = cycles;
+		event.name = name;
+		event.arg = arg;
+		event.phase = phase;
+		__atomic_signal_fence(__ATOMIC_SEQ_CST);
+		event.seq = n + 1;
+	}
+
+	// Span for the lifetime of a scope
+	class Scope
+	{
+	public:
+		inline Scope(const char* name) : name(name) { record(AudioTraceEvent::Begin, name); }
+		inline ~Scope() { record(AudioTraceEvent::End, name); }
+	private:
+		const char* name;
+	};
+
+	// Copies the oldest complete event not drained yet, returns false if there is none.
+	// Only from loop(): an event still being written stops the drain until the next call.
+	bool read(AudioTraceEvent& event);
+
+	// Prints up to `max` events as lines of "cycles phase name arg" to Serial or any other
+	// Print, preceded by a "# audio_trace <F_CPU_ACTUAL> <dropped>" line when anything was drained.
+	template <typename Out>
+	size_t drain(Out& out, size_t max = 64)
+	{
+		AudioTraceEvent event;
+		size_t count = 0;
+		while (count < max && read(event))
+		{
+			if (count == 0)
+			{
+				out.print("# audio_trace ");
+				out.print((unsigned long)F_CPU_ACTUAL);
+				out.print(' ');
+				out.println((unsigned long)dropped);
+			}
+			out.print((unsigned long)event.cycles);
+			out.print(' ');
+			out.print((char)event.phase);
+			out.print(' ');
+			out.print(event.name);
+			out.print(' ');
+			out.println((long)event.arg);
+			count++;
+		}
+		return count;
+	}
+
+	// Forgets everything recorded so far
+	void clear();
+}
+
+#if AUDIO_TRACE
+#define AUDIO_TRACE_JOIN2(a, b) a##b
+#define AUDIO_TRACE_JOIN(a, b) AUDIO_TRACE_JOIN2(a, b)
+#define AUDIO_TRACE_BEGIN(name) audio_trace::record(AudioTraceEvent::Begin, name)
+#define AUDIO_TRACE_END(name) audio_trace::record(AudioTraceEvent::End, name)
+#define AUDIO_TRACE_INSTANT(name, arg) audio_trace::record(AudioTraceEvent::Instant, name, arg)
+#define AUDIO_TRACE_COUNTER(name, value) audio_trace::record(AudioTraceEvent::Counter, name, value)
+#define AUDIO_TRACE_SCOPE(name) audio_trace::Scope AUDIO_TRACE_JOIN(audioTraceScope, __LINE__)(name)
+#else
+#define AUDIO_TRACE_BEGIN(name) do { } while (0)
+#define AUDIO_TRACE_END(name) do { } while (0)
+#define AUDIO_TRACE_INSTANT(name, arg) do { } while (0)
+#define AUDIO_TRACE_COUNTER(name, value) do { } while (0)
+#define AUDIO_TRACE_SCOPE(name) do { } while (0)
+#endif
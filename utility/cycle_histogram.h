@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// Log-bucketed histogram of cycle counts, in the spirit of HdrHistogram.
+// Values below 8 get a bucket each, above that every power of two is split into 8
+// linear sub-buckets, so a bucket is never wider than 1/8 of its value and the full
+// 32 bit range fits in 240 counters. Recording is a count-leading-zeros, two shifts
+// and an increment, cheap enough for the audio interrupt.
+class CycleHistogram
+{
+public:
+	static const int SUB_BUCKET_BITS = 3;
+	static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+	static const int BUCKETS = (32 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+	uint32_t counts[BUCKETS];
+
+	inline CycleHistogram() { clear(); }
+
+	inline void clear() { memset(counts, 0, sizeof(counts)); }
+
+	inline void record(uint32_t value)
+	{
+		counts[bucketOf(value)]++;
+	}
+
+	static inline int bucketOf(uint32_t value)
+	{
+		if (value < SUB_BUCKETS)
+			return value;
+
+		int exponent = 31 - __builtin_clz(value); // >= SUB_BUCKET_BITS
+		int shift = exponent - SUB_BUCKET_BITS;
+		return (shift + 1) * SUB_BUCKETS + ((value >> shift) & (SUB_BUCKETS - 1));
+	}
+
+	// Largest value that lands in a bucket
+	static inline uint32_t bucketHigh(int bucket)
+	{
+		if (bucket < SUB_BUCKETS)
+			return bucket;
+
+		int shift = bucket / SUB_BUCKETS - 1;
+		uint32_t low = (uint32_t)(SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+		return low + ((1u << shift) - 1);
+	}
+
+	inline uint32_t count() const
+	{
+		uint32_t total = 0;
+		for (int i = 0; i < BUCKETS; i++)
+			total += counts[i];
+		return total;
+	}
+
+	// Upper bound of the bucket holding the given percentile (0 to 100) of the recorded values,
+	// 0 when nothing was recorded. Meant for loop(): a value recorded meanwhile may or may not count.
+	inline uint32_t percentile(float percent) const
+	{
+		uint32_t total = count();
+		if (total == 0)
+			return 0;
+
+		uint64_t target = (uint64_t)((double)total * percent / 100.0 + 0.999999);
+		if (target == 0)
+			target = 1;
+
+		uint64_t seen = 0;
+		for (int i = 0; i < BUCKETS; i++)
+		{
+			seen += counts[i];
+			if (seen >= target)
+				return bucketHigh(i);
+		}
+		return bucketHigh(BUCKETS - 1);
+	}
+};
@@ -37,7 +37,7 @@ static inline int32_t signed_saturate_rshift(int32_t val, int bits, int rshift)
 	int32_t out;
 	asm volatile("ssat %0, %1, %2, asr %3" : "=r" (out) : "I" (bits), "r" (val), "I" (rshift));
 	return out;
-#elif defined(KINETISL)
+#else
 	int32_t out, max;
 	out = val >> rshift;
 	max = 1 << (bits - 1);
@@ -75,7 +75,7 @@ static inline int32_t signed_multiply_32x16b(int32_t a, uint32_t b)
 	int32_t out;
 	asm volatile("smulwb %0, %1, %2" : "=r" (out) : "r" (a), "r" (b));
 	return out;
-#elif defined(KINETISL)
+#else
 	return ((int64_t)a * (int16_t)(b & 0xFFFF)) >> 16;
 #endif
 }
@@ -88,7 +88,7 @@ static inline int32_t signed_multiply_32x16t(int32_t a, uint32_t b)
 	int32_t out;
 	asm volatile("smulwt %0, %1, %2" : "=r" (out) : "r" (a), "r" (b));
 	return out;
-#elif defined(KINETISL)
+#else
 	return ((int64_t)a * (int16_t)(b >> 16)) >> 16;
 #endif
 }
@@ -101,12 +101,12 @@ static inline int32_t multiply_32x32_rshift32(int32_t a, int32_t b)
 	int32_t out;
 	asm volatile("smmul %0, %1, %2" : "=r" (out) : "r" (a), "r" (b));
 	return out;
-#elif defined(KINETISL)
+#else
 	return ((int64_t)a * (int64_t)b) >> 32;
 #endif
 }
 
-// computes (((int64_t)a[31:0] * (int64_t)b[31:0] + 0x8000000) >> 32)
+// computes (((int64_t)a[31:0] * (int64_t)b[31:0] + 0x80000000) >> 32)
 static inline int32_t multiply_32x32_rshift32_rounded(int32_t a, int32_t b) __attribute__((always_inline, unused));
 static inline int32_t multiply_32x32_rshift32_rounded(int32_t a, int32_t b)
 {
@@ -114,12 +114,12 @@ static inline int32_t multiply_32x32_rshift32_rounded(int32_t a, int32_t b)
 	int32_t out;
 	asm volatile("smmulr %0, %1, %2" : "=r" (out) : "r" (a), "r" (b));
 	return out;
-#elif defined(KINETISL)
-	return (((int64_t)a * (int64_t)b) + 0x8000000) >> 32;
+#else
+	return (((int64_t)a * (int64_t)b) + 0x80000000) >> 32;
 #endif
 }
 
-// computes sum + (((int64_t)a[31:0] * (int64_t)b[31:0] + 0x8000000) >> 32)
+// computes sum + (((int64_t)a[31:0] * (int64_t)b[31:0] + 0x80000000) >> 32)
 static inline int32_t multiply_accumulate_32x32_rshift32_rounded(int32_t sum, int32_t a, int32_t b) __attribute__((always_inline, unused));
 static inline int32_t multiply_accumulate_32x32_rshift32_rounded(int32_t sum, int32_t a, int32_t b)
 {
@@ -127,12 +127,12 @@ static inline int32_t multiply_accumulate_32x32_rshift32_rounded(int32_t sum, in
 	int32_t out;
 	asm volatile("smmlar %0, %2, %3, %1" : "=r" (out) : "r" (sum), "r" (a), "r" (b));
 	return out;
-#elif defined(KINETISL)
-	return sum + ((((int64_t)a * (int64_t)b) + 0x8000000) >> 32);
+#else
+	return sum + ((((int64_t)a * (int64_t)b) + 0x80000000) >> 32);
 #endif
 }
 
-// computes sum - (((int64_t)a[31:0] * (int64_t)b[31:0] + 0x8000000) >> 32)
+// computes sum - (((int64_t)a[31:0] * (int64_t)b[31:0] + 0x80000000) >> 32)
 static inline int32_t multiply_subtract_32x32_rshift32_rounded(int32_t sum, int32_t a, int32_t b) __attribute__((always_inline, unused));
 static inline int32_t multiply_subtract_32x32_rshift32_rounded(int32_t sum, int32_t a, int32_t b)
 {
@@ -140,8 +140,8 @@ static inline int32_t multiply_subtract_32x32_rshift32_rounded(int32_t sum, int3
 	int32_t out;
 	asm volatile("smmlsr %0, %2, %3, %1" : "=r" (out) : "r" (sum), "r" (a), "r" (b));
 	return out;
-#elif defined(KINETISL)
-	return sum - ((((int64_t)a * (int64_t)b) + 0x8000000) >> 32);
+#else
+	return sum - ((((int64_t)a * (int64_t)b) + 0x80000000) >> 32);
 #endif
 }
 
@@ -154,7 +154,7 @@ static inline uint32_t pack_16t_16t(int32_t a, int32_t b)
 	int32_t out;
 	asm volatile("pkhtb %0, %1, %2, asr #16" : "=r" (out) : "r" (a), "r" (b));
 	return out;
-#elif defined(KINETISL)
+#else
 	return (a & 0xFFFF0000) | ((uint32_t)b >> 16);
 #endif
 }
@@ -167,7 +167,7 @@ static inline uint32_t pack_16t_16b(int32_t a, int32_t b)
 	int32_t out;
 	asm volatile("pkhtb %0, %1, %2" : "=r" (out) : "r" (a), "r" (b));
 	return out;
-#elif defined(KINETISL)
+#else
 	return (a & 0xFFFF0000) | (b & 0x0000FFFF);
 #endif
 }
@@ -180,7 +180,7 @@ static inline uint32_t pack_16b_16b(int32_t a, int32_t b)
 	int32_t out;
 	asm volatile("pkhbt %0, %1, %2, lsl #16" : "=r" (out) : "r" (b), "r" (a));
 	return out;
-#elif defined(KINETISL)
+#else
 	return (a << 16) | (b & 0x0000FFFF);
 #endif
 }
@@ -351,8 +351,6 @@ static inline int32_t FRACMUL_SHL(int32_t x, int32_t y, int z)
     return t;
 }
 
-#endif
-
 //get Q from PSR
 static inline uint32_t get_q_psr(void) __attribute__((always_inline, unused));
 static inline uint32_t get_q_psr(void)
@@ -371,5 +369,138 @@ static inline void clr_q_psr(void)
        "msr APSR_nzcvq,%0\n" : [t] "=&r" (t)::"cc");
 }
 
+#else
+
+// Plain C versions of the DSP extension instructions above, for other targets and the host
+// build (extras/host). Same results, without the Q flag.
+
+static inline int32_t dspinst_saturate16(int32_t val) __attribute__((always_inline, unused));
+static inline int32_t dspinst_saturate16(int32_t val)
+{
+	return val > 32767 ? 32767 : (val < -32768 ? -32768 : val);
+}
+
+static inline uint32_t dspinst_pack16(int32_t hi, int32_t lo) __attribute__((always_inline, unused));
+static inline uint32_t dspinst_pack16(int32_t hi, int32_t lo)
+{
+	return ((uint32_t)hi << 16) | ((uint32_t)lo & 0xFFFF);
+}
+
+static inline uint32_t signed_add_16_and_16(uint32_t a, uint32_t b) __attribute__((always_inline, unused));
+static inline uint32_t signed_add_16_and_16(uint32_t a, uint32_t b)
+{
+	return dspinst_pack16(dspinst_saturate16((int16_t)(a >> 16) + (int16_t)(b >> 16)),
+		dspinst_saturate16((int16_t)a + (int16_t)b));
+}
+
+static inline int32_t signed_subtract_16_and_16(int32_t a, int32_t b) __attribute__((always_inline, unused));
+static inline int32_t signed_subtract_16_and_16(int32_t a, int32_t b)
+{
+	return dspinst_pack16(dspinst_saturate16((int16_t)(a >> 16) - (int16_t)(b >> 16)),
+		dspinst_saturate16((int16_t)a - (int16_t)b));
+}
+
+static inline int32_t signed_halving_add_16_and_16(int32_t a, int32_t b) __attribute__((always_inline, unused));
+static inline int32_t signed_halving_add_16_and_16(int32_t a, int32_t b)
+{
+	return dspinst_pack16(((int16_t)(a >> 16) + (int16_t)(b >> 16)) >> 1, ((int16_t)a + (int16_t)b) >> 1);
+}
+
+static inline int32_t signed_halving_subtract_16_and_16(int32_t a, int32_t b) __attribute__((always_inline, unused));
+static inline int32_t signed_halving_subtract_16_and_16(int32_t a, int32_t b)
+{
+	return dspinst_pack16(((int16_t)(a >> 16) - (int16_t)(b >> 16)) >> 1, ((int16_t)a - (int16_t)b) >> 1);
+}
+
+static inline int32_t signed_multiply_accumulate_32x16b(int32_t sum, int32_t a, uint32_t b) __attribute__((always_inline, unused));
+static inline int32_t signed_multiply_accumulate_32x16b(int32_t sum, int32_t a, uint32_t b)
+{
+	return sum + (int32_t)(((int64_t)a * (int16_t)(b & 0xFFFF)) >> 16);
+}
+
+static inline int32_t signed_multiply_accumulate_32x16t(int32_t sum, int32_t a, uint32_t b) __attribute__((always_inline, unused));
+static inline int32_t signed_multiply_accumulate_32x16t(int32_t sum, int32_t a, uint32_t b)
+{
+	return sum + (int32_t)(((int64_t)a * (int16_t)(b >> 16)) >> 16);
+}
+
+static inline uint32_t logical_and(uint32_t a, uint32_t b) __attribute__((always_inline, unused));
+static inline uint32_t logical_and(uint32_t a, uint32_t b)
+{
+	return a & b;
+}
+
+static inline int32_t multiply_16tx16t_add_16bx16b(uint32_t a, uint32_t b) __attribute__((always_inline, unused));
+static inline int32_t multiply_16tx16t_add_16bx16b(uint32_t a, uint32_t b)
+{
+	// summed unsigned like SMUAD: 0x8000 * 0x8000 twice wraps to INT32_MIN instead of overflowing
+	return (int32_t)((uint32_t)((int16_t)a * (int16_t)b) + (uint32_t)((int16_t)(a >> 16) * (int16_t)(b >> 16)));
+}
+
+static inline int32_t multiply_16tx16b_add_16bx16t(uint32_t a, uint32_t b) __attribute__((always_inline, unused));
+static inline int32_t multiply_16tx16b_add_16bx16t(uint32_t a, uint32_t b)
+{
+	return (int32_t)((uint32_t)((int16_t)a * (int16_t)(b >> 16)) + (uint32_t)((int16_t)(a >> 16) * (int16_t)b));
+}
+
+static inline int64_t multiply_accumulate_16tx16t_add_16bx16b(int64_t sum, uint32_t a, uint32_t b)
+{
+	return sum + (int16_t)a * (int16_t)b + (int16_t)(a >> 16) * (int16_t)(b >> 16);
+}
+
+static inline int64_t multiply_accumulate_16tx16b_add_16bx16t(int64_t sum, uint32_t a, uint32_t b)
+{
+	return sum + (int16_t)a * (int16_t)(b >> 16) + (int16_t)(a >> 16) * (int16_t)b;
+}
+
+static inline int32_t multiply_16bx16b(uint32_t a, uint32_t b) __attribute__((always_inline, unused));
+static inline int32_t multiply_16bx16b(uint32_t a, uint32_t b)
+{
+	return (int16_t)a * (int16_t)b;
+}
+
+static inline int32_t multiply_16bx16t(uint32_t a, uint32_t b) __attribute__((always_inline, unused));
+static inline int32_t multiply_16bx16t(uint32_t a, uint32_t b)
+{
+	return (int16_t)a * (int16_t)(b >> 16);
+}
+
+static inline int32_t multiply_16tx16b(uint32_t a, uint32_t b) __attribute__((always_inline, unused));
+static inline int32_t multiply_16tx16b(uint32_t a, uint32_t b)
+{
+	return (int16_t)(a >> 16) * (int16_t)b;
+}
+
+static inline int32_t multiply_16tx16t(uint32_t a, uint32_t b) __attribute__((always_inline, unused));
+static inline int32_t multiply_16tx16t(uint32_t a, uint32_t b)
+{
+	return (int16_t)(a >> 16) * (int16_t)(b >> 16);
+}
+
+static inline int32_t substract_32_saturate(uint32_t a, uint32_t b) __attribute__((always_inline, unused));
+static inline int32_t substract_32_saturate(uint32_t a, uint32_t b)
+{
+	int64_t out = (int64_t)(int32_t)a - (int32_t)b;
+	return out > INT32_MAX ? INT32_MAX : (out < INT32_MIN ? INT32_MIN : (int32_t)out);
+}
+
+static inline int32_t FRACMUL_SHL(int32_t x, int32_t y, int z)
+{
+	return (int32_t)(((int64_t)x * y) >> (31 - z));
+}
+
+static inline uint32_t get_q_psr(void) __attribute__((always_inline, unused));
+static inline uint32_t get_q_psr(void)
+{
+	return 0;
+}
+
+static inline void clr_q_psr(void) __attribute__((always_inline, unused));
+static inline void clr_q_psr(void)
+{
+}
+
+#endif
+
 
 #endif
@@ -0,0 +1,556 @@
+/* FLAC frames from interleaved PCM, WavWriter's lossless stage
+ *
+ * Encodes the segments of WavWriter's ring (16 bit, packed 24 bit or 32 bit interleaved
+ * samples in the layout of pcm_pack.h) into FLAC frames (RFC 9639). It runs from loop(),
+ * on a segment the callback has finished with, never in the audio interrupt. Each
+ * channel of a frame is stored as the smallest of:
+ *
+ *  CONSTANT   one value, for silent or unconnected inputs
+ *  FIXED      polynomial prediction of order 0 to 4, the residual Rice coded in up to
+ *             256 partitions with a parameter each
+ *  VERBATIM   the samples as they are, for noise that does not compress
+ *
+ * Low bits that are 0 in every sample of a channel are left out (FLAC's wasted bits), so a
+ * 24 bit codec recorded at 32 bit costs no more than at 24. Channels are coded
+ * independently and there is no LPC: choosing the fixed predictor is one pass over the
+ * channel, coding it another, so the cost per sample stays low and does not depend on
+ * the signal. The Rice parameters come from the partition sums without a division.
+ *
+ * One frame per segment, fixed block size. The MD5 in STREAMINFO is 0 ("not computed").
+ * 32 bit streams need a decoder that follows RFC 9639 (libFLAC 1.4 and later).
+ */
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include "pcm_pack.h"
+
+// Prediction arithmetic: 16 and 24 bit residuals fit 32 bits, 32 bit samples need 64
+template <bool Wide> struct flac_acc { typedef int32_t type; };
+template <> struct flac_acc<true> { typedef int64_t type; };
+
+// CRC-16 of FLAC frames, polynomial x^16 + x^15 + x^2 + 1, built at compile time
+struct FlacCrc16Table
+{
+	uint16_t t[256];
+
+	constexpr FlacCrc16Table() : t()
+	{
+		for (unsigned i = 0; i < 256; i++)
+		{
+			unsigned crc = i << 8;
+			for (int b = 0; b < 8; b++)
+				crc = (crc & 0x8000) ? (crc << 1) ^ 0x8005 : crc << 1;
+			t[i] = (uint16_t)crc;
+		}
+	}
+};
+
+static constexpr FlacCrc16Table kFlacCrc16 = FlacCrc16Table();
+
+// `crc` continues the CRC of the bytes before p, for frames read in pieces
+static inline uint16_t flac_crc16(const uint8_t* p, size_t n, uint16_t crc = 0) __attribute__((unused));
+static inline uint16_t flac_crc16(const uint8_t* p, size_t n, uint16_t crc)
+{
+	for (size_t i = 0; i < n; i++)
+		crc = (uint16_t)(crc << 8) ^ kFlacCrc16.t[(crc >> 8) ^ p[i]];
+	return crc;
+}
+
+// CRC-8 of frame headers, polynomial x^8 + x^2 + x + 1; a dozen bytes, no table
+static inline uint8_t flac_crc8(const uint8_t* p, size_t n) __attribute__((unused));
+static inline uint8_t flac_crc8(const uint8_t* p, size_t n)
+{
+	unsigned crc = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		crc ^= p[i];
+		for (int b = 0; b < 8; b++)
+			crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+	}
+	return (uint8_t)crc;
+}
+
+// Reads the fixed block size frame header at p (n bytes available): the frame number and
+// the frames in it. Returns the header size with the CRC-8, 0 if p is not a valid header.
+// Finds the frames of a file again without decoding them, WavWriter::RecoverFile().
+static inline size_t flac_frame_header(const uint8_t* p, size_t n, uint32_t* number, uint32_t* frames) __attribute__((unused));
+static inline size_t flac_frame_header(const uint8_t* p, size_t n, uint32_t* number, uint32_t* frames)
+{
+	if (n < 6 || p[0] != 0xFF || p[1] != 0xF8 || (p[3] & 1) || (p[3] >> 4) > 10)
+		return 0;
+	unsigned blockCode = p[2] >> 4, rateCode = p[2] & 15, bitsCode = (p[3] >> 1) & 7;
+	if (blockCode == 0 || rateCode == 15 || bitsCode == 3)
+		return 0;
+
+	// frame number, UTF-8 style: as many continuation bytes as leading ones after the first
+	unsigned extra = p[4] < 0x80 ? 0 : __builtin_clz(~((uint32_t)p[4] << 24)) - 1;
+	if ((extra == 0 && p[4] >= 0x80) || extra > 5)
+		return 0;
+	uint32_t value = p[4] & (extra ? 0x3F >> extra : 0x7F);
+	size_t h = 5;
+	for (unsigned i = 0; i < extra; i++, h++)
+	{
+		if (h >= n || (p[h] & 0xC0) != 0x80)
+			return 0;
+		value = value << 6 | (p[h] & 0x3F);
+	}
+
+	uint32_t block;
+	if (blockCode == 1)
+		block = 192;
+	else if (blockCode <= 5)
+		block = 576u << (blockCode - 2);
+	else if (blockCode >= 8)
+		block = 256u << (blockCode - 8);
+	else
+	{
+		if (h + blockCode - 5 > n)
+			return 0;
+		block = blockCode == 6 ? p[h] + 1u : (p[h] << 8 | p[h + 1]) + 1u;
+		h += blockCode - 5;
+	}
+	h += rateCode == 12 ? 1 : rateCode >= 13 ? 2 : 0;
+	if (h >= n || flac_crc8(p, h) != p[h])
+		return 0;
+	*number = value;
+	*frames = block;
+	return h + 1;
+}
+
+// MSB first bit stream, written a word at a time
+struct FlacBitWriter
+{
+	uint8_t* p;
+	uint64_t acc = 0;
+	unsigned bits = 0; // in acc, below 32 between calls
+
+	explicit FlacBitWriter(uint8_t* dest) : p(dest) {}
+
+	// the low n bits of v, n = 1 to 32
+	inline void put(uint32_t v, unsigned n)
+	{
+		acc = (acc << n) | v;
+		bits += n;
+		if (bits >= 32)
+		{
+			bits -= 32;
+			uint32_t w = __builtin_bswap32((uint32_t)(acc >> bits));
+			memcpy(p, &w, 4);
+			p += 4;
+		}
+	}
+
+	inline void putSigned(int32_t v, unsigned n)
+	{
+		put(n < 32 ? (uint32_t)v & ((1u << n) - 1) : (uint32_t)v, n);
+	}
+
+	inline void zeros(uint32_t n)
+	{
+		for (; n >= 32; n -= 32)
+			put(0, 32);
+		if (n)
+			put(0, n);
+	}
+
+	// q = u >> k zeros, a one, and the low k bits of u
+	inline void rice(uint32_t u, unsigned k)
+	{
+		uint32_t q = u >> k;
+		uint32_t low = (1u << k) | (u & ((1u << k) - 1));
+		if (q + k < 32)
+		{
+			put(low, q + k + 1);
+		}
+		else
+		{
+			zeros(q);
+			put(low, k + 1);
+		}
+	}
+
+	// pads to a whole byte, returns the end of the stream
+	inline uint8_t* flush()
+	{
+		if (bits & 7)
+			put(0, 8 - (bits & 7));
+		while (bits)
+		{
+			bits -= 8;
+			*p++ = (uint8_t)(acc >> bits);
+		}
+		return p;
+	}
+};
+
+template <size_t Channels, size_t Bits, size_t MaxFrames>
+class FlacEncoder
+{
+public:
+	static_assert(Channels > 0 && Channels <= 8, "FLAC streams have 1 to 8 channels");
+	static_assert(Bits == 16 || Bits == 24 || Bits == 32, "FlacEncoder takes 16, 24 or 32 bit samples");
+	static_assert(MaxFrames >= 16 && MaxFrames <= 65535, "FLAC blocks have 16 to 65535 frames");
+
+	// "fLaC" and the STREAMINFO block
+	static constexpr size_t kStreamHeaderBytes = 42;
+	// the largest frame: a frame header, verbatim subframes with the wasted bits field,
+	// the padding and the CRC
+	static constexpr size_t kMaxFrameBytes = 16 + MaxFrames * Channels * Bits / 8 + Channels * 6 + 2;
+
+	// Starts a new stream
+	void begin(uint32_t sampleRate)
+	{
+		sampleRate_ = sampleRate;
+		frame_ = 0;
+		maxBlock_ = 0;
+		minFrameBytes_ = 0;
+		maxFrameBytes_ = 0;
+	}
+
+	// "fLaC" and STREAMINFO for a stream of `frames` frames, into kStreamHeaderBytes bytes
+	void streamHeader(uint8_t* out, uint64_t frames) const
+	{
+		uint32_t block = maxBlock_ ? maxBlock_ : MaxFrames;
+		memcpy(out, "fLaC", 4);
+		out[4] = 0x80; // the last metadata block, STREAMINFO
+		out[5] = 0;
+		out[6] = 0;
+		out[7] = 34;
+		out[8] = out[10] = (uint8_t)(block >> 8); // same minimum and maximum block size
+		out[9] = out[11] = (uint8_t)block;
+		for (int i = 0; i < 3; i++)
+		{
+			out[12 + i] = (uint8_t)(minFrameBytes_ >> (16 - 8 * i));
+			out[15 + i] = (uint8_t)(maxFrameBytes_ >> (16 - 8 * i));
+		}
+		uint64_t v = ((uint64_t)sampleRate_ << 44) | ((uint64_t)(Channels - 1) << 41) | ((uint64_t)(Bits - 1) << 36) | (frames & 0xFFFFFFFFFull);
+		for (int i = 0; i < 8; i++)
+			out[18 + i] = (uint8_t)(v >> (56 - 8 * i));
+		memset(out + 26, 0, 16); // MD5 not computed
+	}
+
+	// Encodes `frames` interleaved frames (up to MaxFrames) as the next FLAC frame into
+	// out, kMaxFrameBytes of room. Returns the frame's size in bytes.
+	size_t encodeFrame(const uint8_t* pcm, size_t frames, uint8_t* out)
+	{
+		uint8_t* h = out;
+		*h++ = 0xFF;
+		*h++ = 0xF8; // sync code, fixed block size
+		unsigned blockCode = blockSizeCode(frames);
+		*h++ = (uint8_t)(blockCode << 4 | sampleRateCode(sampleRate_));
+		*h++ = (uint8_t)((Channels - 1) << 4 | (Bits == 16 ? 4 : Bits == 24 ? 6 : 7) << 1);
+		h = putFrameNumber(h, frame_);
+		if (blockCode == 6)
+		{
+			*h++ = (uint8_t)(frames - 1);
+		}
+		else if (blockCode == 7)
+		{
+			*h++ = (uint8_t)((frames - 1) >> 8);
+			*h++ = (uint8_t)(frames - 1);
+		}
+		*h = flac_crc8(out, h - out);
+		h++;
+
+		FlacBitWriter bw(h);
+		for (size_t k = 0; k < Channels; k++)
+			encodeSubframe(pcm + k * kSampleBytes, frames, bw);
+		uint8_t* end = bw.flush();
+
+		uint16_t crc = flac_crc16(out, end - out);
+		*end++ = (uint8_t)(crc >> 8);
+		*end++ = (uint8_t)crc;
+
+		uint32_t bytes = end - out;
+		if (frame_ == 0 || bytes < minFrameBytes_)
+			minFrameBytes_ = bytes;
+		if (bytes > maxFrameBytes_)
+			maxFrameBytes_ = bytes;
+		if (frames > maxBlock_)
+			maxBlock_ = frames;
+		frame_++;
+		return bytes;
+	}
+
+private:
+	typedef typename flac_acc<(Bits > 24)>::type Acc;
+
+	static constexpr size_t kSampleBytes = Bits / 8;
+	static constexpr size_t kStride = Channels * kSampleBytes;
+	static constexpr unsigned kMaxPartitionOrder = 8;
+
+	uint32_t residual_[MaxFrames]; // zigzag coded, one channel
+	uint64_t sums_[1 << kMaxPartitionOrder];
+	uint8_t params_[1 << kMaxPartitionOrder];
+	uint8_t bestParams_[1 << kMaxPartitionOrder];
+	uint32_t sampleRate_ = 0;
+	uint32_t frame_ = 0;
+	uint32_t maxBlock_ = 0;
+	uint32_t minFrameBytes_ = 0, maxFrameBytes_ = 0;
+
+	static inline int32_t load(const uint8_t* p)
+	{
+		switch (Bits)
+		{
+			case 16:
+			{
+				int16_t v;
+				memcpy(&v, p, 2);
+				return v;
+			}
+			case 24:
+				return pcm_unpack24(p) >> 8;
+			default:
+			{
+				int32_t v;
+				memcpy(&v, p, 4);
+				return v;
+			}
+		}
+	}
+
+	static unsigned blockSizeCode(size_t frames)
+	{
+		if (frames >= 256 && frames <= 32768 && (frames & (frames - 1)) == 0)
+			return __builtin_ctz(frames); // 8 to 15: 256 to 32768
+		if (frames == 192)
+			return 1;
+		if (frames == 576 || frames == 1152 || frames == 2304 || frames == 4608)
+			return 2 + __builtin_ctz(frames / 576);
+		return frames <= 256 ? 6 : 7;
+	}
+
+	static unsigned sampleRateCode(uint32_t rate)
+	{
+		switch (rate)
+		{
+			case 88200: return 1;
+			case 176400: return 2;
+			case 192000: return 3;
+			case 8000: return 4;
+			case 16000: return 5;
+			case 22050: return 6;
+			case 24000: return 7;
+			case 32000: return 8;
+			case 44100: return 9;
+			case 48000: return 10;
+			case 96000: return 11;
+			default: return 0; // from STREAMINFO
+		}
+	}
+
+	// frame number, UTF-8 style
+	static uint8_t* putFrameNumber(uint8_t* p, uint32_t n)
+	{
+		if (n < 0x80)
+		{
+			*p++ = (uint8_t)n;
+			return p;
+		}
+		int extra = n < 0x800 ? 1 : n < 0x10000 ? 2 : n < 0x200000 ? 3 : n < 0x4000000 ? 4 : 5;
+		*p++ = (uint8_t)((0xFF00 >> (extra + 1)) | (n >> (6 * extra)));
+		for (int i = extra - 1; i >= 0; i--)
+			*p++ = (uint8_t)(0x80 | ((n >> (6 * i)) & 0x3F));
+		return p;
+	}
+
+	// Rice bits of a partition of `count` residuals summing to `sum`, without the parameter.
+	// An upper bound: the sum of the quotients is at most sum >> k.
+	static inline uint64_t riceBits(uint64_t sum, uint32_t count, unsigned& k)
+	{
+		// the best parameter is close to log2 of the mean, try its neighbours too
+		int guess = (sum > count) ? (63 - __builtin_clzll(sum)) - (31 - __builtin_clz(count)) : 0;
+		if (guess > 30)
+			guess = 30; // the largest parameter, full scale 32 bit noise
+		uint64_t best = ~0ull;
+		for (int c = guess - 1; c <= guess + 1; c++)
+		{
+			if (c < 0 || c > 30)
+				continue;
+			uint64_t bits = (uint64_t)count * (c + 1) + (sum >> c);
+			if (bits < best)
+			{
+				best = bits;
+				k = c;
+			}
+		}
+		return best;
+	}
+
+	// Residuals of one fixed predictor into residual_[order, n), zigzag coded.
+	// False if one does not fit a signed 32 bit word (without -2^31) as RFC 9639 asks,
+	// only possible with 32 bit samples.
+	template <unsigned Order>
+	bool residuals(const uint8_t* src, size_t n, unsigned shift)
+	{
+		Acc x1 = 0, x2 = 0, x3 = 0, x4 = 0;
+		if (Order > 0) x1 = load(src + (Order - 1) * kStride) >> shift;
+		if (Order > 1) x2 = load(src + (Order - 2) * kStride) >> shift;
+		if (Order > 2) x3 = load(src + (Order - 3) * kStride) >> shift;
+		if (Order > 3) x4 = load(src + (Order - 4) * kStride) >> shift;
+
+		bool fits = true;
+		for (size_t i = Order; i < n; i++)
+		{
+			Acc x = load(src + i * kStride) >> shift;
+			Acc r;
+			switch (Order)
+			{
+				case 0: r = x; break;
+				case 1: r = x - x1; break;
+				case 2: r = x - 2 * x1 + x2; break;
+				case 3: r = x - 3 * x1 + 3 * x2 - x3; break;
+				default: r = x - 4 * x1 + 6 * x2 - 4 * x3 + x4; break;
+			}
+			x4 = x3;
+			x3 = x2;
+			x2 = x1;
+			x1 = x;
+			if (sizeof(Acc) > 4)
+				fits &= r >= -2147483647ll && r <= 2147483647ll;
+			residual_[i] = ((uint32_t)r << 1) ^ (uint32_t)(r >> (sizeof(Acc) * 8 - 1));
+		}
+		return fits;
+	}
+
+	void encodeSubframe(const uint8_t* src, size_t n, FlacBitWriter& bw)
+	{
+		// pass 1: constant?, the wasted bits and the residual size of each predictor order
+		int32_t first = load(src);
+		uint32_t set = 0;
+		bool constant = true;
+		uint64_t sum[5] = {0, 0, 0, 0, 0};
+		Acc e0 = 0, e1 = 0, e2 = 0, e3 = 0;
+		for (size_t i = 0; i < n; i++)
+		{
+			Acc x = load(src + i * kStride);
+			set |= (uint32_t)x;
+			constant &= x == first;
+			Acc d1 = x - e0, d2 = d1 - e1, d3 = d2 - e2, d4 = d3 - e3;
+			e0 = x;
+			e1 = d1;
+			e2 = d2;
+			e3 = d3;
+			if (i >= 4)
+			{
+				sum[0] += x < 0 ? -x : x;
+				sum[1] += d1 < 0 ? -d1 : d1;
+				sum[2] += d2 < 0 ? -d2 : d2;
+				sum[3] += d3 < 0 ? -d3 : d3;
+				sum[4] += d4 < 0 ? -d4 : d4;
+			}
+		}
+
+		if (constant)
+		{
+			bw.put(0x00, 8);
+			bw.putSigned(first, Bits);
+			return;
+		}
+
+		unsigned shift = __builtin_ctz(set);
+		unsigned bps = Bits - shift;
+		uint64_t verbatimBits = (uint64_t)n * bps;
+
+		// pass 2: the residual of the best order and its Rice partitions
+		uint64_t fixedBits = ~0ull;
+		unsigned order = 0, partitionOrder = 0;
+		bool rice2 = false;
+		if (n > 4)
+		{
+			for (unsigned o = 1; o < 5; o++)
+				if (sum[o] < sum[order])
+					order = o;
+
+			bool fits;
+			switch (order)
+			{
+				case 0: fits = residuals<0>(src, n, shift); break;
+				case 1: fits = residuals<1>(src, n, shift); break;
+				case 2: fits = residuals<2>(src, n, shift); break;
+				case 3: fits = residuals<3>(src, n, shift); break;
+				default: fits = residuals<4>(src, n, shift); break;
+			}
+			if (fits)
+				fixedBits = order * bps + 6 + partition(n, order, partitionOrder, rice2);
+		}
+
+		bw.put((fixedBits < verbatimBits ? 0x10 | order << 1 : 0x02) | (shift ? 1 : 0), 8);
+		if (shift)
+			bw.put(1, shift); // wasted bits - 1 zeros and a one
+
+		if (fixedBits >= verbatimBits)
+		{
+			for (size_t i = 0; i < n; i++)
+				bw.putSigned(load(src + i * kStride) >> shift, bps);
+			return;
+		}
+
+		for (unsigned i = 0; i < order; i++)
+			bw.putSigned(load(src + i * kStride) >> shift, bps);
+
+		bw.put(rice2 ? 1 : 0, 2);
+		bw.put(partitionOrder, 4);
+		size_t per = n >> partitionOrder;
+		for (size_t j = 0, i = order; j < ((size_t)1 << partitionOrder); j++)
+		{
+			unsigned k = bestParams_[j];
+			bw.put(k, rice2 ? 5 : 4);
+			for (size_t end = (j + 1) * per; i < end; i++)
+				bw.rice(residual_[i], k);
+		}
+	}
+
+	// Picks the partition order and the parameters (bestParams_) with the fewest bits for
+	// residual_[order, n), returns that size
+	uint64_t partition(size_t n, unsigned order, unsigned& partitionOrder, bool& rice2)
+	{
+		// the finest split: the block divides evenly and the first partition is not empty
+		unsigned maxOrder = 0;
+		while (maxOrder < kMaxPartitionOrder && (n & ((2u << maxOrder) - 1)) == 0 && (n >> (maxOrder + 1)) > order)
+			maxOrder++;
+
+		size_t parts = (size_t)1 << maxOrder;
+		size_t per = n >> maxOrder;
+		for (size_t j = 0, i = order; j < parts; j++)
+		{
+			uint64_t s = 0;
+			for (size_t end = (j + 1) * per; i < end; i++)
+				s += residual_[i];
+			sums_[j] = s;
+		}
+
+		uint64_t best = ~0ull;
+		for (int p = maxOrder;; p--)
+		{
+			parts = (size_t)1 << p;
+			per = n >> p;
+			uint64_t bits = 0;
+			unsigned maxParam = 0;
+			for (size_t j = 0; j < parts; j++)
+			{
+				unsigned k = 0;
+				bits += 4 + riceBits(sums_[j], j ? per : per - order, k);
+				params_[j] = k;
+				if (k > maxParam)
+					maxParam = k;
+			}
+			// parameters over 14 need the 5 bit field
+			if (maxParam > 14)
+				bits += parts;
+			if (bits < best)
+			{
+				best = bits;
+				partitionOrder = p;
+				rice2 = maxParam > 14;
+				memcpy(bestParams_, params_, parts);
+			}
+			if (p == 0)
+				break;
+			for (size_t j = 0; j < parts / 2; j++)
+				sums_[j] = sums_[2 * j] + sums_[2 * j + 1];
+		}
+		return best;
+	}
+};
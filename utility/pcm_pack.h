@@ -0,0 +1,297 @@
+/* Planar callback blocks to interleaved PCM and back, for WavWriter and WavReader
+ *
+ * The callback's int32_t samples are the SAI words: at a word width of 16 or 24 bit
+ * (AudioOutputI2S::setFormat) the sample sits right-aligned in the low bits of the int32,
+ * sign-extended, at 32 bit it fills the word. The interleave kernels take `shift` =
+ * 32 - word width, left-justify each sample with it, then interleave `count` frames of
+ * Channels planar buffers into the byte layout of a WAV data chunk and keep the top
+ * bits of each sample on the way, so the file size does not depend on the word width:
+ *
+ *  pcm_interleave16   2 bytes per sample, the top 16 bits
+ *  pcm_interleave24   3 bytes per sample, packed: 4 samples are shifted and merged into
+ *                     3 words, so a 24 bit recording takes 3/4 of the bytes of a 32 bit one
+ *  pcm_interleave32   4 bytes per sample, the whole left-justified word
+ *  pcm_interleave_f32 4 byte IEEE floats in [-1.0, 1.0), converted from Q31 while the
+ *                     frames are interleaved (one VCVT per sample on the Cortex-M7), so a
+ *                     float recording costs no pass over the block of its own
+ *
+ * The pcm_deinterleave kernels go the other way for playback: each file sample becomes a
+ * left-justified int32 and is then shifted down arithmetically by the same `shift`, into a
+ * right-aligned word of the SAI word width (a 24 bit file on 16 bit words keeps its top 16
+ * bits); pcm_deinterleave_f32 converts IEEE float files to Q31 in the same pass.
+ *
+ * The channel loop is unrolled for the compile-time channel count, the frame count is
+ * a runtime value so a block can be split at a segment boundary. The 16 and 32 bit
+ * sides are aligned to their sample size, the packed one needs byte alignment.
+ */
+#pragma once
+
+#include <string.h>
+#include "tdm_transpose.h"
+#include "tdm_convert.h"
+
+// Packs the top 24 bits of 4 samples into 12 bytes, little endian
+static inline void pcm_pack24x4(uint32_t a, uint32_t b, uint32_t c, uint32_t d, uint8_t* dest) __attribute__((always_inline, unused));
+static inline void pcm_pack24x4(uint32_t a, uint32_t b, uint32_t c, uint32_t d, uint8_t* dest)
+{
+	uint32_t w0 = (a >> 8) | ((b << 16) & 0xFF000000);
+	uint32_t w1 = (b >> 16) | ((c << 8) & 0xFFFF0000);
+	uint32_t w2 = (c >> 24) | (d & 0xFFFFFF00);
+	// word stores, unaligned ones are fine on the M7 and the host
+	memcpy(dest, &w0, 4);
+	memcpy(dest + 4, &w1, 4);
+	memcpy(dest + 8, &w2, 4);
+}
+
+// The top 24 bits of one sample into 3 bytes
+static inline void pcm_pack24(uint32_t a, uint8_t* dest) __attribute__((always_inline, unused));
+static inline void pcm_pack24(uint32_t a, uint8_t* dest)
+{
+	dest[0] = (uint8_t)(a >> 8);
+	dest[1] = (uint8_t)(a >> 16);
+	dest[2] = (uint8_t)(a >> 24);
+}
+
+template <size_t Channels>
+static inline void pcm_interleave16(const int32_t* const* src, size_t count, int16_t* dest, unsigned shift)
+{
+	static_assert(Channels > 0 && Channels <= TDM_MAX_CHANNELS, "TDM supports 1 to 16 slots per frame");
+
+	// local copy, the stores cannot change it
+	const int32_t* s[Channels];
+	for (size_t k = 0; k < Channels; k++)
+		s[k] = src[k];
+
+	for (size_t i = 0; i < count; i++)
+	{
+		for (size_t k = 0; k < Channels; k++)
+			dest[k] = (int16_t)(((uint32_t)s[k][i] << shift) >> 16);
+		dest += Channels;
+	}
+}
+
+template <size_t Channels>
+static inline void pcm_interleave24(const int32_t* const* src, size_t count, uint8_t* dest, unsigned shift)
+{
+	static_assert(Channels > 0 && Channels <= TDM_MAX_CHANNELS, "TDM supports 1 to 16 slots per frame");
+
+	const int32_t* s[Channels];
+	for (size_t k = 0; k < Channels; k++)
+		s[k] = src[k];
+
+	size_t i = 0;
+	if (Channels % 4 == 0)
+	{
+		// whole groups of 4 in every frame
+		for (; i < count; i++)
+		{
+			for (size_t k = 0; k < Channels; k += 4)
+			{
+				pcm_pack24x4((uint32_t)s[k][i] << shift, (uint32_t)s[k + 1][i] << shift,
+					(uint32_t)s[k + 2][i] << shift, (uint32_t)s[k + 3][i] << shift, dest);
+				dest += 12;
+			}
+		}
+	}
+	else if (Channels % 4 == 2)
+	{
+		// a group spans two frames
+		for (; i + 1 < count; i += 2)
+		{
+			for (size_t k = 0; k + 4 <= Channels; k += 4)
+			{
+				pcm_pack24x4((uint32_t)s[k][i] << shift, (uint32_t)s[k + 1][i] << shift,
+					(uint32_t)s[k + 2][i] << shift, (uint32_t)s[k + 3][i] << shift, dest);
+				dest += 12;
+			}
+			pcm_pack24x4((uint32_t)s[Channels - 2][i] << shift, (uint32_t)s[Channels - 1][i] << shift,
+				(uint32_t)s[0][i + 1] << shift, (uint32_t)s[1][i + 1] << shift, dest);
+			dest += 12;
+			for (size_t k = 2; k < Channels; k += 4)
+			{
+				pcm_pack24x4((uint32_t)s[k][i + 1] << shift, (uint32_t)s[k + 1][i + 1] << shift,
+					(uint32_t)s[k + 2][i + 1] << shift, (uint32_t)s[k + 3][i + 1] << shift, dest);
+				dest += 12;
+			}
+		}
+	}
+
+	// odd channel counts, and the last frame of an odd count of frames
+	for (; i < count; i++)
+	{
+		for (size_t k = 0; k < Channels; k++)
+		{
+			pcm_pack24((uint32_t)s[k][i] << shift, dest);
+			dest += 3;
+		}
+	}
+}
+
+template <size_t Channels>
+static inline void pcm_interleave32(const int32_t* const* src, size_t count, int32_t* dest, unsigned shift)
+{
+	static_assert(Channels > 0 && Channels <= TDM_MAX_CHANNELS, "TDM supports 1 to 16 slots per frame");
+
+	const int32_t* s[Channels];
+	for (size_t k = 0; k < Channels; k++)
+		s[k] = src[k];
+
+	for (size_t i = 0; i < count; i++)
+	{
+		for (size_t k = 0; k < Channels; k++)
+			dest[k] = (int32_t)((uint32_t)s[k][i] << shift);
+		dest += Channels;
+	}
+}
+
+template <size_t Channels>
+static inline void pcm_interleave_f32(const int32_t* const* src, size_t count, float* dest, unsigned shift)
+{
+	static_assert(Channels > 0 && Channels <= TDM_MAX_CHANNELS, "TDM supports 1 to 16 slots per frame");
+
+	const int32_t* s[Channels];
+	for (size_t k = 0; k < Channels; k++)
+		s[k] = src[k];
+
+	for (size_t i = 0; i < count; i++)
+	{
+		for (size_t k = 0; k < Channels; k++)
+			dest[k] = q31_to_float((int32_t)((uint32_t)s[k][i] << shift));
+		dest += Channels;
+	}
+}
+
+// Unpacks 12 bytes into 4 left-justified samples
+static inline void pcm_unpack24x4(const uint8_t* src, int32_t& a, int32_t& b, int32_t& c, int32_t& d) __attribute__((always_inline, unused));
+static inline void pcm_unpack24x4(const uint8_t* src, int32_t& a, int32_t& b, int32_t& c, int32_t& d)
+{
+	uint32_t w0, w1, w2;
+	memcpy(&w0, src, 4);
+	memcpy(&w1, src + 4, 4);
+	memcpy(&w2, src + 8, 4);
+	a = (int32_t)(w0 << 8);
+	b = (int32_t)(((w0 >> 16) & 0x0000FF00) | (w1 << 16));
+	c = (int32_t)(((w1 >> 8) & 0x00FFFF00) | (w2 << 24));
+	d = (int32_t)(w2 & 0xFFFFFF00);
+}
+
+// 3 bytes into one left-justified sample
+static inline int32_t pcm_unpack24(const uint8_t* src) __attribute__((always_inline, unused));
+static inline int32_t pcm_unpack24(const uint8_t* src)
+{
+	return (int32_t)(((uint32_t)src[0] << 8) | ((uint32_t)src[1] << 16) | ((uint32_t)src[2] << 24));
+}
+
+template <size_t Channels>
+static inline void pcm_deinterleave16(const int16_t* src, size_t count, int32_t* const* dest, unsigned shift)
+{
+	static_assert(Channels > 0 && Channels <= TDM_MAX_CHANNELS, "TDM supports 1 to 16 slots per frame");
+
+	int32_t* d[Channels];
+	for (size_t k = 0; k < Channels; k++)
+		d[k] = dest[k];
+
+	for (size_t i = 0; i < count; i++)
+	{
+		for (size_t k = 0; k < Channels; k++)
+			d[k][i] = (int32_t)((uint32_t)(uint16_t)src[k] << 16) >> shift;
+		src += Channels;
+	}
+}
+
+// Unpacks 12 bytes into 4 samples shifted down to the word width
+static inline void pcm_unpack24x4_shift(const uint8_t* src, int32_t& a, int32_t& b, int32_t& c, int32_t& d, unsigned shift) __attribute__((always_inline, unused));
+static inline void pcm_unpack24x4_shift(const uint8_t* src, int32_t& a, int32_t& b, int32_t& c, int32_t& d, unsigned shift)
+{
+	int32_t w, x, y, z;
+	pcm_unpack24x4(src, w, x, y, z);
+	a = w >> shift;
+	b = x >> shift;
+	c = y >> shift;
+	d = z >> shift;
+}
+
+template <size_t Channels>
+static inline void pcm_deinterleave24(const uint8_t* src, size_t count, int32_t* const* dest, unsigned shift)
+{
+	static_assert(Channels > 0 && Channels <= TDM_MAX_CHANNELS, "TDM supports 1 to 16 slots per frame");
+
+	int32_t* d[Channels];
+	for (size_t k = 0; k < Channels; k++)
+		d[k] = dest[k];
+
+	size_t i = 0;
+	if (Channels % 4 == 0)
+	{
+		for (; i < count; i++)
+		{
+			for (size_t k = 0; k < Channels; k += 4)
+			{
+				pcm_unpack24x4_shift(src, d[k][i], d[k + 1][i], d[k + 2][i], d[k + 3][i], shift);
+				src += 12;
+			}
+		}
+	}
+	else if (Channels % 4 == 2)
+	{
+		for (; i + 1 < count; i += 2)
+		{
+			for (size_t k = 0; k + 4 <= Channels; k += 4)
+			{
+				pcm_unpack24x4_shift(src, d[k][i], d[k + 1][i], d[k + 2][i], d[k + 3][i], shift);
+				src += 12;
+			}
+			pcm_unpack24x4_shift(src, d[Channels - 2][i], d[Channels - 1][i], d[0][i + 1], d[1][i + 1], shift);
+			src += 12;
+			for (size_t k = 2; k < Channels; k += 4)
+			{
+				pcm_unpack24x4_shift(src, d[k][i + 1], d[k + 1][i + 1], d[k + 2][i + 1], d[k + 3][i + 1], shift);
+				src += 12;
+			}
+		}
+	}
+
+	for (; i < count; i++)
+	{
+		for (size_t k = 0; k < Channels; k++)
+		{
+			d[k][i] = pcm_unpack24(src) >> shift;
+			src += 3;
+		}
+	}
+}
+
+template <size_t Channels>
+static inline void pcm_deinterleave32(const int32_t* src, size_t count, int32_t* const* dest, unsigned shift)
+{
+	static_assert(Channels > 0 && Channels <= TDM_MAX_CHANNELS, "TDM supports 1 to 16 slots per frame");
+
+	int32_t* d[Channels];
+	for (size_t k = 0; k < Channels; k++)
+		d[k] = dest[k];
+
+	for (size_t i = 0; i < count; i++)
+	{
+		for (size_t k = 0; k < Channels; k++)
+			d[k][i] = src[k] >> shift;
+		src += Channels;
+	}
+}
+
+// IEEE float samples in [-1.0, 1.0) to Q31, saturated, then shifted down to the word width
+template <size_t Channels>
+static inline void pcm_deinterleave_f32(const float* src, size_t count, int32_t* const* dest, unsigned shift)
+{
+	static_assert(Channels > 0 && Channels <= TDM_MAX_CHANNELS, "TDM supports 1 to 16 slots per frame");
+
+	int32_t* d[Channels];
+	for (size_t k = 0; k < Channels; k++)
+		d[k] = dest[k];
+
+	for (size_t i = 0; i < count; i++)
+	{
+		for (size_t k = 0; k < Channels; k++)
+			d[k][i] = float_to_q31(src[k]) >> shift;
+		src += Channels;
+	}
+}
@@ -0,0 +1,305 @@
+/* TDM frame transposes with a fused sample conversion, for the float callback
+ *
+ * Same layouts as tdm_transpose.h, but the planar side holds float samples in
+ * [-1.0, 1.0): the deinterleave scales each 32 bit word by 2^-31 on the way in and
+ * the interleave scales by 2^31, saturates and truncates on the way out. The
+ * conversion happens in registers while the frames are transposed, so the callback
+ * gets float buffers without another pass over the block.
+ *
+ * Words narrower than 32 bits (a SAI word width of 16 or 24, right-aligned in the
+ * register) take `shift` = 32 - width: the deinterleave shifts them to the top before
+ * the scaling, which also gets the sign right, the interleave shifts the saturated
+ * Q31 value back down. 0 for 32 bit words.
+ *
+ * Kernels:
+ *  tdm_deinterleave_q31_ref / tdm_interleave_q31_ref    scalar, any channel count; on the Cortex-M7
+ *                                                       one VCVT with 31 fraction bits per sample
+ *  tdm_deinterleave_q31_sse2 / tdm_interleave_q31_sse2  host, 4x4 transposes (2 or a multiple of 4 slots)
+ *  tdm_deinterleave_q31_avx2 / tdm_interleave_q31_avx2  host, 8x8 transposes (a multiple of 8 slots)
+ *  tdm_deinterleave / tdm_interleave                    float overloads of the dispatchers
+ */
+#pragma once
+
+#include "tdm_transpose.h"
+
+#define Q31_TO_FLOAT_SCALE (1.0f / 2147483648.0f)
+#define FLOAT_TO_Q31_SCALE 2147483648.0f
+
+// Sample in Q1.31 to float in [-1.0, 1.0)
+static inline float q31_to_float(int32_t x) __attribute__((always_inline, unused));
+static inline float q31_to_float(int32_t x)
+{
+#if defined(__ARM_ARCH_7EM__)
+	// one VCVT to fixed point with 31 fraction bits does the scaling
+	float f;
+	asm("vmov %0, %1\n\tvcvt.f32.s32 %0, %0, #31" : "=t" (f) : "r" (x));
+	return f;
+#else
+	return (float)x * Q31_TO_FLOAT_SCALE;
+#endif
+}
+
+// Float to Q1.31, truncated, saturated at [-1.0, 1.0 - 2^-31]
+static inline int32_t float_to_q31(float f) __attribute__((always_inline, unused));
+static inline int32_t float_to_q31(float f)
+{
+#if defined(__ARM_ARCH_7EM__)
+	// VCVT to fixed point rounds towards zero and saturates
+	int32_t x;
+	asm("vcvt.s32.f32 %1, %1, #31\n\tvmov %0, %1" : "=r" (x), "+t" (f));
+	return x;
+#else
+	float v = f * FLOAT_TO_Q31_SCALE;
+	if (v >= FLOAT_TO_Q31_SCALE)
+		return INT32_MAX;
+	if (!(v > -FLOAT_TO_Q31_SCALE))
+		return INT32_MIN;
+	return (int32_t)v;
+#endif
+}
+
+template <size_t Slot, size_t Channels>
+struct TdmSlotQ31
+{
+	static inline void deinterleave(const int32_t* frame, float* const* dest, size_t i, unsigned shift) __attribute__((always_inline))
+	{
+		dest[Slot][i] = q31_to_float((int32_t)((uint32_t)frame[Slot] << shift));
+		TdmSlotQ31<Slot + 1, Channels>::deinterleave(frame, dest, i, shift);
+	}
+
+	static inline void interleave(int32_t* frame, const float* const* src, size_t i, unsigned shift) __attribute__((always_inline))
+	{
+		frame[Slot] = float_to_q31(src[Slot][i]) >> shift;
+		TdmSlotQ31<Slot + 1, Channels>::interleave(frame, src, i, shift);
+	}
+};
+
+// end of the recursion, one past the last slot
+template <size_t Channels>
+struct TdmSlotQ31<Channels, Channels>
+{
+	static inline void deinterleave(const int32_t*, float* const*, size_t, unsigned) __attribute__((always_inline)) { }
+	static inline void interleave(int32_t*, const float* const*, size_t, unsigned) __attribute__((always_inline)) { }
+};
+
+// Converts Frames interleaved TDM frames from src into the Channels planar float buffers in dest.
+template <size_t Channels, size_t Frames>
+static inline void tdm_deinterleave_q31_ref(const int32_t* src, float* const* dest, unsigned shift = 0)
+{
+	static_assert(Channels > 0 && Channels <= TDM_MAX_CHANNELS, "TDM supports 1 to 16 slots per frame");
+
+	for (size_t i = 0; i < Frames; i++)
+	{
+		TdmSlotQ31<0, Channels>::deinterleave(src, dest, i, shift);
+		src += Channels;
+	}
+}
+
+// Converts Frames samples from the Channels planar float buffers in src into interleaved TDM frames at dest.
+template <size_t Channels, size_t Frames>
+static inline void tdm_interleave_q31_ref(const float* const* src, int32_t* dest, unsigned shift = 0)
+{
+	static_assert(Channels > 0 && Channels <= TDM_MAX_CHANNELS, "TDM supports 1 to 16 slots per frame");
+
+	for (size_t i = 0; i < Frames; i++)
+	{
+		TdmSlotQ31<0, Channels>::interleave(dest, src, i, shift);
+		dest += Channels;
+	}
+}
+
+#if defined(__SSE2__)
+
+static inline __m128 tdm_q31_to_ps(__m128i x, __m128i shift) __attribute__((always_inline, unused));
+static inline __m128 tdm_q31_to_ps(__m128i x, __m128i shift)
+{
+	return _mm_mul_ps(_mm_cvtepi32_ps(_mm_sll_epi32(x, shift)), _mm_set1_ps(Q31_TO_FLOAT_SCALE));
+}
+
+// CVTTPS2DQ returns 0x80000000 for anything out of range, which is right for the
+// negative side; flipping all bits of it where v >= 2^31 gives 0x7FFFFFFF.
+static inline __m128i tdm_ps_to_q31(__m128 f, __m128i shift) __attribute__((always_inline, unused));
+static inline __m128i tdm_ps_to_q31(__m128 f, __m128i shift)
+{
+	__m128 v = _mm_mul_ps(f, _mm_set1_ps(FLOAT_TO_Q31_SCALE));
+	__m128i over = _mm_castps_si128(_mm_cmpge_ps(v, _mm_set1_ps(FLOAT_TO_Q31_SCALE)));
+	return _mm_sra_epi32(_mm_xor_si128(_mm_cvttps_epi32(v), over), shift);
+}
+
+template <size_t Channels, size_t Frames>
+static inline void tdm_deinterleave_q31_sse2(const int32_t* src, float* const* dest, unsigned shift = 0)
+{
+	if (Frames % 4 != 0 || (Channels != 2 && Channels % 4 != 0))
+	{
+		tdm_deinterleave_q31_ref<Channels, Frames>(src, dest, shift);
+		return;
+	}
+
+	const __m128i sh = _mm_cvtsi32_si128((int)shift);
+
+	for (size_t i = 0; i < Frames; i += 4)
+	{
+		const int32_t* frame = src + i * Channels;
+		if (Channels == 2)
+		{
+			__m128i v0 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)frame), _MM_SHUFFLE(3, 1, 2, 0));
+			__m128i v1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(frame + 4)), _MM_SHUFFLE(3, 1, 2, 0));
+			_mm_storeu_ps(dest[0] + i, tdm_q31_to_ps(_mm_unpacklo_epi64(v0, v1), sh));
+			_mm_storeu_ps(dest[1] + i, tdm_q31_to_ps(_mm_unpackhi_epi64(v0, v1), sh));
+			continue;
+		}
+
+		for (size_t k = 0; k < Channels; k += 4)
+		{
+			__m128i r0 = _mm_loadu_si128((const __m128i*)(frame + 0 * Channels + k));
+			__m128i r1 = _mm_loadu_si128((const __m128i*)(frame + 1 * Channels + k));
+			__m128i r2 = _mm_loadu_si128((const __m128i*)(frame + 2 * Channels + k));
+			__m128i r3 = _mm_loadu_si128((const __m128i*)(frame + 3 * Channels + k));
+			tdm_transpose4x4(r0, r1, r2, r3);
+			_mm_storeu_ps(dest[k + 0] + i, tdm_q31_to_ps(r0, sh));
+			_mm_storeu_ps(dest[k + 1] + i, tdm_q31_to_ps(r1, sh));
+			_mm_storeu_ps(dest[k + 2] + i, tdm_q31_to_ps(r2, sh));
+			_mm_storeu_ps(dest[k + 3] + i, tdm_q31_to_ps(r3, sh));
+		}
+	}
+}
+
+template <size_t Channels, size_t Frames>
+static inline void tdm_interleave_q31_sse2(const float* const* src, int32_t* dest, unsigned shift = 0)
+{
+	if (Frames % 4 != 0 || (Channels != 2 && Channels % 4 != 0))
+	{
+		tdm_interleave_q31_ref<Channels, Frames>(src, dest, shift);
+		return;
+	}
+
+	const __m128i sh = _mm_cvtsi32_si128((int)shift);
+
+	for (size_t i = 0; i < Frames; i += 4)
+	{
+		int32_t* frame = dest + i * Channels;
+		if (Channels == 2)
+		{
+			__m128i a = tdm_ps_to_q31(_mm_loadu_ps(src[0] + i), sh);
+			__m128i b = tdm_ps_to_q31(_mm_loadu_ps(src[1] + i), sh);
+			_mm_storeu_si128((__m128i*)frame, _mm_unpacklo_epi32(a, b));
+			_mm_storeu_si128((__m128i*)(frame + 4), _mm_unpackhi_epi32(a, b));
+			continue;
+		}
+
+		for (size_t k = 0; k < Channels; k += 4)
+		{
+			__m128i r0 = tdm_ps_to_q31(_mm_loadu_ps(src[k + 0] + i), sh);
+			__m128i r1 = tdm_ps_to_q31(_mm_loadu_ps(src[k + 1] + i), sh);
+			__m128i r2 = tdm_ps_to_q31(_mm_loadu_ps(src[k + 2] + i), sh);
+			__m128i r3 = tdm_ps_to_q31(_mm_loadu_ps(src[k + 3] + i), sh);
+			tdm_transpose4x4(r0, r1, r2, r3);
+			_mm_storeu_si128((__m128i*)(frame + 0 * Channels + k), r0);
+			_mm_storeu_si128((__m128i*)(frame + 1 * Channels + k), r1);
+			_mm_storeu_si128((__m128i*)(frame + 2 * Channels + k), r2);
+			_mm_storeu_si128((__m128i*)(frame + 3 * Channels + k), r3);
+		}
+	}
+}
+
+#endif // __SSE2__
+
+#if defined(__AVX2__)
+
+static inline __m256 tdm_q31_to_ps256(__m256i x, __m128i shift) __attribute__((always_inline, unused));
+static inline __m256 tdm_q31_to_ps256(__m256i x, __m128i shift)
+{
+	return _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_sll_epi32(x, shift)), _mm256_set1_ps(Q31_TO_FLOAT_SCALE));
+}
+
+static inline __m256i tdm_ps256_to_q31(__m256 f, __m128i shift) __attribute__((always_inline, unused));
+static inline __m256i tdm_ps256_to_q31(__m256 f, __m128i shift)
+{
+	__m256 v = _mm256_mul_ps(f, _mm256_set1_ps(FLOAT_TO_Q31_SCALE));
+	__m256i over = _mm256_castps_si256(_mm256_cmp_ps(v, _mm256_set1_ps(FLOAT_TO_Q31_SCALE), _CMP_GE_OQ));
+	return _mm256_sra_epi32(_mm256_xor_si256(_mm256_cvttps_epi32(v), over), shift);
+}
+
+template <size_t Channels, size_t Frames>
+static inline void tdm_deinterleave_q31_avx2(const int32_t* src, float* const* dest, unsigned shift = 0)
+{
+	if (Frames % 8 != 0 || Channels % 8 != 0)
+	{
+		tdm_deinterleave_q31_sse2<Channels, Frames>(src, dest, shift);
+		return;
+	}
+
+	const __m128i sh = _mm_cvtsi32_si128((int)shift);
+	__m256i r[8];
+	for (size_t i = 0; i < Frames; i += 8)
+	{
+		const int32_t* frame = src + i * Channels;
+		for (size_t k = 0; k < Channels; k += 8)
+		{
+#pragma GCC unroll 8
+			for (size_t j = 0; j < 8; j++)
+				r[j] = _mm256_loadu_si256((const __m256i*)(frame + j * Channels + k));
+			tdm_transpose8x8(r);
+#pragma GCC unroll 8
+			for (size_t j = 0; j < 8; j++)
+				_mm256_storeu_ps(dest[k + j] + i, tdm_q31_to_ps256(r[j], sh));
+		}
+	}
+}
+
+template <size_t Channels, size_t Frames>
+static inline void tdm_interleave_q31_avx2(const float* const* src, int32_t* dest, unsigned shift = 0)
+{
+	if (Frames % 8 != 0 || Channels % 8 != 0)
+	{
+		tdm_interleave_q31_sse2<Channels, Frames>(src, dest, shift);
+		return;
+	}
+
+	const __m128i sh = _mm_cvtsi32_si128((int)shift);
+	__m256i r[8];
+	for (size_t i = 0; i < Frames; i += 8)
+	{
+		int32_t* frame = dest + i * Channels;
+		for (size_t k = 0; k < Channels; k += 8)
+		{
+#pragma GCC unroll 8
+			for (size_t j = 0; j < 8; j++)
+				r[j] = tdm_ps256_to_q31(_mm256_loadu_ps(src[k + j] + i), sh);
+			tdm_transpose8x8(r);
+#pragma GCC unroll 8
+			for (size_t j = 0; j < 8; j++)
+				_mm256_storeu_si256((__m256i*)(frame + j * Channels + k), r[j]);
+		}
+	}
+}
+
+#endif // __AVX2__
+
+// Converts Frames interleaved TDM frames from src into the Channels planar float buffers in dest,
+// using the fastest kernel for the target. `shift` is 32 - the word width.
+template <size_t Channels, size_t Frames>
+static inline void tdm_deinterleave(const int32_t* src, float* const* dest, unsigned shift = 0)
+{
+#if defined(__AVX2__)
+	tdm_deinterleave_q31_avx2<Channels, Frames>(src, dest, shift);
+#elif defined(__SSE2__)
+	tdm_deinterleave_q31_sse2<Channels, Frames>(src, dest, shift);
+#else
+	tdm_deinterleave_q31_ref<Channels, Frames>(src, dest, shift);
+#endif
+}
+
+// Converts Frames samples from the Channels planar float buffers in src into interleaved TDM frames at dest,
+// using the fastest kernel for the target. `shift` is 32 - the word width.
+template <size_t Channels, size_t Frames>
+static inline void tdm_interleave(const float* const* src, int32_t* dest, unsigned shift = 0)
+{
+#if defined(__AVX2__)
+	tdm_interleave_q31_avx2<Channels, Frames>(src, dest, shift);
+#elif defined(__SSE2__)
+	tdm_interleave_q31_sse2<Channels, Frames>(src, dest, shift);
+#else
+	tdm_interleave_q31_ref<Channels, Frames>(src, dest, shift);
+#endif
+}
@@ -0,0 +1,448 @@
+/* TDM frame transposes for Teensy 4.x
+ *
+ * The SAI delivers (and expects) one frame per sample period, each frame holding
+ * one 32 bit word per TDM slot: ch0 ch1 ... chN-1 ch0 ch1 ... (interleaved).
+ * The audio callback works on one buffer per channel (planar).
+ *
+ * These templates move a block of frames between both layouts. The channel count
+ * and the number of frames are compile-time constants, the per-frame channel loop
+ * is unrolled by the TdmSlot recursion so each slot compiles to a single load/store
+ * pair with a constant offset, no matter if 2, 4, 8 or 16 slots are used.
+ *
+ * Kernels:
+ *  tdm_deinterleave_ref / tdm_interleave_ref   scalar reference, any channel count
+ *  tdm_deinterleave_m7  / tdm_interleave_m7    Cortex-M7, LDM/STM bursts of 4 slots, LDRD/STRD pairs
+ *  tdm_deinterleave_sse2 / tdm_interleave_sse2 host, 4x4 transposes (2 or a multiple of 4 slots)
+ *  tdm_deinterleave_avx2 / tdm_interleave_avx2 host, 8x8 transposes (a multiple of 8 slots)
+ *  tdm_deinterleave / tdm_interleave           the best kernel available for the target
+ *
+ * The vector kernels fall back to the next kernel when the channel count or the number
+ * of frames does not fit their register width, so every kernel accepts every shape.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// The SAI frame holds at most 16 words with the FRSZ setting used in config_i2s()
+#define TDM_MAX_CHANNELS 16
+
+template <size_t Slot, size_t Channels>
+struct TdmSlot
+{
+	// dest[Slot][i] = frame[Slot] for every slot of one frame
+	static inline void deinterleave(const int32_t* frame, int32_t* const* dest, size_t i) __attribute__((always_inline))
+	{
+		dest[Slot][i] = frame[Slot];
+		TdmSlot<Slot + 1, Channels>::deinterleave(frame, dest, i);
+	}
+
+	// frame[Slot] = src[Slot][i] for every slot of one frame
+	static inline void interleave(int32_t* frame, const int32_t* const* src, size_t i) __attribute__((always_inline))
+	{
+		frame[Slot] = src[Slot][i];
+		TdmSlot<Slot + 1, Channels>::interleave(frame, src, i);
+	}
+};
+
+// end of the recursion, one past the last slot
+template <size_t Channels>
+struct TdmSlot<Channels, Channels>
+{
+	static inline void deinterleave(const int32_t*, int32_t* const*, size_t) __attribute__((always_inline)) { }
+	static inline void interleave(int32_t*, const int32_t* const*, size_t) __attribute__((always_inline)) { }
+};
+
+// Copies Frames interleaved TDM frames from src into the Channels planar buffers in dest.
+template <size_t Channels, size_t Frames>
+static inline void tdm_deinterleave_ref(const int32_t* src, int32_t* const* dest)
+{
+	static_assert(Channels > 0 && Channels <= TDM_MAX_CHANNELS, "TDM supports 1 to 16 slots per frame");
+
+	for (size_t i = 0; i < Frames; i++)
+	{
+		TdmSlot<0, Channels>::deinterleave(src, dest, i);
+		src += Channels;
+	}
+}
+
+// Copies Frames samples from the Channels planar buffers in src into interleaved TDM frames at dest.
+template <size_t Channels, size_t Frames>
+static inline void tdm_interleave_ref(const int32_t* const* src, int32_t* dest)
+{
+	static_assert(Channels > 0 && Channels <= TDM_MAX_CHANNELS, "TDM supports 1 to 16 slots per frame");
+
+	for (size_t i = 0; i < Frames; i++)
+	{
+		TdmSlot<0, Channels>::interleave(dest, src, i);
+		dest += Channels;
+	}
+}
+
+#if defined(__ARM_ARCH_7EM__)
+
+// Loads 4 consecutive words with one LDM. The register list of LDM/STM has to be in
+// ascending order, so the words go through r0-r3.
+static inline void tdm_ldm4(const int32_t* p, int32_t& a, int32_t& b, int32_t& c, int32_t& d) __attribute__((always_inline, unused));
+static inline void tdm_ldm4(const int32_t* p, int32_t& a, int32_t& b, int32_t& c, int32_t& d)
+{
+	register int32_t r0 asm("r0");
+	register int32_t r1 asm("r1");
+	register int32_t r2 asm("r2");
+	register int32_t r3 asm("r3");
+	asm("ldmia %4, {%0, %1, %2, %3}"
+		: "=&r" (r0), "=&r" (r1), "=&r" (r2), "=&r" (r3)
+		: "r" (p), "m" (*(const int32_t (*)[4])p));
+	a = r0; b = r1; c = r2; d = r3;
+}
+
+// Stores 4 consecutive words with one STM
+static inline void tdm_stm4(int32_t* p, int32_t a, int32_t b, int32_t c, int32_t d) __attribute__((always_inline, unused));
+static inline void tdm_stm4(int32_t* p, int32_t a, int32_t b, int32_t c, int32_t d)
+{
+	register int32_t r0 asm("r0") = a;
+	register int32_t r1 asm("r1") = b;
+	register int32_t r2 asm("r2") = c;
+	register int32_t r3 asm("r3") = d;
+	asm("stmia %5, {%1, %2, %3, %4}"
+		: "=m" (*(int32_t (*)[4])p)
+		: "r" (r0), "r" (r1), "r" (r2), "r" (r3), "r" (p));
+}
+
+// Loads 2 consecutive words with one LDRD, a single 64 bit access on the M7 bus
+static inline void tdm_ldrd(const int32_t* p, int32_t& a, int32_t& b) __attribute__((always_inline, unused));
+static inline void tdm_ldrd(const int32_t* p, int32_t& a, int32_t& b)
+{
+	asm("ldrd %0, %1, [%2]"
+		: "=&r" (a), "=r" (b)
+		: "r" (p), "m" (*(const int32_t (*)[2])p));
+}
+
+// Stores 2 consecutive words with one STRD
+static inline void tdm_strd(int32_t* p, int32_t a, int32_t b) __attribute__((always_inline, unused));
+static inline void tdm_strd(int32_t* p, int32_t a, int32_t b)
+{
+	asm("strd %1, %2, [%3]"
+		: "=m" (*(int32_t (*)[2])p)
+		: "r" (a), "r" (b), "r" (p));
+}
+
+// Moves the slots of one frame in bursts: 4 slots per LDM/STM, a remaining pair per LDRD/STRD.
+template <size_t Slot, size_t Channels, size_t Remaining = Channels - Slot>
+struct TdmBurst
+{
+	static inline void deinterleave(const int32_t* frame, int32_t* const* dest, size_t i) __attribute__((always_inline))
+	{
+		int32_t a, b, c, d;
+		tdm_ldm4(frame + Slot, a, b, c, d);
+		dest[Slot + 0][i] = a;
+		dest[Slot + 1][i] = b;
+		dest[Slot + 2][i] = c;
+		dest[Slot + 3][i] = d;
+		TdmBurst<Slot + 4, Channels>::deinterleave(frame, dest, i);
+	}
+
+	static inline void interleave(int32_t* frame, const int32_t* const* src, size_t i) __attribute__((always_inline))
+	{
+		tdm_stm4(frame + Slot, src[Slot + 0][i], src[Slot + 1][i], src[Slot + 2][i], src[Slot + 3][i]);
+		TdmBurst<Slot + 4, Channels>::interleave(frame, src, i);
+	}
+};
+
+template <size_t Slot, size_t Channels>
+struct TdmBurst<Slot, Channels, 3>
+{
+	static inline void deinterleave(const int32_t* frame, int32_t* const* dest, size_t i) __attribute__((always_inline))
+	{
+		TdmBurst<Slot, Channels, 2>::deinterleave(frame, dest, i);
+		dest[Slot + 2][i] = frame[Slot + 2];
+	}
+
+	static inline void interleave(int32_t* frame, const int32_t* const* src, size_t i) __attribute__((always_inline))
+	{
+		TdmBurst<Slot, Channels, 2>::interleave(frame, src, i);
+		frame[Slot + 2] = src[Slot + 2][i];
+	}
+};
+
+template <size_t Slot, size_t Channels>
+struct TdmBurst<Slot, Channels, 2>
+{
+	static inline void deinterleave(const int32_t* frame, int32_t* const* dest, size_t i) __attribute__((always_inline))
+	{
+		int32_t a, b;
+		tdm_ldrd(frame + Slot, a, b);
+		dest[Slot + 0][i] = a;
+		dest[Slot + 1][i] = b;
+	}
+
+	static inline void interleave(int32_t* frame, const int32_t* const* src, size_t i) __attribute__((always_inline))
+	{
+		tdm_strd(frame + Slot, src[Slot + 0][i], src[Slot + 1][i]);
+	}
+};
+
+template <size_t Slot, size_t Channels>
+struct TdmBurst<Slot, Channels, 1>
+{
+	static inline void deinterleave(const int32_t* frame, int32_t* const* dest, size_t i) __attribute__((always_inline))
+	{
+		dest[Slot][i] = frame[Slot];
+	}
+
+	static inline void interleave(int32_t* frame, const int32_t* const* src, size_t i) __attribute__((always_inline))
+	{
+		frame[Slot] = src[Slot][i];
+	}
+};
+
+template <size_t Slot, size_t Channels>
+struct TdmBurst<Slot, Channels, 0>
+{
+	static inline void deinterleave(const int32_t*, int32_t* const*, size_t) __attribute__((always_inline)) { }
+	static inline void interleave(int32_t*, const int32_t* const*, size_t) __attribute__((always_inline)) { }
+};
+
+template <size_t Channels, size_t Frames>
+static inline void tdm_deinterleave_m7(const int32_t* src, int32_t* const* dest)
+{
+	static_assert(Channels > 0 && Channels <= TDM_MAX_CHANNELS, "TDM supports 1 to 16 slots per frame");
+
+	for (size_t i = 0; i < Frames; i++)
+	{
+		TdmBurst<0, Channels>::deinterleave(src, dest, i);
+		src += Channels;
+	}
+}
+
+template <size_t Channels, size_t Frames>
+static inline void tdm_interleave_m7(const int32_t* const* src, int32_t* dest)
+{
+	static_assert(Channels > 0 && Channels <= TDM_MAX_CHANNELS, "TDM supports 1 to 16 slots per frame");
+
+	for (size_t i = 0; i < Frames; i++)
+	{
+		TdmBurst<0, Channels>::interleave(dest, src, i);
+		dest += Channels;
+	}
+}
+
+#endif // __ARM_ARCH_7EM__
+
+#if defined(__SSE2__)
+
+// In-place transpose of a 4x4 block of 32 bit words, rows become columns.
+static inline void tdm_transpose4x4(__m128i& r0, __m128i& r1, __m128i& r2, __m128i& r3) __attribute__((always_inline, unused));
+static inline void tdm_transpose4x4(__m128i& r0, __m128i& r1, __m128i& r2, __m128i& r3)
+{
+	__m128i t0 = _mm_unpacklo_epi32(r0, r1);
+	__m128i t1 = _mm_unpacklo_epi32(r2, r3);
+	__m128i t2 = _mm_unpackhi_epi32(r0, r1);
+	__m128i t3 = _mm_unpackhi_epi32(r2, r3);
+	r0 = _mm_unpacklo_epi64(t0, t1);
+	r1 = _mm_unpackhi_epi64(t0, t1);
+	r2 = _mm_unpacklo_epi64(t2, t3);
+	r3 = _mm_unpackhi_epi64(t2, t3);
+}
+
+template <size_t Channels, size_t Frames>
+static inline void tdm_deinterleave_sse2(const int32_t* src, int32_t* const* dest)
+{
+	if (Frames % 4 != 0 || (Channels != 2 && Channels % 4 != 0))
+	{
+		tdm_deinterleave_ref<Channels, Frames>(src, dest);
+		return;
+	}
+
+	for (size_t i = 0; i < Frames; i += 4)
+	{
+		const int32_t* frame = src + i * Channels;
+		if (Channels == 2)
+		{
+			// a0 b0 a1 b1 | a2 b2 a3 b3 -> a0 a1 a2 a3 | b0 b1 b2 b3
+			__m128i v0 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)frame), _MM_SHUFFLE(3, 1, 2, 0));
+			__m128i v1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(frame + 4)), _MM_SHUFFLE(3, 1, 2, 0));
+			_mm_storeu_si128((__m128i*)(dest[0] + i), _mm_unpacklo_epi64(v0, v1));
+			_mm_storeu_si128((__m128i*)(dest[1] + i), _mm_unpackhi_epi64(v0, v1));
+			continue;
+		}
+
+		for (size_t k = 0; k < Channels; k += 4)
+		{
+			__m128i r0 = _mm_loadu_si128((const __m128i*)(frame + 0 * Channels + k));
+			__m128i r1 = _mm_loadu_si128((const __m128i*)(frame + 1 * Channels + k));
+			__m128i r2 = _mm_loadu_si128((const __m128i*)(frame + 2 * Channels + k));
+			__m128i r3 = _mm_loadu_si128((const __m128i*)(frame + 3 * Channels + k));
+			tdm_transpose4x4(r0, r1, r2, r3);
+			_mm_storeu_si128((__m128i*)(dest[k + 0] + i), r0);
+			_mm_storeu_si128((__m128i*)(dest[k + 1] + i), r1);
+			_mm_storeu_si128((__m128i*)(dest[k + 2] + i), r2);
+			_mm_storeu_si128((__m128i*)(dest[k + 3] + i), r3);
+		}
+	}
+}
+
+template <size_t Channels, size_t Frames>
+static inline void tdm_interleave_sse2(const int32_t* const* src, int32_t* dest)
+{
+	if (Frames % 4 != 0 || (Channels != 2 && Channels % 4 != 0))
+	{
+		tdm_interleave_ref<Channels, Frames>(src, dest);
+		return;
+	}
+
+	for (size_t i = 0; i < Frames; i += 4)
+	{
+		int32_t* frame = dest + i * Channels;
+		if (Channels == 2)
+		{
+			__m128i a = _mm_loadu_si128((const __m128i*)(src[0] + i));
+			__m128i b = _mm_loadu_si128((const __m128i*)(src[1] + i));
+			_mm_storeu_si128((__m128i*)frame, _mm_unpacklo_epi32(a, b));
+			_mm_storeu_si128((__m128i*)(frame + 4), _mm_unpackhi_epi32(a, b));
+			continue;
+		}
+
+		for (size_t k = 0; k < Channels; k += 4)
+		{
+			__m128i r0 = _mm_loadu_si128((const __m128i*)(src[k + 0] + i));
+			__m128i r1 = _mm_loadu_si128((const __m128i*)(src[k + 1] + i));
+			__m128i r2 = _mm_loadu_si128((const __m128i*)(src[k + 2] + i));
+			__m128i r3 = _mm_loadu_si128((const __m128i*)(src[k + 3] + i));
+			tdm_transpose4x4(r0, r1, r2, r3);
+			_mm_storeu_si128((__m128i*)(frame + 0 * Channels + k), r0);
+			_mm_storeu_si128((__m128i*)(frame + 1 * Channels + k), r1);
+			_mm_storeu_si128((__m128i*)(frame + 2 * Channels + k), r2);
+			_mm_storeu_si128((__m128i*)(frame + 3 * Channels + k), r3);
+		}
+	}
+}
+
+#endif // __SSE2__
+
+#if defined(__AVX2__)
+
+// In-place transpose of an 8x8 block of 32 bit words, rows become columns.
+static inline void tdm_transpose8x8(__m256i* r) __attribute__((always_inline, unused));
+static inline void tdm_transpose8x8(__m256i* r)
+{
+	__m256i t0 = _mm256_unpacklo_epi32(r[0], r[1]);
+	__m256i t1 = _mm256_unpackhi_epi32(r[0], r[1]);
+	__m256i t2 = _mm256_unpacklo_epi32(r[2], r[3]);
+	__m256i t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+	__m256i t4 = _mm256_unpacklo_epi32(r[4], r[5]);
+	__m256i t5 = _mm256_unpackhi_epi32(r[4], r[5]);
+	__m256i t6 = _mm256_unpacklo_epi32(r[6], r[7]);
+	__m256i t7 = _mm256_unpackhi_epi32(r[6], r[7]);
+
+	__m256i u0 = _mm256_unpacklo_epi64(t0, t2);
+	__m256i u1 = _mm256_unpackhi_epi64(t0, t2);
+	__m256i u2 = _mm256_unpacklo_epi64(t1, t3);
+	__m256i u3 = _mm256_unpackhi_epi64(t1, t3);
+	__m256i u4 = _mm256_unpacklo_epi64(t4, t6);
+	__m256i u5 = _mm256_unpackhi_epi64(t4, t6);
+	__m256i u6 = _mm256_unpacklo_epi64(t5, t7);
+	__m256i u7 = _mm256_unpackhi_epi64(t5, t7);
+
+	r[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+	r[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+	r[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+	r[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+	r[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+	r[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+	r[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+	r[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
+
+template <size_t Channels, size_t Frames>
+static inline void tdm_deinterleave_avx2(const int32_t* src, int32_t* const* dest)
+{
+	if (Frames % 8 != 0 || Channels % 8 != 0)
+	{
+		tdm_deinterleave_sse2<Channels, Frames>(src, dest);
+		return;
+	}
+
+	__m256i r[8];
+	for (size_t i = 0; i < Frames; i += 8)
+	{
+		const int32_t* frame = src + i * Channels;
+		for (size_t k = 0; k < Channels; k += 8)
+		{
+#pragma GCC unroll 8
+			for (size_t j = 0; j < 8; j++)
+				r[j] = _mm256_loadu_si256((const __m256i*)(frame + j * Channels + k));
+			tdm_transpose8x8(r);
+#pragma GCC unroll 8
+			for (size_t j = 0; j < 8; j++)
+				_mm256_storeu_si256((__m256i*)(dest[k + j] + i), r[j]);
+		}
+	}
+}
+
+template <size_t Channels, size_t Frames>
+static inline void tdm_interleave_avx2(const int32_t* const* src, int32_t* dest)
+{
+	if (Frames % 8 != 0 || Channels % 8 != 0)
+	{
+		tdm_interleave_sse2<Channels, Frames>(src, dest);
+		return;
+	}
+
+	__m256i r[8];
+	for (size_t i = 0; i < Frames; i += 8)
+	{
+		int32_t* frame = dest + i * Channels;
+		for (size_t k = 0; k < Channels; k += 8)
+		{
+#pragma GCC unroll 8
+			for (size_t j = 0; j < 8; j++)
+				r[j] = _mm256_loadu_si256((const __m256i*)(src[k + j] + i));
+			tdm_transpose8x8(r);
+#pragma GCC unroll 8
+			for (size_t j = 0; j < 8; j++)
+				_mm256_storeu_si256((__m256i*)(frame + j * Channels + k), r[j]);
+		}
+	}
+}
+
+#endif // __AVX2__
+
+// Copies Frames interleaved TDM frames from src into the Channels planar buffers in dest,
+// using the fastest kernel for the target.
+template <size_t Channels, size_t Frames>
+static inline void tdm_deinterleave(const int32_t* src, int32_t* const* dest)
+{
+#if defined(__ARM_ARCH_7EM__)
+	tdm_deinterleave_m7<Channels, Frames>(src, dest);
+#elif defined(__AVX2__)
+	tdm_deinterleave_avx2<Channels, Frames>(src, dest);
+#elif defined(__SSE2__)
+	tdm_deinterleave_sse2<Channels, Frames>(src, dest);
+#else
+	tdm_deinterleave_ref<Channels, Frames>(src, dest);
+#endif
+}
+
+// Copies Frames samples from the Channels planar buffers in src into interleaved TDM frames at dest,
+// using the fastest kernel for the target.
+template <size_t Channels, size_t Frames>
+static inline void tdm_interleave(const int32_t* const* src, int32_t* dest)
+{
+#if defined(__ARM_ARCH_7EM__)
+	tdm_interleave_m7<Channels, Frames>(src, dest);
+#elif defined(__AVX2__)
+	tdm_interleave_avx2<Channels, Frames>(src, dest);
+#elif defined(__SSE2__)
+	tdm_interleave_sse2<Channels, Frames>(src, dest);
+#else
+	tdm_interleave_ref<Channels, Frames>(src, dest);
+#endif
+}